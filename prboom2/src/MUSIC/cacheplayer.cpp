@@ -0,0 +1,554 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *  Plays MIDI and MUS songs from PCM rendered by a synth player ahead of
+ *  time. Each song is rendered once per synth and settings, on a
+ *  background thread, and saved as a WAV file named after a hash of the
+ *  song and settings; later plays stream that file instead of running
+ *  the synth in the audio callback. Songs are streamed through a small
+ *  ring rather than held in memory, and mus_cache_size caps the cache
+ *  directory, removing the least recently played songs first.
+ *
+ *---------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cacheplayer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "i_sound.h"  // mus_cache_size
+#include "i_system.h"
+#include "lprintf.h"
+#include "m_io.h"
+#include "m_swap.h"
+#include "memio.h"
+#include "mus2mid.h"
+
+namespace {
+// Songs stream from their cache file through a ring of this many stereo
+// frames, about 24 seconds at 44.1 kHz, whatever the song's length.
+constexpr std::size_t RING_FRAMES = 1 << 20;
+
+// The filler renders this many frames at a time between checks for
+// being cancelled.
+constexpr std::size_t RENDER_FRAMES = 4096;
+
+// How long the filler sleeps when the ring is full.
+constexpr auto FILL_WAIT = std::chrono::milliseconds(10);
+
+// A render ends at this much silence, or this length.
+constexpr std::size_t SILENCE_SECONDS = 5;
+constexpr std::size_t MAX_SECONDS = 20 * 60;
+
+// Quieter than this is silence; synths may dither.
+constexpr int SILENCE_LEVEL = 16;
+
+constexpr std::size_t WAV_HEADER_SIZE = 44;
+
+struct cached_song_t {
+  std::string path;
+
+  // The synth rendering this song and its handle, while there is one.
+  const music_player_t* synth = nullptr;
+  const void* synth_handle = nullptr;
+  std::vector<byte> midi;
+
+  // The song played over and over, from the cache file. written and
+  // played count stream frames, so they only go up; stream frame n is
+  // frame n % length of the song.
+  std::unique_ptr<short[]> ring = std::make_unique<short[]>(RING_FRAMES * 2);
+  std::atomic<std::size_t> written = 0;
+  std::atomic<std::size_t> played = 0;
+
+  // The length of the song once known.
+  std::atomic<std::size_t> length = std::numeric_limits<std::size_t>::max();
+
+  std::atomic<bool> cancel = false;
+  std::thread filler;
+};
+
+std::unique_ptr<cached_song_t> cache_song;
+int cache_samplerate;
+int cache_volume = 15;
+bool cache_playing;
+bool cache_looping;
+bool cache_paused;
+
+auto CacheDir() -> std::string {
+  return std::format("{}/musiccache", I_DoomExeDir());
+}
+
+auto CachePath(const std::string& utf8) -> std::filesystem::path {
+  return std::u8string{utf8.begin(), utf8.end()};
+}
+
+auto HashBytes(std::uint64_t hash, const void* const data, const std::size_t len) -> std::uint64_t {
+  const auto* bytes = static_cast<const byte*>(data);
+
+  // FNV-1a
+  for (std::size_t i = 0; i < len; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+void PutLE(byte* const p, const std::uint32_t value, const int size) {
+  for (int i = 0; i < size; ++i) {
+    p[i] = static_cast<byte>(value >> (8 * i));
+  }
+}
+
+auto GetLE(const byte* const p, const int size) -> std::uint32_t {
+  std::uint32_t value = 0;
+  for (int i = size - 1; i >= 0; --i) {
+    value = (value << 8) | p[i];
+  }
+
+  return value;
+}
+
+void MakeWavHeader(byte* const header, const std::size_t frames) {
+  const auto data_size = static_cast<std::uint32_t>(frames * 4);
+
+  std::memcpy(header, "RIFF", 4);
+  PutLE(header + 4, data_size + WAV_HEADER_SIZE - 8, 4);
+  std::memcpy(header + 8, "WAVEfmt ", 8);
+  PutLE(header + 16, 16, 4);
+  PutLE(header + 20, 1, 2);  // PCM
+  PutLE(header + 22, 2, 2);  // stereo
+  PutLE(header + 24, cache_samplerate, 4);
+  PutLE(header + 28, cache_samplerate * 4, 4);
+  PutLE(header + 32, 4, 2);
+  PutLE(header + 34, 16, 2);
+  std::memcpy(header + 36, "data", 4);
+  PutLE(header + 40, data_size, 4);
+}
+
+// Returns the number of frames in a cache file, or 0 if it isn't one
+// this player wrote for the current sample rate.
+auto ReadWavHeader(std::FILE* const fp) -> std::size_t {
+  byte header[WAV_HEADER_SIZE];
+  byte expected[WAV_HEADER_SIZE];
+
+  if (std::fread(header, sizeof(header), 1, fp) != 1) {
+    return 0;
+  }
+
+  const std::size_t frames = GetLE(header + 40, 4) / 4;
+  MakeWavHeader(expected, frames);
+
+  return std::memcmp(header, expected, WAV_HEADER_SIZE) == 0 ? frames : 0;
+}
+
+// Removes the least recently played songs until the cache fits in
+// mus_cache_size megabytes. The song at keep is never removed.
+void TrimCache(const std::string& keep) {
+  namespace fs = std::filesystem;
+
+  struct cache_file_t {
+    fs::path path;
+    fs::file_time_type time;
+    std::uintmax_t size;
+  };
+
+  if (mus_cache_size <= 0) {
+    return;
+  }
+
+  const fs::path kept = CachePath(keep);
+  std::vector<cache_file_t> files;
+  std::uintmax_t total = 0;
+  std::error_code ec;
+
+  for (fs::directory_iterator it{CachePath(CacheDir()), ec}; !ec && it != fs::directory_iterator{}; it.increment(ec)) {
+    cache_file_t file{it->path(), it->last_write_time(ec), it->file_size(ec)};
+
+    if (!ec && file.path.extension() == ".wav") {
+      total += file.size;
+      if (file.path.filename() != kept.filename()) {
+        files.push_back(std::move(file));
+      }
+    }
+    ec.clear();
+  }
+
+  std::sort(files.begin(), files.end(), [](const cache_file_t& a, const cache_file_t& b) { return a.time < b.time; });
+
+  const std::uintmax_t limit = static_cast<std::uintmax_t>(mus_cache_size) << 20;
+  for (const cache_file_t& file : files) {
+    if (total <= limit) {
+      break;
+    }
+    if (fs::remove(file.path, ec)) {
+      total -= file.size;
+    }
+  }
+}
+
+// Marks a cache file as just played, for TrimCache.
+void TouchCacheFile(const std::string& path) {
+  std::error_code ec;
+  std::filesystem::last_write_time(CachePath(path), std::filesystem::file_time_type::clock::now(), ec);
+}
+
+// Copies into the ring what it has room for from the cache file, which
+// holds the first ready frames of the song. Once the song's length is
+// known the stream carries on from the start of the file. Returns false
+// if the file can't be read.
+auto FeedRing(cached_song_t& song, std::FILE* const fp, const std::size_t ready) -> bool {
+  const std::size_t length = song.length.load(std::memory_order_relaxed);
+  std::size_t written = song.written.load(std::memory_order_relaxed);
+
+  while (length > 0 && !song.cancel.load(std::memory_order_relaxed)) {
+    const std::size_t frame = written % length;
+    const std::size_t room = RING_FRAMES - (written - song.played.load(std::memory_order_acquire));
+    const std::size_t count =
+        std::min({room, frame < ready ? ready - frame : std::size_t{0}, RING_FRAMES - written % RING_FRAMES});
+
+    if (count == 0) {
+      break;
+    }
+
+    short* const samples = song.ring.get() + (written % RING_FRAMES) * 2;
+    if (std::fseek(fp, static_cast<long>(WAV_HEADER_SIZE + frame * 4), SEEK_SET) != 0 ||
+        std::fread(samples, 4, count, fp) != count) {
+      return false;
+    }
+
+    for (std::size_t i = 0; i < count * 2; ++i) {
+      samples[i] = doom_wtohs(samples[i]);
+    }
+
+    written += count;
+    song.written.store(written, std::memory_order_release);
+  }
+
+  return true;
+}
+
+// Filler thread for a song whose cache file is complete.
+void StreamSong(cached_song_t& song, std::FILE* const fp) {
+  const std::size_t length = song.length.load(std::memory_order_relaxed);
+
+  while (!song.cancel.load(std::memory_order_relaxed)) {
+    if (!FeedRing(song, fp, length)) {
+      lprintf(LO_WARN, "StreamSong: Error reading %s\n", song.path.c_str());
+
+      // End the song where it can't be read any further
+      const std::size_t written = song.written.load(std::memory_order_relaxed);
+      if (written < length) {
+        song.length.store(written, std::memory_order_release);
+      }
+      break;
+    }
+
+    std::this_thread::sleep_for(FILL_WAIT);
+  }
+
+  std::fclose(fp);
+}
+
+auto WriteFrames(std::FILE* const fp, const short* const samples, const std::size_t frames) -> bool {
+  std::vector<short> out(samples, samples + frames * 2);
+
+  for (short& sample : out) {
+    sample = doom_htows(sample);
+  }
+
+  return std::fseek(fp, 0, SEEK_END) == 0 && std::fwrite(out.data(), 4, frames, fp) == frames;
+}
+
+// Filler thread for a song that isn't in the cache yet. The synth
+// renders into fp, the new cache file, as fast as it can, and the ring
+// is fed from the file. Frames only go into the file once something
+// audible follows them, so the song ends where the synth goes quiet for
+// SILENCE_SECONDS.
+void RenderSong(cached_song_t& song, std::FILE* fp, const std::string& temp) {
+  const std::size_t limit = MAX_SECONDS * cache_samplerate;
+  const std::size_t silence = SILENCE_SECONDS * cache_samplerate;
+  std::vector<short> held;  // rendered since the last audible frame
+  std::size_t done = 0;
+  std::size_t end = 0;
+
+  byte header[WAV_HEADER_SIZE];
+  MakeWavHeader(header, 0);
+  bool ok = std::fwrite(header, sizeof(header), 1, fp) == 1;
+
+  while (ok && done < limit && done - end < silence && !song.cancel.load(std::memory_order_relaxed)) {
+    const std::size_t base = held.size();
+
+    held.resize(base + RENDER_FRAMES * 2);
+    song.synth->render(held.data() + base, RENDER_FRAMES);
+    done += RENDER_FRAMES;
+
+    std::size_t audible = 0;
+    for (std::size_t i = base; i < held.size(); ++i) {
+      if (std::abs(held[i]) > SILENCE_LEVEL) {
+        audible = i / 2 + 1;
+      }
+    }
+
+    if (audible > 0) {
+      ok = WriteFrames(fp, held.data(), audible);
+      held.erase(held.begin(), held.begin() + static_cast<std::ptrdiff_t>(audible * 2));
+      end += audible;
+    }
+
+    ok = ok && FeedRing(song, fp, end);
+  }
+
+  if (!song.cancel.load(std::memory_order_relaxed)) {
+    MakeWavHeader(header, end);
+    ok = ok && std::fseek(fp, 0, SEEK_SET) == 0 && std::fwrite(header, sizeof(header), 1, fp) == 1;
+  }
+  ok = (std::fclose(fp) == 0) && ok;
+
+  if (song.cancel.load(std::memory_order_relaxed) || !ok || end == 0) {
+    if (!song.cancel.load(std::memory_order_relaxed) && !ok) {
+      lprintf(LO_WARN, "RenderSong: Error writing %s\n", temp.c_str());
+    }
+    M_remove(temp.c_str());
+
+    // Without the file the song ends with what reached the ring
+    song.length.store(song.written.load(std::memory_order_relaxed), std::memory_order_release);
+    return;
+  }
+
+  M_remove(song.path.c_str());
+  if (std::rename(temp.c_str(), song.path.c_str()) != 0 || (fp = M_fopen(song.path.c_str(), "rb")) == nullptr) {
+    lprintf(LO_WARN, "RenderSong: Error saving %s\n", song.path.c_str());
+    M_remove(temp.c_str());
+    song.length.store(song.written.load(std::memory_order_relaxed), std::memory_order_release);
+    return;
+  }
+
+  song.length.store(end, std::memory_order_release);
+  TrimCache(song.path);
+  StreamSong(song, fp);
+}
+
+auto cache_name() -> const char* {
+  return "music cache player";
+}
+
+auto cache_init(const int samplerate) -> int {
+  cache_samplerate = samplerate;
+  return 1;
+}
+
+void cache_unregistersong([[maybe_unused]] const void* const handle) {
+  if (!cache_song) {
+    return;
+  }
+
+  cache_song->cancel = true;
+  if (cache_song->filler.joinable()) {
+    cache_song->filler.join();
+  }
+
+  if (cache_song->synth_handle != nullptr) {
+    cache_song->synth->stop();
+    cache_song->synth->unregistersong(cache_song->synth_handle);
+  }
+
+  cache_song.reset();
+  cache_playing = false;
+}
+
+void cache_shutdown() {
+  cache_unregistersong(nullptr);
+}
+
+void cache_setvolume(const int v) {
+  cache_volume = v;
+}
+
+void cache_pause() {
+  cache_paused = true;
+}
+
+void cache_resume() {
+  cache_paused = false;
+}
+
+// Songs only come in through Cache_RegisterSong
+auto cache_registersong([[maybe_unused]] const void* const data, [[maybe_unused]] const unsigned len) -> const void* {
+  return nullptr;
+}
+
+// The stream only runs forward, so a song plays from where it was
+// stopped, which is its start right after Cache_RegisterSong.
+void cache_play([[maybe_unused]] const void* const handle, const int looping) {
+  if (!cache_song) {
+    return;
+  }
+
+  cache_looping = static_cast<bool>(looping);
+  cache_paused = false;
+  cache_playing = true;
+}
+
+void cache_stop() {
+  cache_playing = false;
+}
+
+void cache_render(void* const dest, const unsigned nsamp) {
+  auto* out = static_cast<short*>(dest);
+  unsigned left = nsamp;
+
+  while (cache_song && cache_playing && !cache_paused && left > 0) {
+    cached_song_t& song = *cache_song;
+    const std::size_t length = song.length.load(std::memory_order_acquire);
+    const std::size_t written = song.written.load(std::memory_order_acquire);
+    const std::size_t played = song.played.load(std::memory_order_relaxed);
+
+    if (length == 0 || (!cache_looping && played >= length)) {
+      cache_playing = false;
+      break;
+    }
+
+    // Wait for the filler, which is normally far ahead
+    if (played >= written) {
+      break;
+    }
+
+    std::size_t count = std::min({static_cast<std::size_t>(left), written - played, RING_FRAMES - played % RING_FRAMES});
+    if (!cache_looping) {
+      count = std::min(count, length - played);
+    }
+
+    const short* const samples = song.ring.get() + (played % RING_FRAMES) * 2;
+
+    for (std::size_t i = 0; i < count * 2; ++i) {
+      out[i] = static_cast<short>(samples[i] * cache_volume / 15);
+    }
+
+    out += count * 2;
+    left -= static_cast<unsigned>(count);
+    song.played.store(played + count, std::memory_order_release);
+  }
+
+  std::fill_n(out, left * 2, short{0});
+}
+}  // namespace
+
+const void* Cache_RegisterSong(const music_player_t* const synth,
+                               const void* const data,
+                               const unsigned len,
+                               const char* const settings) {
+  cache_unregistersong(nullptr);
+
+  auto song = std::make_unique<cached_song_t>();
+
+  std::uint64_t hash = HashBytes(0xcbf29ce484222325ull, data, len);
+  hash = HashBytes(hash, settings, std::strlen(settings));
+  song->path = std::format("{}/{:016x}.wav", CacheDir(), hash);
+
+  std::FILE* fp = M_fopen(song->path.c_str(), "rb");
+  const std::size_t frames = (fp != nullptr) ? ReadWavHeader(fp) : 0;
+
+  if (frames > 0) {
+    TouchCacheFile(song->path);
+    song->length = frames;
+    song->filler = std::thread{StreamSong, std::ref(*song), fp};
+    lprintf(LO_INFO, "Cache_RegisterSong: Playing %s\n", song->path.c_str());
+  } else {
+    if (fp != nullptr) {
+      std::fclose(fp);
+    }
+
+    // Without somewhere to render to, the synth plays the song itself
+    const std::string temp = song->path + ".tmp";
+    M_mkdir(CacheDir().c_str());
+    fp = M_fopen(temp.c_str(), "w+b");
+    if (fp == nullptr) {
+      return nullptr;
+    }
+
+    // The synth is set up here, as midifile.cpp and memio.c allocate
+    // from the zone; only its render runs on the filler thread.
+    if (len > 4 && std::memcmp(data, "MUS", 3) == 0) {
+      MEMFILE* const instream = mem_fopen_read(data, len);
+      MEMFILE* const outstream = mem_fopen_write();
+
+      if (mus2mid(instream, outstream) == 0) {
+        void* outbuf = nullptr;
+        std::size_t outbuf_len = 0;
+
+        mem_get_buf(outstream, &outbuf, &outbuf_len);
+        song->midi.assign(static_cast<byte*>(outbuf), static_cast<byte*>(outbuf) + outbuf_len);
+      }
+
+      mem_fclose(instream);
+      mem_fclose(outstream);
+    } else {
+      song->midi.assign(static_cast<const byte*>(data), static_cast<const byte*>(data) + len);
+    }
+
+    if (!song->midi.empty()) {
+      song->synth_handle = synth->registersong(song->midi.data(), static_cast<unsigned>(song->midi.size()));
+    }
+    if (song->synth_handle == nullptr) {
+      std::fclose(fp);
+      M_remove(temp.c_str());
+      return nullptr;
+    }
+    song->synth = synth;
+
+    synth->play(song->synth_handle, 0);
+    synth->setvolume(15);
+
+    song->filler = std::thread{RenderSong, std::ref(*song), fp, temp};
+    lprintf(LO_INFO, "Cache_RegisterSong: Rendering %s with %s\n", song->path.c_str(), synth->name());
+  }
+
+  cache_song = std::move(song);
+  return cache_song.get();
+}
+
+const music_player_t cache_player = {cache_name,  cache_init,         cache_shutdown,       cache_setvolume,
+                                     cache_pause, cache_resume,       cache_registersong,   cache_unregistersong,
+                                     cache_play,  cache_stop,         cache_render};
@@ -0,0 +1,54 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *  Plays MIDI and MUS songs from PCM rendered by a synth player ahead of
+ *  time, kept on disk between runs.
+ *
+ *---------------------------------------------------------------------
+ */
+
+#ifndef CACHEPLAYER_H
+#define CACHEPLAYER_H
+
+#include "musicplayer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+extern const music_player_t cache_player;
+
+// Register a MIDI or MUS song with the cache player. It is streamed from
+// the cache file if synth has rendered it before with the same settings
+// (anything besides the song that changes synth's output), and otherwise
+// rendered by synth on a background thread and saved. Returns a handle
+// for cache_player, or NULL if the song should be played by synth as
+// usual. synth must not be used for anything else until the handle is
+// unregistered.
+const void* Cache_RegisterSong(const music_player_t* synth, const void* data, unsigned len, const char* settings);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
+
+#endif  // CACHEPLAYER_H
@@ -962,6 +962,7 @@ auto MIDI_LoadFileSpecial(midimem_t* const mf) -> midi_file_t* {
     }
     // non meta events can simply be copied (excluding delta time)
     nextev.event_type = oldev->event_type;
+    nextev.data = oldev->data;
     epos++;
   }
 
@@ -31,11 +31,12 @@
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "dbopl.h"
 #include "opl_queue.h"
 
-#include "i_sound.h"  // mus_opl_gain
+#include "i_sound.h"  // mus_opl_gain, mus_opl_core, mus_opl_block
 
 namespace {
 int init_stage_reg_writes = 1;
@@ -84,6 +85,32 @@ int register_num = 0;
 
 opl_timer_t timer1 = {12500, false, 0, 0};
 opl_timer_t timer2 = {3125, false, 0, 0};
+
+// Chip register writes made by callbacks while a block is being
+// rendered (mus_opl_block), applied when the render reaches them.
+
+struct opl_write_t {
+  unsigned int time;
+  unsigned int reg;
+  Bit8u value;
+};
+
+std::vector<opl_write_t> pending_writes;
+bool logging_writes;
+
+// Block mode moves writes back to this grid, in samples: 1/140 second,
+// the rate DMX drove the OPL at.
+
+unsigned int block_grid;
+
+// The fast core (mus_opl_core 1) runs the chip at half the output rate.
+// Every other output sample is halfway between two chip samples, so the
+// output lags the chip by one; owe_chip_sample is set when a buffer
+// ended before the last chip sample was written out.
+
+unsigned int chip_rate_shift;
+int last_chip_sample;
+bool owe_chip_sample;
 }  // namespace
 
 namespace opl {
@@ -123,11 +150,20 @@ auto OPL_Init(const unsigned int rate) -> int {
 
   mix_buffer = std::make_unique<int[]>(opl_sample_rate);
 
+  pending_writes.clear();
+  pending_writes.reserve(1024);
+  logging_writes = false;
+  block_grid = std::max(opl_sample_rate / 140, 1u);
+
+  chip_rate_shift = (mus_opl_core == 1) ? 1 : 0;
+  last_chip_sample = 0;
+  owe_chip_sample = false;
+
   // Create the emulator structure:
 
   DBOPL_InitTables();
   opl_chip = std::make_unique<Chip>(false);
-  opl_chip->Setup(opl_sample_rate);
+  opl_chip->Setup(opl_sample_rate >> chip_rate_shift);
 
   opl::init_registers();
 
@@ -185,7 +221,11 @@ void WriteRegister(const unsigned int reg_num, const unsigned int value) {
       break;
 
     default:
-      opl_chip->WriteReg(reg_num, static_cast<Bit8u>(value));
+      if (logging_writes) {
+        pending_writes.push_back({current_time, reg_num, static_cast<Bit8u>(value)});
+      } else {
+        opl_chip->WriteReg(reg_num, static_cast<Bit8u>(value));
+      }
       break;
   }
 }
@@ -215,21 +255,113 @@ void OPL_AdvanceTime(const unsigned int nsamples) {
   }
 }
 
+void WriteSample(int16_t* const buffer, const unsigned int i, const int sample) {
+  // clip
+  const int sampval = std::clamp(sample * mus_opl_gain / 50, -32768, 32767);
+  buffer[i * 2] = static_cast<std::int16_t>(sampval);
+  buffer[i * 2 + 1] = static_cast<std::int16_t>(sampval);
+}
+
 void FillBuffer(int16_t* const buffer, const unsigned int nsamples) {
   // FIXME???
   // assert(nsamples < opl_sample_rate);
 
-  opl_chip->GenerateBlock2(nsamples, mix_buffer.get());
+  if (chip_rate_shift == 0) {
+    opl_chip->GenerateBlock2(nsamples, mix_buffer.get());
 
-  // Mix into the destination buffer, doubling up into stereo.
+    // Mix into the destination buffer, doubling up into stereo.
 
-  for (unsigned int i = 0; i < nsamples; ++i) {
-    // clip
-    const int sampval = std::clamp(mix_buffer[i] * mus_opl_gain / 50, -32768, 32767);
-    buffer[i * 2] = static_cast<std::int16_t>(sampval);
-    buffer[i * 2 + 1] = static_cast<std::int16_t>(sampval);
+    for (unsigned int i = 0; i < nsamples; ++i) {
+      WriteSample(buffer, i, mix_buffer[i]);
+    }
+    return;
+  }
+
+  unsigned int i = 0;
+
+  if (owe_chip_sample && nsamples > 0) {
+    WriteSample(buffer, i++, last_chip_sample);
+    owe_chip_sample = false;
+  }
+
+  const unsigned int chip_samples = (nsamples - i + 1) / 2;
+  opl_chip->GenerateBlock2(chip_samples, mix_buffer.get());
+
+  for (unsigned int k = 0; k < chip_samples; ++k) {
+    const int sample = mix_buffer[k];
+
+    WriteSample(buffer, i++, (last_chip_sample + sample) / 2);
+    if (i < nsamples) {
+      WriteSample(buffer, i++, sample);
+    } else {
+      owe_chip_sample = true;
+    }
+    last_chip_sample = sample;
   }
 }
+
+auto BlockTime(const unsigned int time, const unsigned int start) -> unsigned int {
+  return std::max(time - time % block_grid, start);
+}
+
+// Block mode: invoke every callback due in this buffer first, logging
+// the chip writes they make, then render the buffer in runs between
+// those writes. Callbacks still see their exact time, so the song keeps
+// its tempo; only the writes are moved back to the block grid.
+
+void RenderBlock(int16_t* const buffer, const unsigned int buffer_len) {
+  const unsigned int start = current_time;
+  const unsigned int end = start + buffer_len;
+
+  if (opl_paused) {
+    pause_offset += buffer_len;
+  } else {
+    logging_writes = true;
+
+    while (!opl::queue::is_empty(*callback_queue)) {
+      const unsigned int due = opl::queue::peek(*callback_queue) + pause_offset;
+
+      if (due >= end) {
+        break;
+      }
+
+      current_time = std::max(due, start);
+
+      opl_callback_t callback;
+      std::byte* callback_data;
+      if (!opl::queue::pop(*callback_queue, callback, &callback_data)) {
+        break;
+      }
+
+      callback(callback_data);
+    }
+
+    logging_writes = false;
+  }
+
+  current_time = end;
+
+  auto write = pending_writes.cbegin();
+  unsigned int filled = 0;
+
+  while (filled < buffer_len) {
+    for (; write != pending_writes.cend() && BlockTime(write->time, start) <= start + filled; ++write) {
+      opl_chip->WriteReg(write->reg, write->value);
+    }
+
+    const unsigned int next =
+        (write != pending_writes.cend()) ? BlockTime(write->time, start) - start : buffer_len;
+
+    FillBuffer(buffer + filled * 2, next - filled);
+    filled = next;
+  }
+
+  for (; write != pending_writes.cend(); ++write) {
+    opl_chip->WriteReg(write->reg, write->value);
+  }
+
+  pending_writes.clear();
+}
 }  // namespace
 
 void OPL_Render_Samples(void* const dest, const unsigned buffer_len) {
@@ -237,6 +369,11 @@ void OPL_Render_Samples(void* const dest, const unsigned buffer_len) {
 
   auto* const buffer = static_cast<short*>(dest);
 
+  if (mus_opl_block != 0) {
+    RenderBlock(buffer, buffer_len);
+    return;
+  }
+
   // Repeatedly call the OPL emulator update function until the buffer is
   // full.
 
@@ -247,7 +384,7 @@ void OPL_Render_Samples(void* const dest, const unsigned buffer_len) {
     // the callback queue must be invoked.  We can then fill the
     // buffer with this many samples.
 
-    if (opl_paused || !opl::queue::is_empty(*callback_queue)) {
+    if (opl_paused || opl::queue::is_empty(*callback_queue)) {
       nsamples = buffer_len - filled;
     } else {
       const unsigned int next_callback_time = opl::queue::peek(*callback_queue) + pause_offset;
@@ -32,6 +32,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <list>
 #include <string_view>
 #include <vector>
@@ -40,6 +41,7 @@
 #include "memio.h"
 #include "mus2mid.h"
 
+#include "i_sound.h"
 #include "m_misc.h"
 #include "s_sound.h"
 #include "w_wad.h"
@@ -1529,6 +1531,7 @@ void I_OPL_PlaySong(const void* const handle, const int looping) {
 
   // Allocate track data.
   tracks.resize(MIDI_NumTracks(file));
+  running_tracks = tracks.size();
   song_looping = static_cast<bool>(looping);
 
   for (std::size_t i = 0; i < tracks.size(); ++i) {
@@ -1674,6 +1677,129 @@ void I_OPL_RenderSamples(void* const dest, const unsigned nsamp) {
   OPL_Render_Samples(dest, nsamp);
 }
 
+namespace {
+// Songs that never end are cut off here.
+constexpr unsigned int BENCH_MAX_SECONDS = 600;
+
+struct opl_bench_mode_t {
+  int core;
+  int block;
+  const char* name;
+};
+
+constexpr std::array<opl_bench_mode_t, 4> bench_modes = {{
+    {0, 0, "exact"},
+    {0, 1, "block"},
+    {1, 0, "fast exact"},
+    {1, 1, "fast block"},
+}};
+
+// Render a MIDI song to its end, in buffers the size the mixer asks for.
+// Returns the number of samples, and the time taken in seconds.
+auto BenchSong(const void* const midi, const std::size_t len, std::vector<short>& buffer, double& seconds)
+    -> unsigned long long {
+  const void* const handle = I_OPL_RegisterSong(midi, static_cast<unsigned>(len));
+  if (handle == nullptr) {
+    return 0;
+  }
+
+  const auto nsamp = static_cast<unsigned>(buffer.size() / 2);
+  const auto limit = static_cast<unsigned long long>(BENCH_MAX_SECONDS) * opl_sample_rate;
+  unsigned long long samples = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  I_OPL_PlaySong(handle, 0);
+  while (running_tracks > 0 && samples < limit) {
+    OPL_Render_Samples(buffer.data(), nsamp);
+    samples += nsamp;
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  I_OPL_StopSong();
+  I_OPL_UnRegisterSong(handle);
+  return samples;
+}
+}  // namespace
+
+void I_OPL_Benchmark() {
+  const int saved_core = mus_opl_core;
+  const int saved_block = mus_opl_block;
+  std::vector<short> buffer(static_cast<std::size_t>(std::max(snd_samplecount, 1)) * 2);
+  std::array<double, bench_modes.size()> total_seconds = {};
+  unsigned long long total_samples = 0;
+
+  lprintf(LO_INFO, "I_OPL_Benchmark: %d Hz, %d samples per buffer, million samples per second\n", snd_samplerate,
+          snd_samplecount);
+  lprintf(LO_INFO, "%-8s %8s", "track", "length");
+  for (const auto& mode : bench_modes) {
+    lprintf(LO_INFO, " %11s", mode.name);
+  }
+  lprintf(LO_INFO, "\n");
+
+  for (int lump = 0; lump < numlumps; ++lump) {
+    const lumpinfo_t& info = lumpinfo[lump];
+    if (std::strncmp(info.name, "D_", 2) != 0 || W_CheckNumForName(info.name) != lump) {
+      continue;
+    }
+
+    // Convert MUS to MIDI the way Exp_RegisterSongEx does
+    const void* data = W_LockLumpNum(lump);
+    const std::size_t len = W_LumpLength(lump);
+    const void* midi = data;
+    std::size_t midilen = len;
+
+    MEMFILE* const instream = mem_fopen_read(data, len);
+    MEMFILE* const outstream = mem_fopen_write();
+    if (len > 4 && std::memcmp(data, "MUS", 3) == 0 && mus2mid(instream, outstream) == 0) {
+      void* outbuf = nullptr;
+      mem_get_buf(outstream, &outbuf, &midilen);
+      midi = outbuf;
+    }
+
+    unsigned long long samples = 0;
+    std::array<double, bench_modes.size()> seconds = {};
+
+    for (std::size_t m = 0; m < bench_modes.size(); ++m) {
+      mus_opl_core = bench_modes[m].core;
+      mus_opl_block = bench_modes[m].block;
+
+      if (I_OPL_InitMusic(snd_samplerate) == 0) {
+        samples = 0;
+        break;
+      }
+      samples = BenchSong(midi, midilen, buffer, seconds[m]);
+      I_OPL_ShutdownMusic();
+    }
+
+    mem_fclose(instream);
+    mem_fclose(outstream);
+    W_UnlockLumpNum(lump);
+
+    if (samples == 0) {
+      continue;
+    }
+
+    lprintf(LO_INFO, "%-8s %7.1fs", info.name, static_cast<double>(samples) / snd_samplerate);
+    for (std::size_t m = 0; m < bench_modes.size(); ++m) {
+      lprintf(LO_INFO, " %11.2f", static_cast<double>(samples) / seconds[m] / 1e6);
+      total_seconds[m] += seconds[m];
+    }
+    lprintf(LO_INFO, "\n");
+    total_samples += samples;
+  }
+
+  if (total_samples != 0) {
+    lprintf(LO_INFO, "%-8s %7.1fs", "total", static_cast<double>(total_samples) / snd_samplerate);
+    for (const double seconds : total_seconds) {
+      lprintf(LO_INFO, " %11.2f", static_cast<double>(total_samples) / seconds / 1e6);
+    }
+    lprintf(LO_INFO, "\n");
+  }
+
+  mus_opl_core = saved_core;
+  mus_opl_block = saved_block;
+}
+
 const music_player_t opl_synth_player = {I_OPL_SynthName, I_OPL_InitMusic,  I_OPL_ShutdownMusic, I_OPL_SetMusicVolume,
                                          I_OPL_PauseSong, I_OPL_ResumeSong, I_OPL_RegisterSong,  I_OPL_UnRegisterSong,
                                          I_OPL_PlaySong,  I_OPL_StopSong,   I_OPL_RenderSamples};
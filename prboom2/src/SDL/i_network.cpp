@@ -44,8 +44,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include <fcntl.h>
 
@@ -89,11 +94,218 @@ std::size_t recvdbytes;
 
 std::unique_ptr<UDP_PACKET, decltype(&SDLNet_FreePacket)> udp_packet{nullptr, SDLNet_FreePacket};
 
+/* Network simulator
+ *
+ * Once I_SetNetSim is called every packet, both ways, waits in a queue here
+ * before it is sent or handed on, so a bad link can be reproduced against
+ * a server on the same machine. Whether a packet is lost, how long it is
+ * held and whether it is reordered are hashed from the seed, its direction
+ * and its place in that direction's sequence, so the nth packet out meets
+ * the same fate on every run however the two directions interleave. Times
+ * are kept on the simulator's own clock, which starts at 0 when it is set
+ * up, and packets due at the same time leave in the order they came.
+ */
+namespace {
+struct netsim_t {
+  bool enabled;
+  bool trace;   // print the fate of each packet
+  int latency;  // ms each way
+  int jitter;   // up to this many ms more
+  int loss;     // percent of packets dropped
+  int reorder;  // percent of packets held back behind later ones
+  std::uint32_t seed;
+  Uint32 start;  // SDL_GetTicks when the clock read 0
+};
+
+netsim_t netsim;
+
+struct simpacket_t {
+  std::vector<Uint8> data;
+  int channel;
+  IPaddress address;
+};
+
+struct simqueue_t {
+  const char* name;
+  std::uint32_t stream;  // picks this direction's draws
+  std::map<std::pair<Uint32, std::uint32_t>, simpacket_t> packets;  // by time due, then sequence
+  std::uint32_t sequence;  // packets offered so far
+  Uint32 lastdue;
+  std::size_t passed;
+  std::size_t lost;
+  std::size_t reordered;
+};
+
+simqueue_t simout{"out", 1};
+simqueue_t simin{"in", 2};
+
+// What is drawn for each packet
+enum netsim_draw_e {
+  draw_loss,
+  draw_jitter,
+  draw_reorder
+};
+
+auto NetSimNow() -> Uint32 {
+  return SDL_GetTicks() - netsim.start;
+}
+
+// splitmix64 finaliser
+auto NetSimMix(std::uint64_t x) -> std::uint64_t {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// A number in [0, n) for one draw about the current packet of q
+auto NetSimRandom(const simqueue_t& q, const netsim_draw_e draw, const int n) -> int {
+  const std::uint64_t key = (static_cast<std::uint64_t>(q.stream) << 40) | (static_cast<std::uint64_t>(draw) << 32) | q.sequence;
+  const std::uint64_t h = NetSimMix(NetSimMix(netsim.seed) ^ key);
+  return n > 0 ? static_cast<int>(h % static_cast<std::uint64_t>(n)) : 0;
+}
+
+void NetSimPrint(const char* const s) {
+#ifndef PRBOOM_SERVER
+  lprintf(LO_INFO, "%s", s);
+#else
+  std::fputs(s, stdout);
+#endif
+}
+
+void NetSimQueue(simqueue_t& q, const UDP_PACKET* const packet) {
+  char buf[80];
+  const std::uint32_t sequence = q.sequence;
+
+  if (NetSimRandom(q, draw_loss, 100) < netsim.loss) {
+    if (netsim.trace) {
+      std::snprintf(buf, sizeof(buf), "netsim %s %u: lost\n", q.name, sequence);
+      NetSimPrint(buf);
+    }
+    q.sequence++;
+    q.lost++;
+    return;
+  }
+
+  const Uint32 now = NetSimNow();
+  Uint32 delay = netsim.latency + NetSimRandom(q, draw_jitter, netsim.jitter + 1);
+  const bool reordered = NetSimRandom(q, draw_reorder, 100) < netsim.reorder;
+  Uint32 due;
+
+  if (reordered) {
+    delay += netsim.latency + netsim.jitter + 1;
+    due = now + delay;
+    q.reordered++;
+  } else {
+    // Jitter on its own keeps packets in order
+    due = std::max(now + delay, q.lastdue);
+    q.lastdue = due;
+  }
+  if (netsim.trace) {
+    std::snprintf(buf, sizeof(buf), "netsim %s %u: +%ums%s\n", q.name, sequence, delay, reordered ? " reordered" : "");
+    NetSimPrint(buf);
+  }
+
+  q.packets.emplace(std::make_pair(due, sequence), simpacket_t{{packet->data, packet->data + packet->len}, packet->channel, packet->address});
+  q.sequence++;
+  q.passed++;
+}
+
+// Takes the first packet due from q into packet
+auto NetSimNext(simqueue_t& q, UDP_PACKET* const packet) -> bool {
+  if (q.packets.empty() || q.packets.begin()->first.first > NetSimNow()) {
+    return false;
+  }
+
+  const simpacket_t& p = q.packets.begin()->second;
+  std::copy(p.data.cbegin(), p.data.cend(), packet->data);
+  packet->len = static_cast<int>(p.data.size());
+  packet->channel = p.channel;
+  packet->address = p.address;
+  q.packets.erase(q.packets.begin());
+  return true;
+}
+
+void NetSimSend() {
+  while (NetSimNext(simout, udp_packet.get())) {
+    SDLNet_UDP_Send(udp_socket, udp_packet->channel, udp_packet.get());
+  }
+}
+
+// ms until the next queued packet is due, or ms if that's sooner
+auto NetSimWait(int ms) -> int {
+  const Uint32 now = NetSimNow();
+
+  for (const simqueue_t* q : {&simout, &simin}) {
+    if (!q->packets.empty()) {
+      const Uint32 due = q->packets.begin()->first.first;
+      ms = std::min(ms, due > now ? static_cast<int>(due - now) : 0);
+    }
+  }
+  return ms;
+}
+
+void NetSimReport() {
+  char buf[200];
+
+  std::snprintf(buf, sizeof(buf), "I_ShutdownNetwork: simulated %zu packets out (%zu lost, %zu reordered), %zu in (%zu lost, %zu reordered)\n",
+                simout.passed + simout.lost, simout.lost, simout.reordered,
+                simin.passed + simin.lost, simin.lost, simin.reordered);
+  NetSimPrint(buf);
+}
+
+// Sends udp_packet, or queues it when simulating
+void SendUDPPacket(const int channel) {
+  if (netsim.enabled) {
+    udp_packet->channel = channel;
+    NetSimQueue(simout, udp_packet.get());
+    NetSimSend();
+    return;
+  }
+  SDLNet_UDP_Send(udp_socket, channel, udp_packet.get());
+}
+}  // namespace
+
+/* I_SetNetSim
+ *
+ * Simulate a bad network; spec is latency,jitter,loss,reorder[,seed] with
+ * times in ms and loss and reordering in percent. With trace the fate of
+ * each packet is printed as it is queued.
+ */
+void I_SetNetSim(const char* const spec, const dboolean trace) {
+  unsigned int seed = 1;
+
+  netsim = netsim_t{};
+  if (std::sscanf(spec, "%d,%d,%d,%d,%u", &netsim.latency, &netsim.jitter, &netsim.loss, &netsim.reorder, &seed) < 1) {
+    I_Error("I_SetNetSim: bad specification \"%s\"", spec);
+  }
+
+  netsim.latency = std::max(netsim.latency, 0);
+  netsim.jitter = std::max(netsim.jitter, 0);
+  netsim.seed = seed;
+  netsim.trace = trace != 0;
+  netsim.start = SDL_GetTicks();
+  netsim.enabled = true;
+  for (simqueue_t* q : {&simout, &simin}) {
+    q->packets.clear();
+    q->sequence = 0;
+    q->lastdue = 0;
+    q->passed = q->lost = q->reordered = 0;
+  }
+}
+
+auto I_NetSimEnabled() -> dboolean {
+  return netsim.enabled;
+}
+
 /* I_ShutdownNetwork
  *
  * Shutdown the network code
  */
 void I_ShutdownNetwork() {
+  if (netsim.enabled) {
+    NetSimReport();
+  }
   udp_packet.reset();
   SDLNet_Quit();
 }
@@ -120,13 +332,30 @@ void I_FreePacket([[maybe_unused]] std::unique_ptr<UDP_PACKET, decltype(&SDLNet_
 }
 
 /* cph - I_WaitForPacket - use select(2) via SDL_net's interface
- * No more I_uSleep loop kludge */
+ * No more I_uSleep loop kludge
+ * The socket set is kept from call to call, the server waits on every pass */
 
 void I_WaitForPacket(const int ms) {
-  const SDLNet_SocketSet ss = SDLNet_AllocSocketSet(1);
-  SDLNet_UDP_AddSocket(ss, udp_socket);
+  static SDLNet_SocketSet ss;
+  static UDP_SOCKET ss_socket;
+
+  if (ss == nullptr || ss_socket != udp_socket) {
+    if (ss != nullptr) {
+      SDLNet_FreeSocketSet(ss);
+    }
+    ss = SDLNet_AllocSocketSet(1);
+    SDLNet_UDP_AddSocket(ss, udp_socket);
+    ss_socket = udp_socket;
+  }
+
+  if (netsim.enabled) {
+    // Wake in time to send or hand on the next queued packet
+    NetSimSend();
+    SDLNet_CheckSockets(ss, NetSimWait(ms));
+    NetSimSend();
+    return;
+  }
   SDLNet_CheckSockets(ss, ms);
-  SDLNet_FreeSocketSet(ss);
 }
 
 /* I_ConnectToServer
@@ -152,7 +381,7 @@ auto I_ConnectToServer(const char* serv) -> int {
     server = server.substr(0, delim_idx);
   }
 
-  SDLNet_ResolveHost(&serverIP, server.data(), port);
+  SDLNet_ResolveHost(&serverIP, std::string{server}.c_str(), port);
   if (serverIP.host == INADDR_NONE) {
     return -1;
   }
@@ -240,7 +469,18 @@ auto ChecksumPacket(const packet_header_t* buffer, std::size_t len) -> byte {
 }  // namespace
 
 auto I_GetPacket(packet_header_t* buffer, const std::size_t buflen) -> std::size_t {
-  const int status = SDLNet_UDP_Recv(udp_socket, udp_packet.get());
+  int status;
+
+  if (netsim.enabled) {
+    NetSimSend();
+    while (SDLNet_UDP_Recv(udp_socket, udp_packet.get()) > 0) {
+      NetSimQueue(simin, udp_packet.get());
+    }
+    status = NetSimNext(simin, udp_packet.get()) ? 1 : 0;
+  } else {
+    status = SDLNet_UDP_Recv(udp_socket, udp_packet.get());
+  }
+
   auto len = static_cast<std::size_t>(udp_packet->len);
   if (buflen < len) {
     len = buflen;
@@ -267,13 +507,25 @@ auto I_GetPacket(packet_header_t* buffer, const std::size_t buflen) -> std::size
 void I_SendPacket(packet_header_t* const packet, const std::size_t len) {
   packet->checksum = ChecksumPacket(packet, len);
   std::copy_n(reinterpret_cast<const std::byte*>(packet), (udp_packet->len = len), reinterpret_cast<std::byte*>(udp_packet->data));
-  SDLNet_UDP_Send(udp_socket, 0, udp_packet.get());
+  SendUDPPacket(0);
 }
 
 void I_SendPacketTo(packet_header_t* packet, const std::size_t len, UDP_CHANNEL* const to) {
   packet->checksum = ChecksumPacket(packet, len);
   std::copy_n(reinterpret_cast<const std::byte*>(packet), (udp_packet->len = len), reinterpret_cast<std::byte*>(udp_packet->data));
-  SDLNet_UDP_Send(udp_socket, *to, udp_packet.get());
+  SendUDPPacket(*to);
+}
+
+/* I_SendPacketToAddress
+ *
+ * Send to an address without binding it to a channel, so the server
+ * isn't limited to SDLNET_MAX_UDPCHANNELS clients
+ */
+void I_SendPacketToAddress(packet_header_t* packet, const std::size_t len, IPaddress* const to) {
+  packet->checksum = ChecksumPacket(packet, len);
+  std::copy_n(reinterpret_cast<const std::byte*>(packet), (udp_packet->len = len), reinterpret_cast<std::byte*>(udp_packet->data));
+  udp_packet->address = *to;
+  SendUDPPacket(-1);
 }
 
 void I_PrintAddress([[maybe_unused]] std::FILE* fp, [[maybe_unused]] UDP_CHANNEL* addr) {
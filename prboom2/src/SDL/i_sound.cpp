@@ -42,7 +42,10 @@
 #include <algorithm>
 #include <array>
 #include <format>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -64,11 +67,17 @@
 #include <SDL_mixer.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIX_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "z_zone.h"
 
 #include "i_sound.h"
 #include "lprintf.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_misc.h"
 #include "m_swap.h"
 #include "s_sound.h"
@@ -87,6 +96,7 @@
 
 int snd_pcspeaker;
 int lowpass_filter;
+int snd_resample;
 
 // The number of internal mixing channels,
 //  the samples calculated for each mixing step,
@@ -126,6 +136,9 @@ struct channel_info_t {
   // The channel data pointers, start and end.
   const unsigned char* data;
   const unsigned char* enddata;
+  // Samples already resampled to snd_samplerate, see GetCachedSfx
+  const int* cached;
+  const int* cachedend;
   // Time/gametic that the channel started playing,
   //  used to determine oldest, which automatically
   //  has lowest priority.
@@ -164,21 +177,12 @@ namespace {
 void stopchan(const int i) {
   if (channelinfo[i].data != nullptr) { /* cph - prevent excess unlocks */
     channelinfo[i].data = nullptr;
+    channelinfo[i].cached = nullptr;
   }
 }
 
-//
-// This function adds a sound to the
-//  list of currently active sounds,
-//  which is maintained as a given number
-//  (eight, usually) of internal channels.
-// Returns a handle.
-//
-auto addsfx(const int sfxid, const int channel, const unsigned char* const data, const std::size_t len) -> int {
-  channel_info_t* const ci = &channelinfo[channel];
-
-  stopchan(channel);
-
+// Finds the samples of a DMX or WAV sound lump
+void ParseSfx(channel_info_t* const ci, const unsigned char* const data, const std::size_t len) {
   if (std::string_view{reinterpret_cast<const char*>(data), 4} == "RIFF" && std::string_view{reinterpret_cast<const char*>(data) + 8, 8} == "WAVEfmt ") {
     // FIXME: can't handle stereo wavs
     // ci->channels = data[22] | (data[23] << 8);
@@ -215,6 +219,28 @@ auto addsfx(const int sfxid, const int channel, const unsigned char* const data,
   }
 
   ci->stepremainder = 0;
+}
+
+//
+// This function adds a sound to the
+//  list of currently active sounds,
+//  which is maintained as a given number
+//  (eight, usually) of internal channels.
+// Returns a handle.
+//
+auto addsfx(const int sfxid, const int channel, const unsigned char* const data, const std::size_t len,
+            const std::vector<int>* const cached) -> int {
+  channel_info_t* const ci = &channelinfo[channel];
+
+  stopchan(channel);
+
+  ParseSfx(ci, data, len);
+
+  if (cached != nullptr) {
+    ci->cached = cached->data();
+    ci->cachedend = cached->data() + cached->size();
+  }
+
   // Should be gametic, I presume.
   ci->starttime = gametic;
 
@@ -296,6 +322,8 @@ void updateSoundParams(const int handle, const int volume, int seperation, const
   channelinfo[slot].leftvol = leftvol;
   channelinfo[slot].rightvol = rightvol;
 }
+
+auto GetCachedSfx(int lump, const unsigned char* data, std::size_t len) -> const std::vector<int>*;
 }  // namespace
 
 void I_UpdateSoundParams(const int handle, const int volume, const int seperation, const int pitch) {
@@ -359,6 +387,25 @@ auto I_GetSfxLumpNum(sfxinfo_t* sfx) -> int {
   return W_CheckNumForName(namebuf.data());  // e6y: make missing sounds non-fatal
 }
 
+//
+// Resamples a sound lump ahead of time for snd_resample, so its first
+//  I_StartSound doesn't have to.
+//
+void I_PrecacheSound(const int lump) {
+  if (!sound_inited || snd_pcspeaker != 0 || lump < 0) {
+    return;
+  }
+
+  const std::size_t len = W_LumpLength(lump);
+
+  if (len <= 8) {
+    return;
+  }
+
+  GetCachedSfx(lump, static_cast<const unsigned char*>(W_LockLumpNum(lump)), len - 8);
+  W_UnlockLumpNum(lump);
+}
+
 //
 // Starting a sound means adding it
 //  to the current list of active sounds
@@ -407,11 +454,12 @@ auto I_StartSound(const int id, const int channel, const int vol, const int sep,
   // use locking which makes sure the sound data is in a malloced area and
   // not in a memory mapped one
   const auto* const data = static_cast<const unsigned char*>(W_LockLumpNum(lump));
+  const auto* const cached = GetCachedSfx(lump, data, len);
 
   SDL_LockMutex(sfxmutex);
 
   // Returns a handle (not used).
-  addsfx(id, channel, data, len);
+  addsfx(id, channel, data, len, cached);
   updateSoundParams(channel, vol, sep, pitch);
 
   SDL_UnlockMutex(sfxmutex);
@@ -486,6 +534,376 @@ void Exp_UpdateMusic(void* buff, unsigned nsamp);
 extern "C" void PCSound_Mix_Callback(void* udata, Uint8* stream, int len);
 
 namespace {
+//
+// The mixer works on blocks of output frames. Every active channel is
+// resampled into a block of ints, then adds leftvol * s / 49152 to
+// 32-bit accumulators for the block, and one last pass saturates the
+// accumulators into the stream. Each channel adds exactly what it did
+// when the channels were mixed one frame at a time, and integer sums do
+// not depend on order, so the output is the same.
+//
+
+constexpr int MIX_BLOCK = 256;
+
+// Resamples up to count frames of a channel, as many as are left
+template <bool sixteen, bool lowpass>
+auto ResampleChannel(channel_info_t* const ci, int* const s, const int count) -> int {
+  int i = 0;
+
+  while (i < count) {
+    int v;
+
+    // linear filtering
+    // the old SRC did linear interpolation back into 8 bit, and then expanded to 16 bit.
+    // this does interpolation and 8->16 at same time, allowing slightly higher quality
+    if constexpr (sixteen) {
+      v = static_cast<short>(ci->data[0] | (ci->data[1] << 8)) * (255 - (ci->stepremainder >> 8))
+          + static_cast<short>(ci->data[2] | (ci->data[3] << 8)) * (ci->stepremainder >> 8);
+    } else {
+      v = (ci->data[0] * (0x10000 - ci->stepremainder)) + (ci->data[1] * (ci->stepremainder))
+          - 0x800000;  // convert to signed
+    }
+
+    if constexpr (lowpass) {
+      v = ci->prevS + ci->alpha * (v - ci->prevS);
+      ci->prevS = v;
+    }
+
+    s[i++] = v;
+
+    ci->stepremainder += ci->step;
+    ci->data += (ci->stepremainder >> 16) * (sixteen ? 2 : 1);
+    ci->stepremainder &= 0xffffu;
+
+    if (ci->data >= ci->enddata) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+auto ResampleChannel(channel_info_t* const ci, int* const s, const int count) -> int {
+  if (ci->bits == 16) {
+    return lowpass_filter ? ResampleChannel<true, true>(ci, s, count)
+                          : ResampleChannel<true, false>(ci, s, count);
+  }
+  return lowpass_filter ? ResampleChannel<false, true>(ci, s, count)
+                        : ResampleChannel<false, false>(ci, s, count);
+}
+
+//
+// SFX cache
+//
+// With snd_resample set, every sound lump is resampled to snd_samplerate
+// when S_Init precaches the sounds (or, after a settings change, the next
+// time it plays), and channels then step through the result one sample
+// per output frame. snd_resample 1 runs the mixer's own linear
+// interpolation and lowpass ahead of time and keeps the samples it makes
+// whole, so the output is bit-identical to mixing from the lump; 2 uses a
+// windowed sinc instead. The pool is bounded: the sounds played least
+// recently are dropped once it is full, other than ones still playing.
+//
+// Pitched sounds change their step while they play, so they are always
+// mixed from the lump.
+//
+
+struct sfx_cache_t {
+  // what the samples were made for
+  int samplerate;
+  int resample;
+  int lowpass;
+  unsigned int lastused;  // sfx_cache_clock when it was last asked for
+  std::vector<int> samples;  // at the mixer's 24 bit scale
+};
+
+constexpr std::size_t SFX_CACHE_LIMIT = 16 << 20;  // bytes of samples kept
+
+std::unordered_map<int, sfx_cache_t> sfx_cache;
+std::size_t sfx_cache_bytes;
+unsigned int sfx_cache_clock;
+
+constexpr int SINC_TAPS = 8;      // on each side of a sample
+constexpr int SINC_PHASES = 256;  // positions between two source samples
+
+// Windowed-sinc coefficients for each phase, built for one pair of rates
+struct sinc_table_t {
+  unsigned int from = 0;
+  int to = 0;
+  std::vector<float> taps;  // SINC_PHASES + 1 rows of 2 * SINC_TAPS
+};
+
+sinc_table_t sinc_table;
+
+auto SincTable(const unsigned int from, const int to) -> const float* {
+  constexpr double pi = 3.14159265358979323846;
+
+  if (sinc_table.from != from || sinc_table.to != to) {
+    // below the Nyquist frequency of the lower of the two rates
+    const double cutoff = std::min(1.0, static_cast<double>(to) / from);
+
+    sinc_table.from = from;
+    sinc_table.to = to;
+    sinc_table.taps.resize((SINC_PHASES + 1) * 2 * SINC_TAPS);
+
+    for (int phase = 0; phase <= SINC_PHASES; ++phase) {
+      for (int j = 0; j < 2 * SINC_TAPS; ++j) {
+        const int k = j - SINC_TAPS + 1;  // source sample, relative to the centre
+        const double x = static_cast<double>(phase) / SINC_PHASES - k;
+        const double window = 0.42 + 0.5 * std::cos(pi * x / SINC_TAPS) + 0.08 * std::cos(2 * pi * x / SINC_TAPS);
+        // x is 0 at the centre of phase 0 and again at k == 1 in the last
+        // row, which is only there to interpolate towards
+        const double sinc = x == 0.0 ? 1 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+
+        sinc_table.taps[phase * 2 * SINC_TAPS + j] = static_cast<float>(cutoff * sinc * window);
+      }
+    }
+  }
+  return sinc_table.taps.data();
+}
+
+// Source sample k of a sound at the mixer's scale, silence outside it
+auto SourceSample(const channel_info_t& src, const int count, const int k) -> int {
+  if (k < 0 || k >= count) {
+    return 0;
+  }
+
+  if (src.bits == 16) {
+    return static_cast<short>(src.data[k * 2] | (src.data[k * 2 + 1] << 8)) * 255;
+  }
+  return (src.data[k] - 128) * 65536;
+}
+
+// Replaces samples with a windowed-sinc resampling at the same positions
+void ResampleSinc(const channel_info_t& src, const unsigned int step, std::vector<int>& samples) {
+  const int count = (src.bits == 16) ? (src.enddata - src.data) / 2 + 1 : src.enddata - src.data + 1;
+  const float* const table = SincTable(src.samplerate, snd_samplerate);
+  int prev = 0;
+
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    const std::uint64_t pos = static_cast<std::uint64_t>(step) * i;
+    const int center = static_cast<int>(pos >> 16);
+    // interpolated between the two nearest phases in the table
+    const std::uint64_t phase = (pos & 0xffff) * SINC_PHASES;
+    const float* const taps = table + (phase >> 16) * 2 * SINC_TAPS;
+    const double f = (phase & 0xffff) / 65536.0;
+    double sum = 0;
+
+    for (int j = 0; j < 2 * SINC_TAPS; ++j) {
+      const double tap = taps[j] + f * (taps[j + 2 * SINC_TAPS] - taps[j]);
+      sum += SourceSample(src, count, center - SINC_TAPS + 1 + j) * tap;
+    }
+
+    int v = static_cast<int>(std::clamp(sum, -16777216.0, 16777215.0));
+
+    if (lowpass_filter != 0) {
+      v = prev + src.alpha * (v - prev);
+      prev = v;
+    }
+
+    samples[i] = v;
+  }
+}
+
+// Whether a channel is playing from an entry; sfxmutex must be held
+auto SfxCacheInUse(const sfx_cache_t& entry) -> bool {
+  const int* const begin = entry.samples.data();
+  const int* const end = begin + entry.samples.size();
+
+  for (int i = 0; i < MAX_CHANNELS; i++) {
+    const int* const cached = channelinfo[i].cached;
+
+    if (cached != nullptr && cached >= begin && cached <= end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Drops the least recently used entries until bytes more fit, other than
+// keep and ones still playing; sfxmutex must be held
+void SfxCacheEvict(const std::size_t bytes, const int keep) {
+  while (sfx_cache_bytes + bytes > SFX_CACHE_LIMIT) {
+    auto victim = sfx_cache.end();
+
+    for (auto it = sfx_cache.begin(); it != sfx_cache.end(); ++it) {
+      if (it->first != keep && !it->second.samples.empty() && (victim == sfx_cache.end() || it->second.lastused < victim->second.lastused)
+          && !SfxCacheInUse(it->second)) {
+        victim = it;
+      }
+    }
+
+    if (victim == sfx_cache.end()) {
+      break;  // everything left is playing, go over rather than cut it off
+    }
+    sfx_cache_bytes -= victim->second.samples.size() * sizeof(int);
+    sfx_cache.erase(victim);
+  }
+}
+
+// Samples of a sound lump at snd_samplerate, nullptr to mix from the lump
+auto GetCachedSfx(const int lump, const unsigned char* const data, const std::size_t len) -> const std::vector<int>* {
+  if (snd_resample == 0 || pitched_sounds != 0) {
+    return nullptr;
+  }
+
+  sfx_cache_t& entry = sfx_cache[lump];
+
+  entry.lastused = ++sfx_cache_clock;
+  if (!entry.samples.empty() && entry.samplerate == snd_samplerate && entry.resample == snd_resample
+      && entry.lowpass == lowpass_filter) {
+    return &entry.samples;
+  }
+
+  channel_info_t ci{};
+  ParseSfx(&ci, data, len);
+  ci.step = (ci.samplerate << 16) / snd_samplerate;
+
+  if (ci.step == 0 || ci.data >= ci.enddata) {
+    return nullptr;
+  }
+
+  const channel_info_t src = ci;
+  std::vector<int> samples;
+  int block[MIX_BLOCK];
+
+  do {
+    const int n = ResampleChannel(&ci, block, MIX_BLOCK);
+    samples.insert(samples.end(), block, block + n);
+  } while (ci.data < ci.enddata);
+
+  if (snd_resample == 2) {
+    ResampleSinc(src, src.step, samples);
+  }
+
+  // the settings changed since the entry was made, stop the channels
+  // still playing from it before it goes
+  SDL_LockMutex(sfxmutex);
+  for (int i = 0; i < MAX_CHANNELS; i++) {
+    const int* const cached = channelinfo[i].cached;
+
+    if (cached != nullptr && cached >= entry.samples.data() && cached <= entry.samples.data() + entry.samples.size()) {
+      stopchan(i);
+    }
+  }
+  sfx_cache_bytes -= entry.samples.size() * sizeof(int);
+  SfxCacheEvict(samples.size() * sizeof(int), lump);
+  entry.samplerate = snd_samplerate;
+  entry.resample = snd_resample;
+  entry.lowpass = lowpass_filter;
+  entry.samples.swap(samples);
+  sfx_cache_bytes += entry.samples.size() * sizeof(int);
+  SDL_UnlockMutex(sfxmutex);
+
+  return &entry.samples;
+}
+
+// full loudness (vol=127) is actually 127/191
+void AddChannel(int* const mixl, int* const mixr, const int* const s, const int count,
+                const int leftvol, const int rightvol) {
+  int i = 0;
+
+#ifdef MIX_SSE2
+  const __m128i lv = _mm_set1_epi32(leftvol);
+  const __m128i rv = _mm_set1_epi32(rightvol);
+  const __m128i round = _mm_set1_epi32(16383);
+  const __m128 three = _mm_set1_ps(3.0f);
+
+  // v * vol / 49152, truncated like the int division: vol * s fits in 32
+  // bits, /16384 is a shift corrected towards zero, and what is left is
+  // small enough for an exact float /3
+  const auto scale = [&](const __m128i v, const __m128i vol) {
+    const __m128i even = _mm_mul_epu32(v, vol);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_si128(v, 4), vol);
+    __m128i x = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                   _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+
+    x = _mm_srai_epi32(_mm_add_epi32(x, _mm_and_si128(_mm_srai_epi32(x, 31), round)), 14);
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(x), three));
+  };
+
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    auto* const l = reinterpret_cast<__m128i*>(mixl + i);
+    auto* const r = reinterpret_cast<__m128i*>(mixr + i);
+
+    _mm_storeu_si128(l, _mm_add_epi32(_mm_loadu_si128(l), scale(v, lv)));
+    _mm_storeu_si128(r, _mm_add_epi32(_mm_loadu_si128(r), scale(v, rv)));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    mixl[i] += leftvol * s[i] / 49152;   // >> 15;
+    mixr[i] += rightvol * s[i] / 49152;  // >> 15;
+  }
+}
+
+// Clamp to range and interleave into the stream
+void StoreBlock(signed short* const out, const int* const mixl, const int* const mixr, const int count) {
+  int i = 0;
+
+#ifdef MIX_SSE2
+  for (; i + 4 <= count; i += 4) {
+    const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mixl + i));
+    const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mixr + i));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2),
+                     _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r)));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    out[i * 2] = static_cast<signed short>(std::clamp<int>(mixl[i], SHRT_MIN, SHRT_MAX));
+    out[i * 2 + 1] = static_cast<signed short>(std::clamp<int>(mixr[i], SHRT_MIN, SHRT_MAX));
+  }
+}
+
+// Mixes all channels into frames stereo frames of out, on top of what is
+// there (music)
+void MixChannels(signed short* out, int frames) {
+  while (frames > 0) {
+    const int count = std::min(frames, MIX_BLOCK);
+    int mixl[MIX_BLOCK];
+    int mixr[MIX_BLOCK];
+    int s[MIX_BLOCK];
+
+    for (int i = 0; i < count; ++i) {
+      mixl[i] = out[i * 2];
+      mixr[i] = out[i * 2 + 1];
+    }
+
+    for (int chan = 0; chan < numChannels; chan++) {
+      channel_info_t* const ci = channelinfo + chan;
+
+      if (ci->data == nullptr) {
+        continue;
+      }
+
+      if (ci->cached != nullptr) {
+        const int n = std::min<int>(count, ci->cachedend - ci->cached);
+
+        AddChannel(mixl, mixr, ci->cached, n, ci->leftvol, ci->rightvol);
+        ci->cached += n;
+        if (ci->cached == ci->cachedend) {
+          stopchan(chan);
+        }
+      } else {
+        const int n = ResampleChannel(ci, s, count);
+
+        AddChannel(mixl, mixr, s, n, ci->leftvol, ci->rightvol);
+        if (ci->data >= ci->enddata) {
+          stopchan(chan);
+        }
+      }
+    }
+
+    StoreBlock(out, mixl, mixr, count);
+
+    out += count * 2;
+    frames -= count;
+  }
+}
+
 void I_UpdateSound(void* const unused, Uint8* const stream, const int len) {
   if (snd_midiplayer == nullptr) {  // This is but a temporary fix. Please do remove after a more definitive one!
     std::fill_n(stream, len, 0);
@@ -513,107 +931,11 @@ void I_UpdateSound(void* const unused, Uint8* const stream, const int len) {
   }
 
   SDL_LockMutex(sfxmutex);
+  BENCH_START(BENCH_MIXER);
   // Left and right channel
   //  are in audio stream, alternating.
-  auto* leftout = reinterpret_cast<signed short*>(stream);
-  auto* rightout = reinterpret_cast<signed short*>(stream) + 1;
-
-  // Step in stream, left and right, thus two.
-  const int step = 2;
-
-  // Determine end, for left channel only
-  //  (right channel is implicit).
-  const auto* const leftend = reinterpret_cast<signed short*>(leftout + (len / 4) * step);
-
-  // Mix sounds into the mixing buffer.
-  // Loop over step*SAMPLECOUNT,
-  //  that is 512 values for two channels.
-  while (leftout != leftend) {
-    // Mix current sound data.
-    // Data, from raw sound, for right and left.
-    // register unsigned char sample;
-    //
-    // Reset left/right value.
-    // dl = 0;
-    // dr = 0;
-    int dl = *leftout;
-    int dr = *rightout;
-
-    // Love thy L2 chache - made this a loop.
-    // Now more channels could be set at compile time
-    //  as well. Thus loop those  channels.
-    for (int chan = 0; chan < numChannels; chan++) {
-      channel_info_t* const ci = channelinfo + chan;
-
-      // Check channel, if active.
-      if (ci->data != nullptr) {
-        int s;
-        // Get the raw data from the channel.
-        // no filtering
-        // s = ci->data[0] * 0x10000 - 0x800000;
-
-        // linear filtering
-        // the old SRC did linear interpolation back into 8 bit, and then expanded to 16 bit.
-        // this does interpolation and 8->16 at same time, allowing slightly higher quality
-        if (ci->bits == 16) {
-          s = static_cast<short>(ci->data[0] | (ci->data[1] << 8)) * (255 - (ci->stepremainder >> 8))
-              + static_cast<short>(ci->data[2] | (ci->data[3] << 8)) * (ci->stepremainder >> 8);
-        } else {
-          s = (ci->data[0] * (0x10000 - ci->stepremainder)) + (ci->data[1] * (ci->stepremainder))
-              - 0x800000;  // convert to signed
-        }
-
-        // lowpass
-        if (lowpass_filter != 0) {
-          s = ci->prevS + ci->alpha * (s - ci->prevS);
-          ci->prevS = s;
-        }
-
-        // Add left and right part
-        //  for this channel (sound)
-        //  to the current data.
-        // Adjust volume accordingly.
-
-        // full loudness (vol=127) is actually 127/191
-
-        dl += ci->leftvol * s / 49152;   // >> 15;
-        dr += ci->rightvol * s / 49152;  // >> 15;
-
-        // Increment index ???
-        ci->stepremainder += ci->step;
-
-        // MSB is next sample???
-        if (ci->bits == 16) {
-          ci->data += (ci->stepremainder >> 16) * 2;
-        } else {
-          ci->data += ci->stepremainder >> 16;
-        }
-
-        // Limit to LSB???
-        ci->stepremainder &= 0xffffu;
-
-        // Check whether we are done.
-        if (ci->data >= ci->enddata) {
-          stopchan(chan);
-        }
-      }
-    }
-
-    // Clamp to range. Left hardware channel.
-    // Has been char instead of short.
-    // if (dl > 127) *leftout = 127;
-    // else if (dl < -128) *leftout = -128;
-    // else *leftout = dl;
-
-    *leftout = std::clamp<signed short>(static_cast<signed short>(dl), SHRT_MIN, SHRT_MAX);
-
-    // Same for right hardware channel.
-    *rightout = std::clamp<signed short>(static_cast<signed short>(dr), SHRT_MIN, SHRT_MAX);
-
-    // Increment current pointers in stream
-    leftout += step;
-    rightout += step;
-  }
+  MixChannels(reinterpret_cast<signed short*>(stream), len / 4);
+  BENCH_STOP(BENCH_MIXER);
   SDL_UnlockMutex(sfxmutex);
 }
 }  // namespace
@@ -1189,6 +1511,7 @@ const char* snd_mididev;    // midi device to use (portmidiplayer)
 #include "MUSIC/musicplayer.h"
 
 #include "MUSIC/alsaplayer.h"
+#include "MUSIC/cacheplayer.h"
 #include "MUSIC/dumbplayer.h"
 #include "MUSIC/flplayer.h"
 #include "MUSIC/madplayer.h"
@@ -1198,7 +1521,7 @@ const char* snd_mididev;    // midi device to use (portmidiplayer)
 
 namespace {
 // list of possible music players
-const std::array<const music_player_t*, 7> music_players = {  // until some ui work is done, the order these appear is
+const std::array<const music_player_t*, 8> music_players = {  // until some ui work is done, the order these appear is
                                                               // the autodetect order. of particular importance:  things
                                                               // that play mus have to be last, because mus2midi very
                                                               // often succeeds even on garbage input
@@ -1209,6 +1532,7 @@ const std::array<const music_player_t*, 7> music_players = {  // until some ui w
     &opl_synth_player,  // oplplayer.h
     &pm_player,         // portmidiplayer.h
     &alsa_player,       // alsaplayer.h
+    &cache_player,      // cacheplayer.h; never autodetected, see Exp_RegisterCachedSong
 };
 
 std::array<int, music_players.size()> music_player_was_init = {};
@@ -1220,6 +1544,7 @@ constexpr std::string_view PLAYER_FLUIDSYNTH = "fluidsynth midi player";
 constexpr std::string_view PLAYER_OPL2 = "opl2 synth player";
 constexpr std::string_view PLAYER_PORTMIDI = "portmidi midi player";
 constexpr std::string_view PLAYER_ALSA = "alsa midi player";
+constexpr std::string_view PLAYER_CACHE = "music cache player";
 }  // namespace
 
 // order in which players are to be tried
@@ -1231,6 +1556,7 @@ const char* music_player_order[] = {
     PLAYER_OPL2.data(),
     PLAYER_PORTMIDI.data(),
     PLAYER_ALSA.data(),
+    PLAYER_CACHE.data(),
 };
 
 // prefered MIDI device
@@ -1251,6 +1577,10 @@ int mus_fluidsynth_chorus;
 int mus_fluidsynth_reverb;
 int mus_fluidsynth_gain;              // NSM  fine tune fluidsynth output level
 int mus_opl_gain;                     // NSM  fine tune OPL output level
+int mus_opl_core;                     // OPL emulator: 0 = DBOPL, 1 = DBOPL at half rate
+int mus_opl_block;                    // render OPL music in blocks between callbacks
+int mus_cache;                        // play synth music from pre-rendered files
+int mus_cache_size;                   // megabytes of pre-rendered music kept, 0 = no limit
 const char* mus_portmidi_reset_type;  // portmidi reset type
 int mus_portmidi_reset_delay;         // portmidi delay after reset
 int mus_portmidi_filter_sysex;        // portmidi block sysex from midi files
@@ -1362,6 +1692,66 @@ void Exp_SetMusicVolume(const int volume) {
   }
 }
 
+// the first synth that would play a midi, if its output is worth caching
+auto CacheSynth() -> const music_player_t* {
+  for (const char* const name : music_player_order) {
+    if (name == PLAYER_VORBIS || name == PLAYER_MAD || name == PLAYER_DUMB) {
+      continue;
+    }
+
+    for (std::size_t i = 0; i < music_players.size(); i++) {
+      if (music_player_was_init[i] && std::string_view{music_players[i]->name()} == name) {
+        return (name == PLAYER_OPL2 || name == PLAYER_FLUIDSYNTH) ? music_players[i] : nullptr;
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+// returns 1 if the song is played by the cache player
+auto Exp_RegisterCachedSong(const void* const data, const std::size_t len) -> int {
+  if (mus_cache == 0 || dumping_sound != 0 || len <= 4) {
+    return 0;
+  }
+
+  const std::string_view magic{static_cast<const char*>(data), 4};
+  if (magic != "MUS\x1a" && magic != "MThd") {
+    return 0;
+  }
+
+  const music_player_t* const synth = CacheSynth();
+  if (synth == nullptr) {
+    return 0;
+  }
+
+  // everything besides the song that changes what the synth renders
+  std::string settings = std::format("{} {}", synth->name(), snd_samplerate);
+  if (synth->name() == PLAYER_OPL2) {
+    settings += std::format(" {} {} {}", mus_opl_gain, mus_opl_core, mus_opl_block);
+  } else {
+    settings += std::format(" {} {} {} {}", snd_soundfont, mus_fluidsynth_gain, mus_fluidsynth_chorus,
+                            mus_fluidsynth_reverb);
+  }
+
+  const void* const handle = Cache_RegisterSong(synth, data, len, settings.c_str());
+  if (handle == nullptr) {
+    return 0;
+  }
+
+  for (std::size_t i = 0; i < music_players.size(); i++) {
+    if (music_players[i] == &cache_player) {
+      SDL_LockMutex(musmutex);
+      current_player = i;
+      music_handle = handle;
+      SDL_UnlockMutex(musmutex);
+    }
+  }
+
+  lprint(LO_INFO, "Exp_RegisterSongEx: Using player {} for {}\n", cache_player.name(), synth->name());
+  return 1;
+}
+
 // returns 1 on success, 0 on failure
 auto Exp_RegisterSongEx(const void* data, size_t len, int try_mus2mid) -> int {
 //  int i, j;
@@ -1379,6 +1769,10 @@ auto Exp_RegisterSongEx(const void* data, size_t len, int try_mus2mid) -> int {
     Exp_UnRegisterSong(0);
   }
 
+  if (try_mus2mid != 0 && Exp_RegisterCachedSong(data, len) != 0) {
+    return 1;
+  }
+
   // e6y: new logic by me
   // Now you can hear title music in deca.wad
   // http://www.doomworld.com/idgames/index.php?id=8808
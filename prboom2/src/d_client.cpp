@@ -40,7 +40,9 @@
 #include "config.h"
 #endif
 
+#include <cctype>
 #include <cstddef>
+#include <cstdlib>
 
 #include <algorithm>
 #include <memory>
@@ -69,6 +71,7 @@
 #include "g_game.h"
 #include "m_menu.h"
 #include "p_checksum.h"
+#include "p_desync.h"
 
 #include "e6y.h"
 #include "i_main.h"
@@ -86,12 +89,31 @@ namespace {
 bool server;
 int remotetic;   // Tic expected from the remote
 int remotesend;  // Tic expected by the remote
+int netprotocol;  // NET_PROTOCOL_VERSION agreed with the server
+
+// How the link held up, reported on leaving a game played with -netsim
+struct {
+  int retrans_sent;      // resends we asked for
+  int retrans_received;  // resends asked of us
+  int stalls;            // waits of more than a tic for the other players
+  Uint32 stallms;
+  Uint32 maxstallms;
+  Uint32 stallstart;
+  long long lagtics;     // tics between making a ticcmd and running it
+  int ranticks;
+} netstats;
 }  // namespace
 
 ticcmd_t netcmds[MAXPLAYERS][BACKUPTICS];
 
 namespace {
 ticcmd_t* localcmds;
+ticcmd_t spectatorcmds[BACKUPTICS];  // Built but never sent when spectating
+struct {
+  int tic;
+  int gametic;
+  int time;
+} lastack;  // What a spectator last told the server
 //unsigned numqueuedpackets;
 using unique_packet_header_t = std::unique_ptr<packet_header_t, decltype([](auto* p) { Z_Free(p); })>;
 std::vector<unique_packet_header_t, z_allocator<unique_packet_header_t>> queuedpacket;
@@ -106,6 +128,7 @@ int xtratics = 0;
 
 int wanted_player_number;
 int solo_net = 0;
+dboolean spectating;
 
 extern "C" void D_QuitNetGame();
 
@@ -142,15 +165,30 @@ void D_InitNetGame() {
       short pn;
     } PACKEDATTR initpacket;
 
+    // -spectate [game] watches instead of playing
+    const int spectate = M_CheckParm("-spectate");
+    int watchgame = -1;
+    if (spectate != 0 && spectate < myargc - 1 && std::isdigit(static_cast<unsigned char>(myargv[spectate + 1][0]))) {
+      watchgame = std::atoi(myargv[spectate + 1]);
+    }
+
     I_InitNetwork();
     udp_socket = I_Socket(0);
     I_ConnectToServer(myargv[i]);
 
+    {
+      const int p = M_CheckParm("-netsim");
+      if (p != 0 && p < myargc - 1) {
+        I_SetNetSim(myargv[p + 1], devparm);
+      }
+    }
+
     do {
       do {
         // Send init packet
-        initpacket.pn = doom_htons(wanted_player_number);
-        packet_set(&initpacket.head, PKT_INIT, 0);
+        initpacket.pn = doom_htons(spectate != 0 ? watchgame : wanted_player_number);
+        packet_set(&initpacket.head, spectate != 0 ? PKT_WATCH : PKT_INIT, 0);
+        initpacket.head.reserved[0] = NET_PROTOCOL_VERSION;
         I_SendPacket(&initpacket.head, sizeof(initpacket));
         I_WaitForPacket(5000);
       } while (I_GetPacket(packet.get(), 1000) == 0);
@@ -164,6 +202,11 @@ void D_InitNetGame() {
     I_AtExit(D_QuitNetGame, true);
 
     // Get info from the setup packet
+    netprotocol = packet_version(packet.get());
+    spectating = (packet->reserved[1] & SETUP_SPECTATOR) != 0;
+    if ((packet->reserved[1] & SETUP_SHORTTICS) != 0) {
+      shorttics = 1;  // The server is recording a demo without longtics
+    }
     consoleplayer = sinfo->yourplayer;
     compatibility_level = sinfo->complevel;
     G_Compatibility();
@@ -175,8 +218,13 @@ void D_InitNetGame() {
     xtratics = sinfo->extratic;
     G_ReadOptions(sinfo->game_options);
 
-    lprintf(LO_INFO, "\tjoined game as player %d/%d; %d WADs specified\n", consoleplayer + 1,
-            numplayers = sinfo->players, sinfo->numwads);
+    if (spectating) {
+      lprintf(LO_INFO, "\twatching a game of %d players; %d WADs specified\n",
+              numplayers = sinfo->players, sinfo->numwads);
+    } else {
+      lprintf(LO_INFO, "\tjoined game as player %d/%d; %d WADs specified\n", consoleplayer + 1,
+              numplayers = sinfo->players, sinfo->numwads);
+    }
     {
       auto* p = reinterpret_cast<char*>(sinfo->wadnames);
       int i = sinfo->numwads;
@@ -187,7 +235,8 @@ void D_InitNetGame() {
       }
     }
   }
-  localcmds = netcmds[displayplayer = consoleplayer];
+  displayplayer = consoleplayer;
+  localcmds = spectating ? spectatorcmds : netcmds[consoleplayer];
   for (i = 0; i < numplayers; i++) {
     playeringame[i] = true;
   }
@@ -334,6 +383,7 @@ void NetUpdate() {
           unsigned long ptic = doom_ntohl(packet->tic);
 
           if (ptic > static_cast<unsigned>(remotetic)) {  // Missed some
+            netstats.retrans_sent++;
             packet_set(packet.get(), PKT_RETRANS, remotetic);
             *reinterpret_cast<byte*>(packet.get() + 1) = consoleplayer;
             I_SendPacket(packet.get(), sizeof(*packet.get()) + 1);
@@ -360,11 +410,71 @@ void NetUpdate() {
           break;
         }
 
+        case PKT_DTICS: {
+          const byte* p = reinterpret_cast<byte*>(packet.get() + 1);
+          const byte* const end = reinterpret_cast<byte*>(packet.get()) + recvlen;
+          int tics = *p++;
+          unsigned long ptic = doom_ntohl(packet->tic);
+
+          if (ptic > static_cast<unsigned>(remotetic)) {  // Missed some
+            netstats.retrans_sent++;
+            packet_set(packet.get(), PKT_RETRANS, remotetic);
+            *reinterpret_cast<byte*>(packet.get() + 1) = consoleplayer;
+            I_SendPacket(packet.get(), sizeof(*packet.get()) + 1);
+            break;
+          }
+          if (ptic + tics <= static_cast<unsigned>(remotetic)) {
+            break;  // Will not improve things
+          }
+
+          // Decode the whole packet first, so a damaged one changes nothing
+          static ticcmd_t cmds[256][MAXPLAYERS];
+          static byte ingame[256];
+          int i;
+
+          for (i = 0; i < tics && p < end; i++) {
+            ingame[i] = *p++;
+            for (int n = 0; n < MAXPLAYERS && p != nullptr; n++) {
+              if ((ingame[i] & (1 << n)) != 0) {
+                const bool inlast = i > 0 && (ingame[i - 1] & (1 << n)) != 0;
+                const ticcmd_t base = inlast ? cmds[i - 1][n] : ticcmd_t{};
+                p = DeltaToTic(&cmds[i][n], p, end, &base);
+              }
+            }
+            if (p == nullptr) {
+              break;
+            }
+          }
+          if (i < tics) {
+            break;
+          }
+
+          // A spectator catching up can be sent more than it has room for
+          tics = std::min<int>(tics, gametic + BACKUPTICS - ptic);
+
+          remotetic = ptic;
+          for (i = 0; i < tics; i++, remotetic++) {
+            for (int n = 0; n < MAXPLAYERS; n++) {
+              if ((ingame[i] & (1 << n)) != 0) {
+                netcmds[n][remotetic % BACKUPTICS] = cmds[i][n];
+              }
+            }
+          }
+
+          break;
+        }
+
         case PKT_RETRANS:  // Resend request
+          netstats.retrans_received++;
           remotesend = doom_ntohl(packet->tic);
           break;
 
         case PKT_DOWN: {  // Server downed
+          if (spectating) {  // Stop at the last tic we were sent
+            doom_printf("The game has ended\n");
+            break;
+          }
+
           for (int j = 0; j < MAXPLAYERS; j++) {
             if (j != consoleplayer) {
               playeringame[j] = false;
@@ -423,15 +533,46 @@ void NetUpdate() {
       maketic++;
     }
 
-    if (server && maketic > remotesend) {  // Send the tics to the server
-      remotesend -= xtratics;
+    if (server && spectating) {
+      // Tell the server how far we have got, which is all it hears from
+      // a spectator: whenever that changes, when there is room again for
+      // tics that didn't fit, and at least once a second
+      const bool wasfull = lastack.tic - lastack.gametic >= BACKUPTICS / 2;
+      if (remotetic != lastack.tic || (wasfull && remotetic - gametic < BACKUPTICS / 2) ||
+          I_GetTime() - lastack.time >= TICRATE) {
+        char buf[sizeof(packet_header_t) + 1];
+        packet_set(reinterpret_cast<packet_header_t*>(buf), PKT_RETRANS, remotetic);
+        buf[sizeof(buf) - 1] = consoleplayer;
+        I_SendPacket(reinterpret_cast<packet_header_t*>(buf), sizeof(buf));
+        lastack = {remotetic, gametic, I_GetTime()};
+      }
+    } else if (server && maketic > remotesend) {  // Send the tics to the server
+      remotesend -= (netprotocol >= 1 ? std::max(xtratics, NET_REDUNDANCY) : xtratics);
       if (remotesend < 0) {
         remotesend = 0;
       }
 
       int sendtics = std::min(maketic - remotesend, 128);  // limit number of sent tics (CVE-2019-20797)
 
-      {
+      if (netprotocol >= 1) {
+        const std::size_t pkt_size = sizeof(packet_header_t) + 2 + sendtics * DELTA_TICCMD_MAX;
+        const auto packet = unique_packet_header_t{
+            static_cast<packet_header_t*>(Z_Malloc(pkt_size, PU_STATIC, nullptr))};
+
+        packet_set(packet.get(), PKT_DTICC, maketic - sendtics);
+        byte* p = reinterpret_cast<byte*>(packet.get() + 1);
+        *p++ = sendtics;
+        *p++ = consoleplayer;
+
+        ticcmd_t base{};
+        while (sendtics-- != 0) {
+          const ticcmd_t* cmd = &localcmds[remotesend++ % BACKUPTICS];
+          p = TicToDelta(p, cmd, &base);
+          base = *cmd;
+        }
+
+        I_SendPacket(packet.get(), p - reinterpret_cast<byte*>(packet.get()));
+      } else {
         const std::size_t pkt_size = sizeof(packet_header_t) + 2 + sendtics * sizeof(ticcmd_t);
         const auto packet = unique_packet_header_t{
             static_cast<packet_header_t*>(Z_Malloc(pkt_size, PU_STATIC, nullptr))};
@@ -477,7 +618,7 @@ void D_BuildNewTiccmds() {
 #ifdef HAVE_NET
 /* cph - data passed to this must be in the Doom (little-) endian */
 void D_NetSendMisc(const netmisctype_t type, const std::size_t len, void* const data) {
-  if (server) {
+  if (server && !spectating) {
     const std::size_t size = sizeof(packet_header_t) + 3 * sizeof(int) + len;
     const auto packet = unique_packet_header_t{
         static_cast<packet_header_t*>(Z_Malloc(size, PU_STATIC, nullptr))};
@@ -548,6 +689,23 @@ void TryRunTics() {
     D_BuildNewTiccmds();
 #endif
     runtics = (server ? remotetic : maketic) - gametic;
+#ifdef HAVE_NET
+    if (server) {  // Time spent waiting on the other players
+      if (runtics == 0 && maketic > gametic) {
+        if (netstats.stallstart == 0) {
+          netstats.stallstart = SDL_GetTicks();
+        }
+      } else if (runtics != 0 && netstats.stallstart != 0) {
+        const Uint32 stall = SDL_GetTicks() - netstats.stallstart;
+        if (stall > 1000 / TICRATE) {
+          netstats.stalls++;
+          netstats.stallms += stall;
+          netstats.maxstallms = std::max(netstats.maxstallms, stall);
+        }
+        netstats.stallstart = 0;
+      }
+    }
+#endif
     if (runtics == 0) {
       if (movement_smooth == 0 || !window_focused) {
 #ifdef HAVE_NET
@@ -562,6 +720,7 @@ void TryRunTics() {
         if (server) {
           char buf[sizeof(packet_header_t) + 1];
           remotesend--;
+          netstats.retrans_sent++;
           packet_set(reinterpret_cast<packet_header_t*>(buf), PKT_RETRANS, remotetic);
           buf[sizeof(buf) - 1] = consoleplayer;
           I_SendPacket(reinterpret_cast<packet_header_t*>(buf), sizeof(buf));
@@ -590,6 +749,8 @@ void TryRunTics() {
 #ifdef HAVE_NET
     if (server) {
       CheckQueuedPackets();
+      netstats.lagtics += maketic - gametic;
+      netstats.ranticks++;
     }
 #endif
 
@@ -600,6 +761,7 @@ void TryRunTics() {
     M_Ticker();
     G_Ticker();
     P_Checksum(gametic);
+    P_DesyncSnapshot(gametic);
     gametic++;
 
 #ifdef HAVE_NET
@@ -617,6 +779,14 @@ void D_QuitNetGame() {
     return;
   }
 
+  if (I_NetSimEnabled() && netstats.ranticks != 0) {
+    lprintf(LO_INFO, "D_QuitNetGame: %d tics, %.2f tics input lag, %d resends asked for, %d asked of us\n",
+            netstats.ranticks, static_cast<double>(netstats.lagtics) / netstats.ranticks,
+            netstats.retrans_sent, netstats.retrans_received);
+    lprintf(LO_INFO, "D_QuitNetGame: %d stalls, %u ms in all, longest %u ms\n",
+            netstats.stalls, netstats.stallms, netstats.maxstallms);
+  }
+
   buf[sizeof(packet_header_t)] = consoleplayer;
   packet_set(packet, PKT_QUIT, gametic);
 
@@ -0,0 +1,589 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2006 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *  Headless batch demo verifier ("demo farm").
+ *
+ *  Reads a list of demos in the tests/demo-testing.csv format, plays each
+ *  one with -fastdemo -nodraw -nosound -checksum on a pool of worker
+ *  threads, and reports per-demo results in CSV or JSON.
+ *
+ *  The playsim keeps all of its state in globals, so every demo is run in
+ *  its own game process; the pool only decides how many of them run at
+ *  once. -nodraw together with -nosound keeps SDL video and audio from
+ *  being initialised at all.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "doomtype.h"  // complevel_t_e
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct demo_spec_t {
+  std::string complevel;
+  int level = -1;  // complevel passed to the game, -1 to leave it to the demo
+  std::string iwad;
+  std::string pwad;
+  std::string demo;
+  std::string expected;  // expected "final:" digest, may be empty
+};
+
+enum class demo_status_t {
+  pass,      // demo played to the end, digest matched (or none expected)
+  mismatch,  // demo played to the end, digest differed from expected
+  fail,      // game exited before the end of the demo
+};
+
+struct demo_result_t {
+  demo_status_t status = demo_status_t::fail;
+  int exitcode = 0;
+  int tics = -1;
+  std::string digest;
+  double seconds = 0.0;
+};
+
+struct farm_options_t {
+  std::string game = "prboom-plus";
+  std::string specs;
+  std::string path = ".";
+  std::string iwad;
+  std::string output;
+  std::string workdir = ".";
+  std::vector<std::string> extra;
+  bool json = false;
+  unsigned jobs = 0;
+};
+
+auto StatusName(const demo_status_t status) -> const char* {
+  switch (status) {
+    case demo_status_t::pass:
+      return "pass";
+    case demo_status_t::mismatch:
+      return "mismatch";
+    case demo_status_t::fail:
+      break;
+  }
+  return "fail";
+}
+
+//
+// NamedComplevel
+// The complevel for a "Compat level tested" entry, as named in
+// tests/demo-testing.csv or as a number, or -1 if it isn't one
+//
+auto NamedComplevel(const std::string& name) -> int {
+  static constexpr std::pair<std::string_view, int> names[] = {
+      {"doom12", doom_12_compatibility},      {"doom1666", doom_1666_compatibility},
+      {"doom2_19", doom2_19_compatibility},   {"ultdoom", ultdoom_compatibility},
+      {"finaldoom", finaldoom_compatibility}, {"dosdoom", dosdoom_compatibility},
+      {"tasdoom", tasdoom_compatibility},     {"boom201", boom_201_compatibility},
+      {"boom202", boom_202_compatibility},    {"lxdoom", lxdoom_1_compatibility},
+      {"mbf", mbf_compatibility},             {"prboom21x", prboom_2_compatibility},
+      {"prboom22x", prboom_3_compatibility},  {"prboom23x", prboom_4_compatibility},
+      {"prboom240", prboom_5_compatibility},  {"prboom", prboom_6_compatibility},
+  };
+
+  for (const auto& [known, level] : names) {
+    if (name == known) {
+      return level;
+    }
+  }
+
+  char* end = nullptr;
+  const long level = std::strtol(name.c_str(), &end, 10);
+  if (!name.empty() && *end == '\0' && level >= 0 && level < MAX_COMPATIBILITY_LEVEL) {
+    return static_cast<int>(level);
+  }
+
+  return -1;
+}
+
+//
+// SplitCSVLine
+// Splits a line of the demo-testing.csv format, honouring quoted fields
+//
+auto SplitCSVLine(const std::string_view line) -> std::vector<std::string> {
+  std::vector<std::string> fields{1};
+  bool quoted = false;
+
+  for (std::size_t i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+
+    if (quoted) {
+      if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+        fields.back() += '"';
+        ++i;
+      } else if (c == '"') {
+        quoted = false;
+      } else {
+        fields.back() += c;
+      }
+    } else if (c == '"') {
+      quoted = true;
+    } else if (c == ',') {
+      fields.emplace_back();
+    } else if (c != '\r' && c != '\n') {
+      fields.back() += c;
+    }
+  }
+
+  for (auto& field : fields) {
+    const auto first = field.find_first_not_of(" \t");
+    const auto last = field.find_last_not_of(" \t");
+    field = (first == std::string::npos) ? std::string{} : field.substr(first, last - first + 1);
+  }
+
+  return fields;
+}
+
+//
+// ReadDemoSpecs
+// Columns are looked up by header name, so extra columns are ignored and
+// an optional "Checksum" column supplies the expected final digest
+//
+auto ReadDemoSpecs(const std::string& filename, const farm_options_t& options) -> std::vector<demo_spec_t> {
+  std::vector<demo_spec_t> specs;
+  std::ifstream in{filename};
+  std::string line;
+
+  if (!in || !std::getline(in, line)) {
+    std::fprintf(stderr, "demofarm: cannot read %s\n", filename.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  const auto headers = SplitCSVLine(line);
+  const auto column = [&headers](const std::string_view name) -> int {
+    for (std::size_t i = 0; i < headers.size(); ++i) {
+      if (headers[i] == name) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  };
+  const int col_complevel = column("Compat level tested");
+  const int col_iwad = column("IWAD");
+  const int col_pwad = column("PWAD");
+  const int col_demo = column("Demo");
+  const int col_checksum = column("Checksum");
+
+  if (col_demo < 0) {
+    std::fprintf(stderr, "demofarm: %s has no \"Demo\" column\n", filename.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  while (std::getline(in, line)) {
+    const auto fields = SplitCSVLine(line);
+    const auto field = [&fields](const int col) -> std::string {
+      return (col >= 0 && col < static_cast<int>(fields.size())) ? fields[static_cast<std::size_t>(col)] : std::string{};
+    };
+
+    demo_spec_t spec;
+    spec.demo = field(col_demo);
+    if (spec.demo.empty()) {
+      continue;
+    }
+    spec.complevel = field(col_complevel);
+    if (!spec.complevel.empty() && (spec.level = NamedComplevel(spec.complevel)) < 0) {
+      std::fprintf(stderr, "demofarm: unknown compat level \"%s\" for %s, left to the demo\n",
+                   spec.complevel.c_str(), spec.demo.c_str());
+    }
+    spec.iwad = options.iwad.empty() ? field(col_iwad) : options.iwad;
+    spec.pwad = field(col_pwad);
+    spec.expected = field(col_checksum);
+    specs.push_back(std::move(spec));
+  }
+
+  return specs;
+}
+
+#ifdef _WIN32
+//
+// WindowsArg
+// Quotes an argument so that the C runtime of the game splits it back out
+// of the command line unchanged
+//
+auto WindowsArg(const std::string& s) -> std::string {
+  if (!s.empty() && s.find_first_of(" \t\n\v\"") == std::string::npos) {
+    return s;
+  }
+
+  std::string result{"\""};
+  std::size_t backslashes = 0;
+  for (const char c : s) {
+    if (c == '\\') {
+      ++backslashes;
+      continue;
+    }
+    // Backslashes only escape when they come before a quote
+    result.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+    result += c;
+    backslashes = 0;
+  }
+  result.append(backslashes * 2, '\\');
+  return result + '"';
+}
+
+//
+// RunProcess
+// Runs args[0] with args, output thrown away, and returns its exit code
+//
+auto RunProcess(const std::vector<std::string>& args) -> int {
+  std::string cmdline;
+  for (const auto& arg : args) {
+    cmdline += (cmdline.empty() ? "" : " ") + WindowsArg(arg);
+  }
+
+  SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, TRUE};
+  const HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, nullptr);
+
+  STARTUPINFOA si{};
+  si.cb = sizeof(si);
+  si.dwFlags = STARTF_USESTDHANDLES;
+  si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+  si.hStdOutput = nul;
+  si.hStdError = nul;
+
+  PROCESS_INFORMATION pi;
+  if (!CreateProcessA(nullptr, cmdline.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, &pi)) {
+    CloseHandle(nul);
+    return -1;
+  }
+
+  DWORD code = static_cast<DWORD>(-1);
+  WaitForSingleObject(pi.hProcess, INFINITE);
+  GetExitCodeProcess(pi.hProcess, &code);
+  CloseHandle(pi.hThread);
+  CloseHandle(pi.hProcess);
+  CloseHandle(nul);
+  return static_cast<int>(code);
+}
+#else
+//
+// RunProcess
+// Runs args[0], looked up in PATH, with args and no shell between, output
+// thrown away, and returns its exit code
+//
+auto RunProcess(const std::vector<std::string>& args) -> int {
+  std::vector<char*> argv;
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  const pid_t pid = fork();
+  if (pid == -1) {
+    return -1;
+  }
+  if (pid == 0) {
+    // Only async-signal-safe calls here, the other workers hold locks
+    const int fd = open("/dev/null", O_WRONLY);
+    if (fd != -1) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+    }
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+//
+// InPath
+// Resolves a file name against -path; names that do not exist there are
+// passed through unchanged so that IWAD lumps such as DEMO1 still work
+//
+auto InPath(const farm_options_t& options, const std::string& name) -> std::string {
+  if (name.empty() || options.path.empty()) {
+    return name;
+  }
+
+  const auto path = std::filesystem::path{options.path} / name;
+  return std::filesystem::exists(path) ? path.string() : name;
+}
+
+//
+// ParseChecksumFile
+// Reads the output of -checksum: one "tic, digest" line per tic, followed
+// by "final: digest" once G_CheckDemoStatus is reached
+//
+void ParseChecksumFile(const std::string& filename, demo_result_t& result) {
+  std::ifstream in{filename};
+  std::string line;
+  bool finished = false;
+
+  while (std::getline(in, line)) {
+    if (line.starts_with("final: ")) {
+      result.digest = line.substr(7);
+      finished = true;
+    } else {
+      result.tics = std::atoi(line.c_str()) + 1;
+    }
+  }
+
+  if (result.tics < 0) {
+    result.tics = 0;
+  }
+  result.status = finished ? demo_status_t::pass : demo_status_t::fail;
+}
+
+auto RunDemo(const farm_options_t& options, const demo_spec_t& spec, const std::size_t index) -> demo_result_t {
+  namespace chrono = std::chrono;
+
+  demo_result_t result;
+  const std::string checksumfile = options.workdir + "/demofarm-" + std::to_string(index) + ".chk";
+
+  std::vector<std::string> args{options.game, "-nodraw", "-nosound", "-nomouse", "-nofullscreen"};
+  if (!spec.iwad.empty()) {
+    args.insert(args.end(), {"-iwad", InPath(options, spec.iwad)});
+  }
+  if (!spec.pwad.empty()) {
+    args.insert(args.end(), {"-file", InPath(options, spec.pwad)});
+  }
+  if (spec.level >= 0) {
+    // Only vanilla demos take it, the others name their own complevel
+    args.insert(args.end(), {"-complevel", std::to_string(spec.level)});
+  }
+  args.insert(args.end(), {"-checksum", checksumfile});
+  args.insert(args.end(), {"-fastdemo", InPath(options, spec.demo)});
+  args.insert(args.end(), options.extra.cbegin(), options.extra.cend());
+
+  std::remove(checksumfile.c_str());
+
+  const auto start = chrono::steady_clock::now();
+  result.exitcode = RunProcess(args);
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  ParseChecksumFile(checksumfile, result);
+  std::remove(checksumfile.c_str());
+
+  if (result.status == demo_status_t::pass && !spec.expected.empty() && spec.expected != result.digest) {
+    result.status = demo_status_t::mismatch;
+  }
+
+  return result;
+}
+
+auto CSVField(const std::string& s) -> std::string {
+  std::string result{"\""};
+  for (const char c : s) {
+    if (c == '"') {
+      result += '"';
+    }
+    result += c;
+  }
+  return result + '"';
+}
+
+auto JSONEscape(const std::string& s) -> std::string {
+  std::string result;
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result;
+}
+
+void WriteResults(std::FILE* const out,
+                  const farm_options_t& options,
+                  const std::vector<demo_spec_t>& specs,
+                  const std::vector<demo_result_t>& results) {
+  if (options.json) {
+    std::fprintf(out, "[\n");
+  } else {
+    std::fprintf(out, "demo,complevel,iwad,pwad,result,exitcode,tics,digest,expected,seconds\n");
+  }
+
+  for (std::size_t i = 0; i < specs.size(); ++i) {
+    const auto& spec = specs[i];
+    const auto& result = results[i];
+
+    if (options.json) {
+      std::fprintf(out,
+                   "  {\"demo\": \"%s\", \"complevel\": \"%s\", \"iwad\": \"%s\", \"pwad\": \"%s\", "
+                   "\"result\": \"%s\", \"exitcode\": %d, \"tics\": %d, \"digest\": \"%s\", "
+                   "\"expected\": \"%s\", \"seconds\": %.3f}%s\n",
+                   JSONEscape(spec.demo).c_str(), JSONEscape(spec.complevel).c_str(),
+                   JSONEscape(spec.iwad).c_str(), JSONEscape(spec.pwad).c_str(),
+                   StatusName(result.status), result.exitcode, result.tics, result.digest.c_str(),
+                   JSONEscape(spec.expected).c_str(), result.seconds,
+                   (i + 1 < specs.size()) ? "," : "");
+    } else {
+      std::fprintf(out, "%s,%s,%s,%s,%s,%d,%d,%s,%s,%.3f\n",
+                   CSVField(spec.demo).c_str(), CSVField(spec.complevel).c_str(),
+                   CSVField(spec.iwad).c_str(), CSVField(spec.pwad).c_str(),
+                   StatusName(result.status), result.exitcode, result.tics, result.digest.c_str(),
+                   CSVField(spec.expected).c_str(), result.seconds);
+    }
+  }
+
+  if (options.json) {
+    std::fprintf(out, "]\n");
+  }
+}
+
+void Usage(const char* const argv0) {
+  std::fprintf(stderr,
+               "Usage: %s -csv specs.csv [options]\n"
+               "\n"
+               "  -csv file      demo list in tests/demo-testing.csv format\n"
+               "  -game exe      game executable (default prboom-plus)\n"
+               "  -jobs n        number of demos played at once (default: all cores)\n"
+               "  -path dir      directory IWADs, PWADs and demos are looked up in\n"
+               "  -iwad file     override the IWAD column\n"
+               "  -workdir dir   directory for temporary checksum files\n"
+               "  -output file   write results here instead of stdout\n"
+               "  -json          write results as JSON instead of CSV\n"
+               "  -- args...     extra arguments passed to every game process\n",
+               argv0);
+  std::exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  farm_options_t options;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    const bool hasvalue = i + 1 < argc;
+
+    if (arg == "--") {
+      while (++i < argc) {
+        options.extra.emplace_back(argv[i]);
+      }
+    } else if (arg == "-json") {
+      options.json = true;
+    } else if (arg == "-csv" && hasvalue) {
+      options.specs = argv[++i];
+    } else if (arg == "-game" && hasvalue) {
+      options.game = argv[++i];
+    } else if (arg == "-jobs" && hasvalue) {
+      options.jobs = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (arg == "-path" && hasvalue) {
+      options.path = argv[++i];
+    } else if (arg == "-iwad" && hasvalue) {
+      options.iwad = argv[++i];
+    } else if (arg == "-workdir" && hasvalue) {
+      options.workdir = argv[++i];
+    } else if (arg == "-output" && hasvalue) {
+      options.output = argv[++i];
+    } else {
+      Usage(argv[0]);
+    }
+  }
+
+  if (options.specs.empty()) {
+    Usage(argv[0]);
+  }
+  if (options.jobs == 0) {
+    options.jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  const auto specs = ReadDemoSpecs(options.specs, options);
+  std::vector<demo_result_t> results(specs.size());
+  std::atomic<std::size_t> next{0};
+  std::mutex progress_mutex;
+  std::size_t done = 0;
+
+  const auto worker = [&]() {
+    for (std::size_t i = next++; i < specs.size(); i = next++) {
+      results[i] = RunDemo(options, specs[i], i);
+
+      const std::lock_guard lock{progress_mutex};
+      std::fprintf(stderr, "[%zu/%zu] %s: %s (%d tics)\n",
+                   ++done, specs.size(), specs[i].demo.c_str(), StatusName(results[i].status), results[i].tics);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 0; i < std::min<std::size_t>(options.jobs, specs.size()); ++i) {
+    pool.emplace_back(worker);
+  }
+  for (auto& thread : pool) {
+    thread.join();
+  }
+
+  std::FILE* out = stdout;
+  if (!options.output.empty() && (out = std::fopen(options.output.c_str(), "w")) == nullptr) {
+    std::fprintf(stderr, "demofarm: cannot open %s for writing\n", options.output.c_str());
+    return EXIT_FAILURE;
+  }
+  WriteResults(out, options, specs, results);
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  for (const auto& result : results) {
+    if (result.status != demo_status_t::pass) {
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
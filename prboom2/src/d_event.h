@@ -65,7 +65,8 @@ typedef enum {
   ga_completed,
   ga_victory,
   ga_worlddone,
-  ga_screenshot
+  ga_screenshot,
+  ga_seekdemo
 } gameaction_t;
 
 //
@@ -58,6 +58,7 @@
 #include "dstrings.h"
 #include "sounds.h"
 #include "z_zone.h"
+#include "z_bmalloc.h"
 #include "w_wad.h"
 #include "s_sound.h"
 #include "v_video.h"
@@ -67,6 +68,8 @@
 #include "m_misc.h"
 #include "m_menu.h"
 #include "p_checksum.h"
+#include "p_desync.h"
+#include "m_bench.h"
 #include "i_main.h"
 #include "i_system.h"
 #include "i_sound.h"
@@ -426,11 +429,23 @@ void D_Display (fixed_t frac)
 
   // normal update
   if (!wipe)
+  {
+    BENCH_START(BENCH_BLIT);
     I_FinishUpdate ();              // page flip or blit buffer
+    BENCH_STOP(BENCH_BLIT);
+    if (benchmarking)
+      M_BenchFrame();
+  }
   else {
     // wipe update
+    BENCH_START(BENCH_WIPE);
     wipe_EndScreen();
     D_Wipe();
+    BENCH_STOP(BENCH_WIPE);
+    // the wipe holds the screen for many tics, so its frame would
+    // stand out from the rest; it is timed on its own instead
+    if (benchmarking)
+      M_BenchSkipFrame();
   }
 
   // e6y
@@ -481,6 +496,7 @@ static void D_DoomLoop(void)
           M_Ticker ();
           G_Ticker ();
           P_Checksum(gametic);
+          P_DesyncSnapshot(gametic);
           gametic++;
           maketic++;
         }
@@ -1988,6 +2004,12 @@ static void D_DoomMainSetup(void)
 
   lprintf(LO_INFO,"\n");     // killough 3/6/98: add a newline, by popular demand :)
 
+  if (M_CheckParm("-oplbench"))
+  {
+    I_OPL_Benchmark();
+    I_SafeExit(0);
+  }
+
   // e6y 
   // option to disable automatic loading of dehacked-in-wad lump
   if (!M_CheckParm ("-nodeh"))
@@ -2184,6 +2206,13 @@ static void D_DoomMainSetup(void)
       lprintf(LO_INFO,"External statistics registered.\n");
   }
 
+  // print block zone usage as each level ends, and at exit
+  if (M_CheckParm("-poolstats"))
+  {
+    bmalloc_stats = true;
+    I_AtExit(Z_BPrintStats, true);
+  }
+
   // start the apropriate game based on parms
 
   // killough 12/98:
@@ -2204,8 +2233,19 @@ static void D_DoomMainSetup(void)
   if ((p = M_CheckParm ("-checksum")) && ++p < myargc)
     {
       P_RecordChecksum (myargv[p]);
+
+      if ((p = M_CheckParm ("-checksumlevel")) && ++p < myargc)
+        checksum_level = BETWEEN(CHECKSUM_PLAYERS, CHECKSUM_THINKERS, atoi(myargv[p]));
     }
 
+  if ((p = M_CheckParm ("-benchmark")) && ++p < myargc)
+    M_BeginBenchmark (myargv[p]);
+
+  if ((p = M_CheckParm ("-desyncrecord")) && ++p < myargc)
+    P_RecordDesync (myargv[p]);
+  else if ((p = M_CheckParm ("-desynccheck")) && ++p < myargc)
+    P_VerifyDesync (myargv[p]);
+
   if ((p = M_CheckParm ("-fastdemo")) && ++p < myargc)
     {                                 // killough
       fastdemo = true;                // run at fastest speed possible
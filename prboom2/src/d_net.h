@@ -210,6 +210,9 @@ void D_NetSendMisc(netmisctype_t type, size_t len, void* data);
 // CPhipps - ask server for a wad file we need
 bool D_NetGetWad(const char* name);
 
+// Watching a netgame, sending no ticcmds of our own
+extern dboolean spectating;
+
 // Netgame stuff (buffers and pointers, i.e. indices).
 extern  doomcom_t  *doomcom;
 extern  doomdata_t *netbuffer;  // This points inside doomcom.
@@ -198,143 +198,1544 @@ getopt(nargc, nargv, ostr)
 #endif
 
 #define MAXPLAYERS 4
-#define BACKUPTICS 12
+
+#define MAXPACKET 10000
+#define MAXSENDTICS 128     // limit number of sent tics (CVE-2019-20797)
+// Enough to resend any tic a client might still ask for, however far it
+// has fallen behind the others through lost packets
+#define BACKUPTICS MAXSENDTICS
+#define PACKETBATCH 256     // packets read before pending sessions are updated
+#define CLIENTHASH 1024     // buckets in the client address table
+#define SESSIONTIMEOUT 120  // seconds a hosted game may go without a packet
+#define CONFIRMTIME 3       // seconds ready players have to confirm with PKT_GO
+#define SPECTATORWINDOW 8   // tics a spectator is sent past the last it had
+#define SPECTATORTIMEOUT 30 // seconds a spectator may go without a packet
+
+// From g_game.c and g_game.h, for recording demos
+#define DEMOMARKER 0x80
+#define MIN_MAXPLAYERS 32
 
 // Dummies to forfill l_udp.c unused client stuff
 int M_CheckParm(const char* p) { p = NULL; return 1; }
 int myargc;
 char** myargv;
 
-void NORETURN I_Error(const char *error, ...) // killough 3/20/98: add const
-{
-  va_list argptr;
-  va_start(argptr,error);
-  vfprintf(stderr,error,argptr);
-  va_end(argptr);
-  exit(-1);
-}
+void NORETURN I_Error(const char *error, ...) // killough 3/20/98: add const
+{
+  va_list argptr;
+  va_start(argptr,error);
+  vfprintf(stderr,error,argptr);
+  va_end(argptr);
+  exit(-1);
+}
+
+/* Clients are known by the address their packets come from. With SDL_net
+ * we send to the address itself rather than binding a channel per player,
+ * as there are only SDLNET_MAX_UDPCHANNELS of those.
+ */
+#ifdef USE_SDL_NET
+typedef IPaddress netaddr_t;
+#define lastsender sentfrom_addr
+#else
+typedef UDP_CHANNEL netaddr_t;
+#define lastsender sentfrom
+#endif
+
+typedef enum { pc_unused, pc_connected, pc_ready, pc_confirmedready, pc_playing, pc_quit } playerstate_t;
+
+struct session_s;
+
+typedef struct client_s {
+  netaddr_t addr;
+  struct session_s *session;
+  int player;   // -1 for a spectator
+  int protocol; // agreed NET_PROTOCOL_VERSION
+  dboolean hashed;
+  struct client_s *hashnext;
+} client_t;
+
+/* Someone watching a game. A spectator sends no tics, only the first tic
+ * it is still waiting for, and is sent the game from its first tic so it
+ * can join at any point.
+ */
+typedef struct spectator_s {
+  client_t cl;       // first, so a client_t with player -1 is one of these
+  int from;          // the first tic it is waiting for
+  int sentto;        // tics sent to it so far
+  dboolean watching; // has been sent PKT_GO
+  time_t lastheard;
+  struct spectator_s *next;
+} spectator_t;
+
+/* All the state of one game. Without -m the server runs exactly one of
+ * these and exits when it ends; with -m it hosts many at once, filling
+ * each with players in turn as they connect.
+ */
+typedef struct session_s {
+  int id;
+  struct setup_packet_s setupinfo;
+  client_t clients[MAXPLAYERS];
+  int playerjoingame[MAXPLAYERS], playerleftgame[MAXPLAYERS];
+  playerstate_t playerstate[MAXPLAYERS];
+  int remoteticfrom[MAXPLAYERS];
+  int remoteticto[MAXPLAYERS];
+  int backoffcounter[MAXPLAYERS];
+  ticcmd_t netcmds[MAXPLAYERS][BACKUPTICS];
+  int curplayers;
+  time_t confirming;  // when confirming ready players gives up, or 0
+  int exectics; // gametics completed
+  int displaycounter;
+  dboolean ingame;
+  time_t ending;  // when the last player left
+  dboolean ended;
+  time_t lastheard;
+  spectator_t *spectators;
+  int numspectators;
+  time_t lastreap;
+  ticcmd_t (*history)[MAXPLAYERS]; // every tic run, kept for spectators
+  int historylen, historysize;
+  FILE *demofp;
+  long demostart;   // where the tics begin
+  int demotic;      // tics written
+  int demoplayers;  // a bit for each player in the demo
+  dboolean demolongtics;
+  dboolean pending;              // on the pending list
+  struct session_s *nextpending; // received packets since the last update
+  struct session_s *next;
+} session_t;
+
+static session_t *sessions;
+static int numsessions, nextsessionid;
+static int maxsessions; // 0 for a single game
+static int maxspectators; // for each game
+static dboolean keephistory;
+static const char *demoname;
+#ifdef USE_SDL_NET
+static const char *upstream; // relaying the game hosted there
+static int upstreamflags;    // reserved[1] of its PKT_SETUP
+static time_t upstreamheard, upstreamacked;
+#endif
+static client_t *clienthash[CLIENTHASH];
+
+static int numplayers = 2, xtratics = 0;
+static struct setup_packet_s setupinfo = { 2, 0, 1, 1, 1, 0, best_compatibility, 0, 0};
+static char **wadname = NULL;
+static char **wadget = NULL;
+static int numwads = 0;
+
+byte def_game_options[GAME_OPTIONS_SIZE] = \
+{ // cf g_game.c:G_WriteOptions()
+  1, // monsters remember
+  1, // friction
+  0, // weapon recoil
+  1, // pushers
+  0, // reserved/unused
+  1, // player bobbing
+  0, 0, 0, // respawn, fast, nomonsters
+  1, // demo insurance
+  0, 0, 0, 0, // 4 bytes of random number seed
+  1, 0, 0, 0,
+  0, 128, /* distfriend */
+  0, 1, 1, 1, 1, 0,
+  /* Zeroes for all compatibility stuff */
+};
+
+#define nosuch "NOSUCHCONFIGITEM"
+
+const char* gameopt_config_names[] = {
+"monsters_remember",nosuch,"weapon_recoil",nosuch,nosuch,"player_bobbing",nosuch,nosuch,nosuch,"demo_insurance",
+nosuch,nosuch,nosuch,nosuch, // RNG seed
+"monster_infighting","player_helpers",nosuch,nosuch,
+nosuch,nosuch, // distfriend
+"monster_backing","monster_avoid_hazards","monster_friction","help_friends","dog_jumping","monkeys",
+"comp_telefrag","comp_dropoff","comp_vile","comp_pain","comp_skull","comp_blazing","comp_doorlight","comp_model","comp_god","comp_falloff","comp_floors","comp_skymap","comp_pursuit","comp_doorstuck","comp_staylift","comp_zombie","comp_stairs","comp_infcheat","comp_zerotags","comp_moveblock","comp_respawn","comp_sound","comp_666","comp_maskedanim","comp_ouchface","comp_maxhealth","comp_translucency" };//e6y
+
+const int num_gameopts = sizeof gameopt_config_names / sizeof gameopt_config_names[0];
+
+int verbose;
+
+static void SessionPrintf(session_t *s, const char *fmt, ...) __attribute__((format(printf,2,3)));
+
+static void SessionPrintf(session_t *s, const char *fmt, ...)
+{
+  va_list argptr;
+
+  if (maxsessions)
+    printf("game %d: ", s->id);
+  va_start(argptr,fmt);
+  vprintf(fmt,argptr);
+  va_end(argptr);
+}
+
+//
+// Client address table
+//
+
+#ifdef USE_SDL_NET
+static unsigned int AddressHash(const netaddr_t *a)
+{
+  unsigned int h = (a->host ^ ((unsigned int)a->port << 16)) * 2654435761u;
+  return (h ^ (h >> 16)) & (CLIENTHASH - 1);
+}
+
+static dboolean SameAddress(const netaddr_t *a, const netaddr_t *b)
+{
+  return a->host == b->host && a->port == b->port;
+}
+
+static void SendPacketToAddress(packet_header_t *packet, size_t len, netaddr_t *to)
+{
+  I_SendPacketToAddress(packet, len, to);
+}
+
+static void PrintAddress(const netaddr_t *a)
+{
+  const byte *host = (const byte *)&a->host;
+  printf("%d.%d.%d.%d:%d", host[0], host[1], host[2], host[3], SDLNet_Read16(&a->port));
+}
+#else
+static unsigned int AddressHash(const netaddr_t *a)
+{
+  const byte *p = (const byte *)a;
+  unsigned int h = 0;
+  size_t i;
+
+  for (i=0; i<sizeof *a; i++)
+    h = h * 31 + p[i];
+  return (h ^ (h >> 16)) & (CLIENTHASH - 1);
+}
+
+static dboolean SameAddress(const netaddr_t *a, const netaddr_t *b)
+{
+  return !memcmp(a, b, sizeof *a);
+}
+
+static void SendPacketToAddress(packet_header_t *packet, size_t len, netaddr_t *to)
+{
+  I_SendPacketTo(packet, len, to);
+}
+
+static void PrintAddress(netaddr_t *a)
+{
+  I_PrintAddress(stdout, a);
+}
+#endif
+
+static client_t *FindClient(const netaddr_t *addr)
+{
+  client_t *cl;
+
+  for (cl = clienthash[AddressHash(addr)]; cl; cl = cl->hashnext)
+    if (SameAddress(&cl->addr, addr))
+      return cl;
+  return NULL;
+}
+
+static void HashClient(client_t *cl)
+{
+  client_t **bucket = &clienthash[AddressHash(&cl->addr)];
+
+  cl->hashnext = *bucket;
+  *bucket = cl;
+  cl->hashed = true;
+}
+
+static void UnhashClient(client_t *cl)
+{
+  client_t **p;
+
+  if (!cl->hashed)
+    return;
+
+  for (p = &clienthash[AddressHash(&cl->addr)]; *p; p = &(*p)->hashnext)
+    if (*p == cl) {
+      *p = cl->hashnext;
+      break;
+    }
+  cl->hashed = false;
+}
+
+//
+// Sessions
+//
+
+static void CloseDemo(session_t *s);
+static void SendSpectatorTics(session_t *s, spectator_t *sp);
+
+static dboolean n_players_in_state(session_t *s, int n, int ps) {
+	int i,j;
+	for (i=j=0;i<MAXPLAYERS;i++)
+		if (s->playerstate[i] == ps) j++;
+	return (j == n);
+}
+
+// A game still has room if one of its first numplayers slots is free
+static dboolean SessionOpen(session_t *s)
+{
+  int i;
+  for (i=0; i<numplayers; i++)
+    if (s->playerstate[i] == pc_unused)
+      return true;
+  return false;
+}
+
+static dboolean PlayerInTic(session_t *s, int j, int tic)
+{
+  return (s->playerjoingame[j] <= tic) && (s->playerleftgame[j] > tic);
+}
+
+// A tic's command for player j, from the history once everyone has run it
+static const ticcmd_t *SessionCmd(const session_t *s, int j, int tic)
+{
+  if (tic < s->historylen)
+    return &s->history[tic][j];
+  return &s->netcmds[j][tic%BACKUPTICS];
+}
+
+static void SendToPlayer(session_t *s, packet_header_t *packet, size_t len, int i)
+{
+  SendPacketToAddress(packet, len, &s->clients[i].addr);
+}
+
+static void BroadcastPacket(session_t *s, packet_header_t *packet, size_t len)
+{
+  int i;
+  spectator_t *sp;
+
+  for (i=0; i<MAXPLAYERS; i++)
+    if (s->playerstate[i] != pc_unused && s->playerstate[i] != pc_quit)
+      SendToPlayer(s, packet, len, i);
+  for (sp = s->spectators; sp; sp = sp->next)
+    SendPacketToAddress(packet, len, &sp->cl.addr);
+}
+
+// The redundant resends a single game has always made are spaced out
+// with a short sleep, which would hold up every game when hosting many;
+// there a lost packet is just resent when the client asks again.
+static void ResendPause(void)
+{
+  if (!maxsessions)
+    I_uSleep(10000);
+}
+
+static session_t *NewSession(void)
+{
+  session_t *s = calloc(1, sizeof *s);
+  int i;
+
+  s->id = nextsessionid++;
+  s->setupinfo = setupinfo;
+  { /* Random number seed
+     * Mirrors the corresponding code in G_ReadOptions */
+    int rngseed = (int)time(NULL) + s->id;
+    s->setupinfo.game_options[13] = rngseed & 0xff;
+    rngseed >>= 8;
+    s->setupinfo.game_options[12] = rngseed & 0xff;
+    rngseed >>= 8;
+    s->setupinfo.game_options[11] = rngseed & 0xff;
+    rngseed >>= 8;
+    s->setupinfo.game_options[10] = rngseed & 0xff;
+  }
+
+  // no players initially
+  for (i=0; i<MAXPLAYERS; i++) {
+    s->playerjoingame[i] = INT_MAX;
+    s->playerleftgame[i] = 0;
+    s->playerstate[i] = pc_unused;
+    s->clients[i].session = s;
+    s->clients[i].player = i;
+  }
+  s->lastheard = time(NULL);
+
+  s->next = sessions;
+  sessions = s;
+  numsessions++;
+
+  if (maxsessions && verbose)
+    SessionPrintf(s, "opened (%d games)\n", numsessions);
+  return s;
+}
+
+static void RemoveSpectator(session_t *s, spectator_t *sp)
+{
+  spectator_t **p;
+
+  for (p = &s->spectators; *p; p = &(*p)->next)
+    if (*p == sp) {
+      *p = sp->next;
+      break;
+    }
+  s->numspectators--;
+  UnhashClient(&sp->cl);
+  free(sp);
+}
+
+static void FreeSession(session_t *s)
+{
+  session_t **p;
+  int i;
+
+  for (i=0; i<MAXPLAYERS; i++)
+    UnhashClient(&s->clients[i]);
+  while (s->spectators)
+    RemoveSpectator(s, s->spectators);
+  CloseDemo(s);
+  free(s->history);
+
+  for (p = &sessions; *p; p = &(*p)->next)
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+  numsessions--;
+
+  if (verbose)
+    SessionPrintf(s, "closed (%d games)\n", numsessions);
+  free(s);
+}
+
+// The game a newly connecting player joins: the first one still waiting
+// for players, or a new one
+static session_t *OpenSession(void)
+{
+  session_t *s;
+
+  for (s = sessions; s; s = s->next)
+    if (!s->ingame && !s->ending && SessionOpen(s))
+      return s;
+
+  if (maxsessions && numsessions < maxsessions)
+    return NewSession();
+  return NULL;
+}
+
+// The game a new spectator watches: the one asked for, or else the
+// oldest still going
+static session_t *WatchSession(int id)
+{
+  session_t *s, *found = NULL;
+
+  for (s = sessions; s; s = s->next)
+    if (!s->ending && (id < 0 ? (!found || s->id < found->id) : s->id == id))
+      found = s;
+  return found;
+}
+
+// End a game once all its players have gone, which is done by
+// FinishSession once its spectators have seen the rest of it
+static void EndSession(session_t *s)
+{
+  if (!s->ending)
+    s->ending = time(NULL);
+}
+
+static void FinishSession(session_t *s)
+{
+  packet_header_t packet;
+  spectator_t *sp;
+
+  CloseDemo(s);
+  if (!maxsessions)
+    exit(0);
+
+  packet_set(&packet, PKT_DOWN, 0);
+  for (sp = s->spectators; sp; sp = sp->next)
+    SendPacketToAddress(&packet, sizeof packet, &sp->cl.addr);
+  s->ended = true;
+}
+
+//
+// Demo recording
+//
+
+/* A demo of each game is written as it is played, in the format
+ * G_BeginRecording would use. Players don't round their turning for a
+ * demo they aren't recording themselves, so longtics are used wherever
+ * the format has them; otherwise the players are told to round.
+ */
+static dboolean DemoLongtics(int complevel)
+{
+  if (complevel == prboom_6_compatibility)
+    return true;
+  return complevel <= boom_compatibility_compatibility &&
+    complevel != doom_1666_compatibility && complevel != tasdoom_compatibility;
+}
+
+// Returns the length of the header, 0 if the complevel has no format
+static size_t DemoHeader(byte *buf, const struct setup_packet_s *si, int playermask)
+{
+  byte *p = buf;
+  int i;
+
+  if (si->complevel > boom_compatibility_compatibility) {
+    static const byte mbfsig[6] = { 0x1d, 'M', 'B', 'F', 0xe6, '\0' };
+    static const byte boomsig[6] = { 0x1d, 'B', 'o', 'o', 'm', 0xe6 };
+
+    switch (si->complevel) {
+    case boom_201_compatibility: *p++ = 201; break;
+    case boom_202_compatibility: *p++ = 202; break;
+    case mbf_compatibility:      *p++ = 203; break;
+    case prboom_2_compatibility: *p++ = 210; break;
+    case prboom_3_compatibility: *p++ = 211; break;
+    case prboom_4_compatibility: *p++ = 212; break;
+    case prboom_5_compatibility: *p++ = 213; break;
+    case prboom_6_compatibility: *p++ = 214; break;
+    default: return 0;
+    }
+    memcpy(p, si->complevel >= mbf_compatibility ? mbfsig : boomsig, 6);
+    p += 6;
+    *p++ = 0; // compatibility flag
+    *p++ = si->skill;
+    *p++ = si->episode;
+    *p++ = si->level;
+    *p++ = si->deathmatch;
+    *p++ = 0; // consoleplayer
+    memcpy(p, si->game_options, GAME_OPTIONS_SIZE);
+    p += GAME_OPTIONS_SIZE;
+    for (i=0; i<MIN_MAXPLAYERS; i++)
+      *p++ = i < MAXPLAYERS && (playermask & (1 << i));
+  } else {
+    if (DemoLongtics(si->complevel))
+      *p++ = 111;
+    else if (si->complevel == doom_1666_compatibility)
+      *p++ = 106;
+    else
+      *p++ = 110; // tasdoom_compatibility
+    *p++ = si->skill;
+    *p++ = si->episode;
+    *p++ = si->level;
+    *p++ = si->deathmatch;
+    *p++ = si->game_options[6]; // respawn
+    *p++ = si->game_options[7]; // fast
+    *p++ = si->game_options[8]; // nomonsters
+    *p++ = 0; // consoleplayer
+    for (i=0; i<4; i++)
+      *p++ = !!(playermask & (1 << i));
+  }
+  return p - buf;
+}
+
+// Starts the demo of a game, with the players it began with
+static void OpenDemo(session_t *s)
+{
+  byte header[64 + GAME_OPTIONS_SIZE + MIN_MAXPLAYERS];
+  char *name = malloc(strlen(demoname) + 16);
+  size_t len;
+  int i;
+
+  s->demoplayers = 0;
+  for (i=0; i<MAXPLAYERS; i++)
+    if (PlayerInTic(s, i, 0))
+      s->demoplayers |= 1 << i;
+
+  if (!(len = DemoHeader(header, &s->setupinfo, s->demoplayers))) {
+    SessionPrintf(s, "No demo format for compatibility level %d\n", s->setupinfo.complevel);
+  } else {
+    if (maxsessions)
+      sprintf(name, "%s-%d.lmp", demoname, s->id);
+    else
+      sprintf(name, "%s.lmp", demoname);
+
+    if (!(s->demofp = fopen(name, "wb")) || fwrite(header, 1, len, s->demofp) != len) {
+      perror(name);
+      if (s->demofp) fclose(s->demofp);
+      s->demofp = NULL;
+    } else {
+      SessionPrintf(s, "Recording %s\n", name);
+      s->demostart = len;
+      s->demotic = 0;
+      s->demolongtics = DemoLongtics(s->setupinfo.complevel);
+    }
+  }
+  free(name);
+}
+
+static void CloseDemo(session_t *s)
+{
+  if (!s->demofp)
+    return;
+
+  fputc(DEMOMARKER, s->demofp);
+  fflush(s->demofp);
+#ifdef HAVE_UNISTD_H
+  // Drop any tics written past a player leaving
+  if (ftruncate(fileno(s->demofp), ftell(s->demofp)))
+    perror("ftruncate");
+#endif
+  fclose(s->demofp);
+  s->demofp = NULL;
+  if (verbose) SessionPrintf(s, "demo ends after %d tics\n", s->demotic);
+}
+
+// Writes the tics run since the last call
+static void WriteDemo(session_t *s)
+{
+  while (s->demofp && s->demotic < s->exectics) {
+    byte buf[MAXPLAYERS * 5], *p = buf;
+    int j;
+
+    for (j=0; j<MAXPLAYERS; j++)
+      if (s->demoplayers & (1 << j)) {
+        ticcmd_t cmd;
+
+        // The format can't say a player has left, so the demo ends there
+        if (!PlayerInTic(s, j, s->demotic)) {
+          CloseDemo(s);
+          return;
+        }
+        RawToTic(&cmd, SessionCmd(s, j, s->demotic));
+        if (s->setupinfo.complevel == tasdoom_compatibility) {
+          *p++ = cmd.buttons;
+          *p++ = cmd.forwardmove;
+          *p++ = cmd.sidemove;
+          *p++ = (cmd.angleturn + 128) >> 8;
+          continue;
+        }
+        *p++ = cmd.forwardmove;
+        *p++ = cmd.sidemove;
+        if (s->demolongtics) {
+          *p++ = cmd.angleturn & 0xff;
+          *p++ = (cmd.angleturn >> 8) & 0xff;
+        } else
+          *p++ = (cmd.angleturn + 128) >> 8;
+        *p++ = cmd.buttons;
+      }
+    if (fwrite(buf, 1, p - buf, s->demofp) != (size_t)(p - buf)) {
+      perror("WriteDemo");
+      CloseDemo(s);
+      return;
+    }
+    s->demotic++;
+  }
+}
+
+// A player leaving is often heard of after tics past it have been run;
+// those come out of the demo again
+static void DemoPlayerLeft(session_t *s, int tic)
+{
+  int j, ticbytes = 0;
+
+  if (!s->demofp || tic >= s->demotic)
+    return;
+
+  for (j=0; j<MAXPLAYERS; j++)
+    if (s->demoplayers & (1 << j))
+      ticbytes += s->demolongtics ? 5 : 4;
+  s->demotic = MAX(tic, 0);
+  fseek(s->demofp, s->demostart + (long)s->demotic * ticbytes, SEEK_SET);
+  CloseDemo(s);
+}
+
+static void GrowHistory(session_t *s, int tics)
+{
+  if (tics > s->historysize) {
+    s->historysize = MAX(tics, 2 * s->historysize);
+    if (!(s->history = realloc(s->history, s->historysize * sizeof *s->history)))
+      I_Error("GrowHistory: out of memory");
+  }
+}
+
+// Tics up to tic have been run by every player: keep them for
+// spectators and write them to the demo
+static void AdvanceTics(session_t *s, int tic)
+{
+  if (keephistory && tic > s->historylen) {
+    int j;
+
+    GrowHistory(s, tic);
+    for (; s->historylen < tic; s->historylen++)
+      for (j=0; j<MAXPLAYERS; j++)
+        s->history[s->historylen][j] = s->netcmds[j][s->historylen%BACKUPTICS];
+  }
+  s->exectics = tic;
+  WriteDemo(s);
+}
+
+void NORETURN sig_handler(int signum)
+{
+  char buf[80];
+  I_SigString(buf,80,signum);
+  printf("Received signal: %s\n", buf);
+
+  // Any signal is fatal
+  exit(1);
+}
+
+void doexit(void)
+{
+  packet_header_t packet;
+  session_t *s;
+
+  // Send "downed" packet
+  packet_set(&packet, PKT_DOWN, 0);
+  for (s = sessions; s; s = s->next) {
+    BroadcastPacket(s, &packet, sizeof packet);
+    CloseDemo(s);
+  }
+}
+
+#ifndef USE_SDL_NET
+static void I_InitSockets(int v4port)
+{
+  v4socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  I_SetupSocket(v4socket, v4port, AF_INET);
+}
+#else
+static void I_InitSockets(Uint16 port)
+{
+  I_InitNetwork();
+  udp_socket = I_Socket(port);
+  if (!udp_socket) I_Error("I_InitSockets: failed to open UDP port %d\n",port);
+}
+#endif
+
+long int ptic(packet_header_t* p)
+{
+    return doom_ntohl(p->tic);
+}
+
+
+
+void read_config_file(FILE* fp, struct setup_packet_s* sp)
+{
+  byte* gameopt = sp->game_options;
+
+  while (!feof(fp)) {
+    char  def[80];
+    char  strparm[100];
+    if (fscanf (fp, "%79s %99[^\n]\n", def, strparm) == 2) {
+      int v = atoi(strparm);
+      if (!strcmp(def,"default_skill")) {
+        if (verbose) printf("config file sets default_skill to %d\n",v);
+        sp->skill = v-1;
+      } else if (!strcmp(def,"default_compatibility_level")) {
+        if (verbose) printf("config file sets compatibility_level to %d\n",v);
+	if (v == -1) v = MAX_COMPATIBILITY_LEVEL-1; //e6y: -1 => maxcompat
+        sp->complevel = v;
+      } else {
+        int i;
+        for (i=0; i<num_gameopts; i++) {
+	  if (!!strcmp(gameopt_config_names[i],def)) continue;
+	  if (verbose) printf("config file sets %s to %d\n",def,v);
+	  gameopt[i] = v;
+	}
+      }
+    }
+  }
+}
+
+static int badplayer(int n) { return (n < 0 || n >= MAXPLAYERS); }
+
+//
+// Packet handling
+//
+
+static void SendSetup(session_t *s, packet_header_t *packet, client_t *cl)
+{
+  struct setup_packet_s *sinfo = (void*)(packet+1);
+  size_t extrabytes = 0;
+  int i;
+
+  packet_set(packet, PKT_SETUP, 0);
+  packet->reserved[0] = cl->protocol;
+  if (cl->player < 0)
+    packet->reserved[1] |= SETUP_SPECTATOR;
+  if (s->demofp || (demoname && !s->ingame)) {
+    if (!DemoLongtics(s->setupinfo.complevel))
+      packet->reserved[1] |= SETUP_SHORTTICS;
+  }
+#ifdef USE_SDL_NET
+  packet->reserved[1] |= upstreamflags & SETUP_SHORTTICS;
+#endif
+  memcpy(sinfo, &s->setupinfo, sizeof s->setupinfo);
+  sinfo->yourplayer = MAX(cl->player, 0);
+  sinfo->numwads = numwads;
+  for (i=0; i<numwads; i++) {
+    strcpy(sinfo->wadnames + extrabytes, wadname[i]);
+    extrabytes += strlen(wadname[i]) + 1;
+  }
+  SendPacketToAddress(packet, sizeof *packet + sizeof s->setupinfo + extrabytes, &cl->addr);
+  if (cl->player >= 0) // Spectators joining mustn't hold up the players
+    ResendPause();
+  SendPacketToAddress(packet, sizeof *packet + sizeof s->setupinfo + extrabytes, &cl->addr);
+}
+
+static session_t *JoinPlayer(packet_header_t *packet, client_t *cl, int version)
+{
+  session_t *s;
+  int n;
+
+  if (cl) { // Already joined, the setup packet must have been lost
+    s = cl->session;
+    n = cl->player;
+  } else {
+    if (!(s = OpenSession())) return NULL; // No room
+
+    /* Find player number and add to the game */
+    n = *(short*)(packet+1);
+
+    if (badplayer(n) || s->playerstate[n] != pc_unused)
+     for (n=0; n<numplayers; n++)
+      if (s->playerstate[n] == pc_unused) break;
+
+    if (n == numplayers) return NULL; // Full game
+    s->playerstate[n] = pc_connected;
+    cl = &s->clients[n];
+    cl->addr = lastsender;
+    HashClient(cl);
+
+    SessionPrintf(s, "Join by ");
+    PrintAddress(&lastsender);
+    printf(" as player %d\n",n);
+  }
+  cl->protocol = version;
+  SendSetup(s, packet, cl);
+  return s;
+}
+
+static void JoinSpectator(packet_header_t *packet, size_t len, int version)
+{
+  session_t *s;
+  spectator_t *sp;
+  int id = len >= sizeof *packet + 2 ? (short)doom_ntohs(*(short*)(packet+1)) : -1;
+
+  // Spectators are sent PKT_DTICS
+  if (version < 1 || !(s = WatchSession(id)) || s->numspectators >= maxspectators) {
+    packet_set(packet, PKT_DOWN, 0);
+    SendPacketToAddress(packet, sizeof *packet, &lastsender);
+    return;
+  }
+
+  sp = calloc(1, sizeof *sp);
+  sp->cl.addr = lastsender;
+  sp->cl.session = s;
+  sp->cl.player = -1;
+  sp->cl.protocol = version;
+  sp->lastheard = time(NULL);
+  sp->next = s->spectators;
+  s->spectators = sp;
+  s->numspectators++;
+  HashClient(&sp->cl);
+
+  if (verbose) {
+    SessionPrintf(s, "Spectator ");
+    PrintAddress(&lastsender);
+    printf(" joins (%d watching)\n", s->numspectators);
+  }
+  SendSetup(s, packet, &sp->cl);
+}
+
+static void HandleSpectatorPacket(spectator_t *sp, packet_header_t *packet)
+{
+  session_t *s = sp->cl.session;
+
+  sp->lastheard = time(NULL);
+  switch (packet->type) {
+  case PKT_WATCH: // Our PKT_SETUP was lost
+    SendSetup(s, packet, &sp->cl);
+    break;
+  case PKT_GO:
+    if (s->ingame) {
+      int i;
+
+      // Joining late, or our PKT_GO was lost. Players who have already
+      // left are sent again, as their PKT_QUITs went before it came.
+      packet_set(packet, PKT_GO, 0);
+      SendPacketToAddress(packet, sizeof *packet, &sp->cl.addr);
+      for (i=0; i<MAXPLAYERS; i++)
+        if (s->playerleftgame[i] != INT_MAX && s->playerjoingame[i] != INT_MAX) {
+          packet_set(packet, PKT_QUIT, s->playerleftgame[i]);
+          *(byte*)(packet+1) = i;
+          SendPacketToAddress(packet, sizeof *packet + 1, &sp->cl.addr);
+        }
+      sp->watching = true;
+    }
+    break;
+  case PKT_RETRANS: // Where it has got to
+    if (verbose>2) printf("spectator asks for tics from %ld\n", ptic(packet));
+    sp->from = sp->sentto = ptic(packet);
+    if (sp->watching)
+      SendSpectatorTics(s, sp);
+    break;
+  case PKT_QUIT:
+    if (verbose) SessionPrintf(s, "Spectator leaves (%d watching)\n", s->numspectators - 1);
+    RemoveSpectator(s, sp);
+    break;
+  default:
+    break;
+  }
+}
+
+static void SendWad(packet_header_t *packet)
+{
+  int i;
+  char *name = 1 + (char*)(packet+1);
+  size_t size = sizeof(packet_header_t);
+  packet_header_t *reply;
+
+  if (verbose) printf("Request for %s ", name);
+  for (i=0; i<numwads; i++)
+    if (!strcasecmp(name, wadname[i]))
+      break;
+
+  if ((i==numwads) || !wadget[i]) {
+    if (verbose) printf("n/a\n");
+    *(char*)(packet+1) = 0;
+    SendPacketToAddress(packet, size+1, &lastsender);
+  } else {
+    size += strlen(wadname[i]) + strlen(wadget[i]) + 2;
+    reply = malloc(size);
+    packet_set(reply, PKT_WAD, 0);
+    strcpy((char*)(reply+1), wadname[i]);
+    strcpy((char*)(reply+1) + strlen(wadname[i]) + 1, wadget[i]);
+    printf("sending %s\n", wadget[i]);
+    SendPacketToAddress(reply, size, &lastsender);
+    free(reply);
+  }
+}
+
+// Returns the game the packet was for, if any
+static session_t *HandlePacket(packet_header_t *packet, size_t len)
+{
+  client_t *cl = FindClient(&lastsender);
+  session_t *s;
+  int from;
+  int version = packet_version(packet);
+
+  if (verbose>2) printf("Received packet:");
+
+  if (cl && cl->player < 0) {
+    HandleSpectatorPacket((spectator_t *)cl, packet);
+    return NULL;
+  }
+
+  // Packets from players not yet in a game
+  switch (packet->type) {
+  case PKT_INIT:
+    if (cl && cl->session->ingame) break;
+    return JoinPlayer(packet, cl, version);
+  case PKT_WATCH:
+    if (!cl) JoinSpectator(packet, len, version);
+    return NULL;
+  case PKT_WAD:
+    if (!cl) SendWad(packet);
+    return NULL;
+  }
+
+  if (!cl) return NULL;
+  s = cl->session;
+  from = cl->player;
+  s->lastheard = time(NULL);
+
+  switch (packet->type) {
+  case PKT_INIT:
+    break;
+  case PKT_GO:
+    if (!s->ingame) {
+      if (s->confirming) {
+        if (s->playerstate[from] != pc_confirmedready) s->curplayers++;
+        s->playerstate[from] = pc_confirmedready;
+      } else
+        s->playerstate[from] = pc_ready;
+    } else if (maxsessions) {
+      // Our PKT_GO was lost, the client is still waiting for it
+      packet_set(packet, PKT_GO, 0);
+      SendToPlayer(s, packet, sizeof *packet, from);
+    }
+    break;
+  case PKT_TICC:
+    {
+      byte tics = *(byte*)(packet+1);
+
+      if (verbose>2)
+        printf("tics %ld - %ld from %d\n", ptic(packet), ptic(packet) + tics - 1, from);
+      if (ptic(packet) > s->remoteticfrom[from]) {
+        // Missed tics, so request a resend
+        packet_set(packet, PKT_RETRANS, s->remoteticfrom[from]);
+        SendToPlayer(s, packet, sizeof *packet, from);
+      } else {
+        ticcmd_t *newtic = (void*)(((byte*)(packet+1))+2);
+        if (ptic(packet) + tics < s->remoteticfrom[from]) break; // Won't help
+        s->remoteticfrom[from] = ptic(packet);
+        while (tics--)
+          s->netcmds[from][s->remoteticfrom[from]++%BACKUPTICS] = *newtic++;
+      }
+    }
+    break;
+  case PKT_DTICC:
+    {
+      const byte *p = (byte*)(packet+1);
+      const byte *end = (byte*)packet + len;
+      ticcmd_t cmds[256], base = { 0 };
+      int tics, i;
+
+      if (len < sizeof *packet + 2) break;
+      tics = *p; p += 2;
+
+      if (verbose>2)
+        printf("tics %ld - %ld from %d\n", ptic(packet), ptic(packet) + tics - 1, from);
+      if (ptic(packet) > s->remoteticfrom[from]) {
+        // Missed tics, so request a resend
+        packet_set(packet, PKT_RETRANS, s->remoteticfrom[from]);
+        SendToPlayer(s, packet, sizeof *packet, from);
+        break;
+      }
+      if (ptic(packet) + tics < s->remoteticfrom[from]) break; // Won't help
+
+      for (i=0; i<tics; i++) {
+        if (!(p = DeltaToTic(&cmds[i], p, end, &base))) break;
+        base = cmds[i];
+      }
+      if (i < tics) break; // Truncated
+
+      // Kept as they came in for PKT_TICC, in network byte order
+      s->remoteticfrom[from] = ptic(packet);
+      for (i=0; i<tics; i++)
+        TicToRaw(&s->netcmds[from][s->remoteticfrom[from]++%BACKUPTICS], &cmds[i]);
+    }
+    break;
+  case PKT_RETRANS:
+    if (verbose>2) printf("%d requests resend from %ld\n", from, ptic(packet));
+    s->remoteticto[from] = ptic(packet);
+    break;
+  case PKT_QUIT:
+    if (!s->ingame) {
+      // If we already got a PKT_GO, we have to remove this player frmo the count of ready players. And we then flag this player slot as vacant.
+      SessionPrintf(s, "player %d pulls out\n", from);
+      if (s->playerstate[from] == pc_confirmedready) s->curplayers--;
+      s->playerstate[from] = pc_unused;
+      UnhashClient(cl);
+      if (maxsessions && n_players_in_state(s, MAXPLAYERS, pc_unused))
+        EndSession(s);
+    } else
+    if (s->playerleftgame[from] == INT_MAX) { // In the game
+      s->playerleftgame[from] = ptic(packet);
+      DemoPlayerLeft(s, ptic(packet));
+      --s->curplayers;
+      if (verbose) SessionPrintf(s, "%d quits at %ld (%d left)\n", from, ptic(packet), s->curplayers);
+      if (!s->curplayers) EndSession(s); // All players have exited
+    }
+    // fallthrough
+    // and broadcast it
+  case PKT_EXTRA:
+    BroadcastPacket(s, packet, len);
+    if (packet->type == PKT_EXTRA) {
+      if (verbose>2) printf("misc from %d\n", *(((byte*)(packet+1))+1));
+    }
+    break;
+  default:
+    printf("Unrecognised packet type %d\n", packet->type);
+    break;
+  }
+  return s;
+}
+
+//
+// Sending tics
+//
+
+// Big enough for a tic either way
+#define TICBLOCKSIZE (1 + MAXPLAYERS * (1 + DELTA_TICCMD_MAX))
+#define TICCACHE (2 * MAXSENDTICS)
+
+// How a tic is written into a PKT_TICS or PKT_DTICS
+enum {
+  tb_raw,   // PKT_TICS
+  tb_first, // PKT_DTICS, first tic of the packet
+  tb_delta, // PKT_DTICS, later tics
+  NUMTICBLOCKS
+};
+
+/* The commands for each tic are the same for every player they are sent
+ * to, so each tic's block is put together once per update and copied
+ * whole into each player's packet.
+ */
+static struct {
+  const session_t *session;
+  int tic, update;
+  size_t len;
+  byte data[TICBLOCKSIZE];
+} ticblocks[NUMTICBLOCKS][TICCACHE];
+static int ticupdate;
+static packet_header_t *ticpacket;
+
+static const byte *TicBlock(session_t *s, int tic, int kind, size_t *len)
+{
+  int j;
+  byte *p, *q;
+  int playersthistic = 0;
+  int slot = tic % TICCACHE;
+
+  if (ticblocks[kind][slot].update == ticupdate && ticblocks[kind][slot].tic == tic &&
+      ticblocks[kind][slot].session == s) {
+    *len = ticblocks[kind][slot].len;
+    return ticblocks[kind][slot].data;
+  }
+
+  p = ticblocks[kind][slot].data;
+  q = p++;
+  *q = 0;
+  for (j=0; j<MAXPLAYERS; j++)
+    if (PlayerInTic(s, j, tic)) {
+      if (kind == tb_raw) {
+        *p++ = j;
+        memcpy(p, SessionCmd(s, j, tic), sizeof(ticcmd_t));
+        p += sizeof(ticcmd_t);
+        playersthistic++;
+      } else {
+        ticcmd_t cmd, base = { 0 };
+
+        // netcmds are kept in network byte order
+        RawToTic(&cmd, SessionCmd(s, j, tic));
+        if (kind == tb_delta && PlayerInTic(s, j, tic-1))
+          RawToTic(&base, SessionCmd(s, j, tic-1));
+        p = TicToDelta(p, &cmd, &base);
+        *q |= 1 << j;
+      }
+    }
+  if (kind == tb_raw)
+    *q = playersthistic;
+
+  ticblocks[kind][slot].session = s;
+  ticblocks[kind][slot].tic = tic;
+  ticblocks[kind][slot].update = ticupdate;
+  *len = ticblocks[kind][slot].len = p - ticblocks[kind][slot].data;
+  return ticblocks[kind][slot].data;
+}
+
+static void SendTics(session_t *s, netaddr_t *to, int tic, int tics, dboolean delta)
+{
+  byte *p = (void*)(ticpacket+1);
+  int kind = delta ? tb_first : tb_raw;
+
+  packet_set(ticpacket, delta ? PKT_DTICS : PKT_TICS, tic);
+  *p++ = tics;
+  while (tics--) {
+    size_t len;
+    const byte *block = TicBlock(s, tic++, kind, &len);
+
+    memcpy(p, block, len);
+    p += len;
+    if (delta) kind = tb_delta;
+  }
+  SendPacketToAddress(ticpacket, p - ((byte*)ticpacket), to);
+}
+
+// Sends a spectator the tics it hasn't had, as far as it has room for
+static void SendSpectatorTics(session_t *s, spectator_t *sp)
+{
+  int tic = MAX(sp->from, sp->sentto - NET_REDUNDANCY);
+  int tics = MIN(s->exectics, sp->from + SPECTATORWINDOW) - tic;
+
+  if (tics <= 0)
+    return;
+  SendTics(s, &sp->cl.addr, tic, tics, true);
+  sp->sentto = tic + tics;
+}
+
+static void SendSpectators(session_t *s)
+{
+  spectator_t *sp;
+
+  for (sp = s->spectators; sp; sp = sp->next)
+    if (sp->watching && sp->sentto < s->exectics)
+      SendSpectatorTics(s, sp);
+}
+
+static void RunTics(session_t *s)
+{
+  int lowtic = INT_MAX, lastleft = 0;
+  int i;
+
+  for (i=0; i<MAXPLAYERS; i++)
+    if (s->playerstate[i] == pc_playing || s->playerstate[i] == pc_quit) {
+      if (s->remoteticfrom[i] < s->playerleftgame[i]-1 && s->remoteticfrom[i]<lowtic)
+        lowtic = s->remoteticfrom[i];
+      if (s->playerleftgame[i] != INT_MAX)
+        lastleft = MAX(lastleft, s->playerleftgame[i]);
+    }
+
+  // Everyone has left, and sent all the tics they were in
+  if (lowtic == INT_MAX)
+    lowtic = lastleft;
+
+  if (verbose>1) SessionPrintf(s, "%d new tics can be run\n", lowtic - s->exectics);
+
+  ticupdate++;
+
+  if (lowtic > s->exectics)
+    AdvanceTics(s, lowtic); // count exec'ed tics
+
+  // Now send all tics up to lowtic
+  for (i=0; i<MAXPLAYERS; i++)
+    if (s->playerstate[i] == pc_playing) {
+      int tics;
+      dboolean delta = s->clients[i].protocol >= 1;
+      if (lowtic <= s->remoteticto[i]) continue;
+      if ((s->remoteticto[i] -= (delta ? MAX(xtratics, NET_REDUNDANCY) : xtratics)) < 0) s->remoteticto[i] = 0;
+      tics = MIN(lowtic - s->remoteticto[i], MAXSENDTICS);
+      if (verbose>1) printf("sending %d tics to %d\n", tics, i);
+      SendTics(s, &s->clients[i].addr, s->remoteticto[i], tics, delta);
+      s->remoteticto[i] += tics;
+      {
+        if (s->remoteticfrom[i] == s->remoteticto[i]) {
+	  s->backoffcounter[i] = 0;
+	} else if (s->remoteticfrom[i] > s->remoteticto[i]+1) {
+	  if ((s->backoffcounter[i] += s->remoteticfrom[i] - s->remoteticto[i] - 1) > 35) {
+	    packet_header_t packet;
+	    packet_set(&packet, PKT_BACKOFF, s->remoteticto[i]);
+	    SendToPlayer(s, &packet, sizeof packet, i);
+	    s->backoffcounter[i] = 0;
+	    if (verbose) SessionPrintf(s, "telling client %d to back off\n",i);
+	  }
+	}
+      }
+    }
+
+  SendSpectators(s);
+}
+
+// Drop spectators who have gone quiet
+static void ReapSpectators(session_t *s)
+{
+  time_t now = time(NULL);
+  spectator_t *sp, *next;
+
+  if (now == s->lastreap)
+    return;
+  s->lastreap = now;
+
+  for (sp = s->spectators; sp; sp = next) {
+    next = sp->next;
+    if (now - sp->lastheard > SPECTATORTIMEOUT) {
+      if (verbose) SessionPrintf(s, "Spectator timed out (%d watching)\n", s->numspectators - 1);
+      RemoveSpectator(s, sp);
+    }
+  }
+}
+
+// Whether every spectator has seen the game to the end
+static dboolean SpectatorsDone(session_t *s)
+{
+  spectator_t *sp;
+
+  for (sp = s->spectators; sp; sp = sp->next)
+    if (sp->watching && sp->from < s->exectics)
+      return false;
+  return true;
+}
+
+// Start, confirm and run a game after it has received packets
+static void UpdateSession(session_t *s)
+{
+  if (!s->ingame && n_players_in_state(s, numplayers, pc_confirmedready)) {
+    int i;
+    packet_header_t gopacket;
+    s->ingame=true;
+    SessionPrintf(s, "All players joined, beginning game.\n");
+    for (i=0; i<MAXPLAYERS; i++) {
+      if (s->playerstate[i] == pc_confirmedready) {
+	      s->playerjoingame[i] = 0;
+	      s->playerleftgame[i] = INT_MAX;
+	      s->playerstate[i] = pc_playing;
+      }
+    }
+    packet_set(&gopacket, PKT_GO, 0);
+    BroadcastPacket(s, &gopacket, sizeof gopacket);
+    ResendPause();
+    BroadcastPacket(s, &gopacket, sizeof gopacket);
+    ResendPause();
+    {
+      spectator_t *sp;
+      for (sp = s->spectators; sp; sp = sp->next)
+        sp->watching = true;
+    }
+    if (demoname)
+      OpenDemo(s);
+  }
+  if (s->confirming && time(NULL) >= s->confirming && !s->ingame) {
+    int i;
+    s->confirming = 0;
+    s->curplayers = 0;
+    for (i=0; i<MAXPLAYERS; i++) {
+      if (s->playerstate[i] == pc_ready) {
+	      s->playerstate[i] = pc_unused;
+	      UnhashClient(&s->clients[i]);
+	      SessionPrintf(s, "Player %d dropped, no PKT_GO received in confirmation\n", i);
+      }
+      if (s->playerstate[i] == pc_confirmedready) s->playerstate[i] = pc_ready;
+    }
+  }
+  if (!s->ingame && !s->confirming && n_players_in_state(s, numplayers, pc_ready)) {
+	  SessionPrintf(s, "All players ready, now confirming.\n");
+	  s->confirming = time(NULL) + CONFIRMTIME;
+  }
+
+#ifdef USE_SDL_NET
+  if (s->ingame && !upstream) // Run some tics
+#else
+  if (s->ingame) // Run some tics
+#endif
+    RunTics(s);
 
-int playerjoingame[MAXPLAYERS], playerleftgame[MAXPLAYERS];
-UDP_CHANNEL remoteaddr[MAXPLAYERS];
-enum { pc_unused, pc_connected, pc_ready, pc_confirmedready, pc_playing, pc_quit } playerstate[MAXPLAYERS];
-int displaycounter;
+  if (s->spectators)
+    ReapSpectators(s);
+  if (s->ending && (SpectatorsDone(s) || time(NULL) - s->ending > SESSIONTIMEOUT)) {
+    FinishSession(s);
+    return;
+  }
 
-dboolean n_players_in_state(int n, int ps) {
-	int i,j;
-	for (i=j=0;i<MAXPLAYERS;i++)
-		if (playerstate[i] == ps) j++;
-	return (j == n);
+  if (!maxsessions && !((s->ingame ? 0xff : 0xf) & s->displaycounter++)) {
+    int i;
+    fprintf(stderr,"Player states: [");
+    for (i=0;i<MAXPLAYERS;i++) {
+      switch (s->playerstate[i]) {
+        case pc_unused: fputc(' ',stderr); break;
+        case pc_connected: fputc('c',stderr); break;
+        case pc_ready: fputc('r',stderr); break;
+        case pc_confirmedready: fputc('g',stderr); break;
+        case pc_playing: fputc('p',stderr); break;
+        case pc_quit: fputc('x',stderr); break;
+      }
+    }
+    fprintf(stderr,"]\n");
+  }
 }
 
-void BroadcastPacket(packet_header_t *packet, size_t len)
+// Drop hosted games that have gone quiet, their players having vanished
+// without a PKT_QUIT
+static void ReapSessions(void)
 {
-  int i;
-  for (i=0; i<MAXPLAYERS; i++)
-    if (playerstate[i] != pc_unused && playerstate[i] != pc_quit)
-      I_SendPacketTo(packet, len, &remoteaddr[i]);
-}
+  static time_t lastreap, lastreport;
+  time_t now = time(NULL);
+  session_t *s, *next;
 
-byte def_game_options[GAME_OPTIONS_SIZE] = \
-{ // cf g_game.c:G_WriteOptions()
-  1, // monsters remember
-  1, // friction
-  0, // weapon recoil
-  1, // pushers
-  0, // reserved/unused
-  1, // player bobbing
-  0, 0, 0, // respawn, fast, nomonsters
-  1, // demo insurance
-  0, 0, 0, 0, // 4 bytes of random number seed
-  1, 0, 0, 0,
-  0, 128, /* distfriend */
-  0, 1, 1, 1, 1, 0,
-  /* Zeroes for all compatibility stuff */
-};
+  if (now == lastreap)
+    return;
+  lastreap = now;
 
-#define nosuch "NOSUCHCONFIGITEM"
+  for (s = sessions; s; s = next) {
+    next = s->next;
+    // Give up confirming even if no more packets arrive for the game
+    if (s->confirming && !s->ingame && now >= s->confirming) {
+      UpdateSession(s);
+      if (s->ended) {
+        FreeSession(s);
+        continue;
+      }
+    }
+    if (now - s->lastheard > SESSIONTIMEOUT) {
+      packet_header_t packet;
 
-const char* gameopt_config_names[] = {
-"monsters_remember",nosuch,"weapon_recoil",nosuch,nosuch,"player_bobbing",nosuch,nosuch,nosuch,"demo_insurance",
-nosuch,nosuch,nosuch,nosuch, // RNG seed
-"monster_infighting","player_helpers",nosuch,nosuch,
-nosuch,nosuch, // distfriend
-"monster_backing","monster_avoid_hazards","monster_friction","help_friends","dog_jumping","monkeys",
-"comp_telefrag","comp_dropoff","comp_vile","comp_pain","comp_skull","comp_blazing","comp_doorlight","comp_model","comp_god","comp_falloff","comp_floors","comp_skymap","comp_pursuit","comp_doorstuck","comp_staylift","comp_zombie","comp_stairs","comp_infcheat","comp_zerotags","comp_moveblock","comp_respawn","comp_sound","comp_666","comp_maskedanim","comp_ouchface","comp_maxhealth","comp_translucency" };//e6y
+      SessionPrintf(s, "timed out\n");
+      packet_set(&packet, PKT_DOWN, 0);
+      BroadcastPacket(s, &packet, sizeof packet);
+      FreeSession(s);
+    }
+  }
 
-const int num_gameopts = sizeof gameopt_config_names / sizeof gameopt_config_names[0];
+  if (now - lastreport >= 60) {
+    int playing = 0;
 
-int verbose;
+    lastreport = now;
+    for (s = sessions; s; s = s->next)
+      playing += s->ingame;
+    fprintf(stderr,"Games: %d (%d playing)\n", numsessions, playing);
+  }
+}
 
-void NORETURN sig_handler(int signum)
-{
-  char buf[80];
-  I_SigString(buf,80,signum);
-  printf("Received signal: %s\n", buf);
+#ifdef USE_SDL_NET
+//
+// Relaying
+//
 
-  // Any signal is fatal
-  exit(1);
-}
+/* With -u the server hosts no game of its own, but joins one elsewhere
+ * as a spectator and passes it on to spectators here, so that one game
+ * can be watched by more people than a single server could serve.
+ */
 
-void doexit(void)
+static dboolean FromUpstream(void)
 {
-  packet_header_t packet;
-
-  // Send "downed" packet
-  packet_set(&packet, PKT_DOWN, 0);
-  BroadcastPacket(&packet, sizeof packet);
+  return SameAddress(&sentfrom_addr, &serverIP);
 }
 
-#ifndef USE_SDL_NET
-static void I_InitSockets(int v4port)
+// Tells upstream how far we have got, which also keeps us in its game
+static void RelayAck(session_t *s)
 {
-  v4socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
-  I_SetupSocket(v4socket, v4port, AF_INET);
+  byte buf[sizeof(packet_header_t) + 1];
+
+  packet_set((packet_header_t *)buf, PKT_RETRANS, s->historylen);
+  buf[sizeof(packet_header_t)] = 0;
+  I_SendPacket((packet_header_t *)buf, sizeof buf);
+  upstreamacked = time(NULL);
 }
-#else
-static void I_InitSockets(Uint16 port)
+
+// Waits for a packet of the given type from upstream, sending the
+// given one until it comes
+static size_t RelayExchange(packet_header_t *packet, packet_header_t *send, size_t sendlen, int type)
 {
-  I_InitNetwork();
-  udp_socket = I_Socket(port);
-  if (!udp_socket) I_Error("I_InitSockets: failed to open UDP port %d\n",port);
+  size_t len;
+
+  while (1) {
+    I_SendPacket(send, sendlen);
+    I_WaitForPacket(1000);
+    while ((len = I_GetPacket(packet, MAXPACKET)))
+      if (FromUpstream()) {
+        if (packet->type == PKT_DOWN)
+          I_Error("RelayConnect: %s has no game to watch\n", upstream);
+        if (packet->type == type)
+          return len;
+      }
+  }
 }
-#endif
 
-long int ptic(packet_header_t* p)
+// Joins the game being relayed, returning once it has started
+static session_t *RelayConnect(packet_header_t *packet)
 {
-    return doom_ntohl(p->tic);
-}
+  struct {
+    packet_header_t head;
+    short game;
+  } PACKEDATTR init;
+  struct setup_packet_s *sinfo = (void*)(packet+1);
+  session_t *s;
+  size_t len;
+  const char *p, *end;
+  int i;
 
+  if (I_ConnectToServer(upstream))
+    I_Error("RelayConnect: can't find %s\n", upstream);
+  printf("Joining the game at %s\n", upstream);
 
+  packet_set(&init.head, PKT_WATCH, 0);
+  init.head.reserved[0] = NET_PROTOCOL_VERSION;
+  init.game = doom_htons(-1);
+  len = RelayExchange(packet, &init.head, sizeof init, PKT_SETUP);
+  if (len < sizeof *packet + sizeof *sinfo - 1 || packet_version(packet) < 1)
+    I_Error("RelayConnect: %s can't be watched\n", upstream);
 
-void read_config_file(FILE* fp, struct setup_packet_s* sp)
+  upstreamflags = packet->reserved[1];
+  memcpy(&setupinfo, sinfo, sizeof setupinfo);
+  setupinfo.numwads = 0;
+  numplayers = sinfo->players;
+  p = (const char *)sinfo->wadnames;
+  end = (const char *)packet + len;
+  for (i=0; i<sinfo->numwads && p < end; i++) {
+    wadname = realloc(wadname, ++numwads * sizeof *wadname);
+    wadget  = realloc(wadget ,   numwads * sizeof *wadget );
+    wadname[numwads-1] = calloc(1, end - p + 1);
+    strncpy(wadname[numwads-1], p, end - p);
+    wadget[numwads-1] = NULL;
+    p += strlen(wadname[numwads-1]) + 1;
+  }
+  if (demoname && !DemoLongtics(setupinfo.complevel) && !(upstreamflags & SETUP_SHORTTICS))
+    printf("Warning: the players aren't rounding their turning, so the demo may not play back\n");
+
+  s = NewSession();
+  s->setupinfo = setupinfo; // with upstream's random seed
+  for (i=0; i<numplayers; i++) {
+    s->playerjoingame[i] = 0;
+    s->playerleftgame[i] = INT_MAX;
+  }
+  s->curplayers = numplayers;
+
+  packet_set(&init.head, PKT_GO, 0);
+  init.game = 0;
+  RelayExchange(packet, &init.head, sizeof init.head + 1, PKT_GO);
+  printf("Relaying a game of %d players\n", numplayers);
+  s->ingame = true;
+  upstreamheard = time(NULL);
+  if (demoname)
+    OpenDemo(s);
+  return s;
+}
+
+static session_t *HandleUpstream(session_t *s, packet_header_t *packet, size_t len)
 {
-  byte* gameopt = sp->game_options;
+  upstreamheard = time(NULL);
 
-  while (!feof(fp)) {
-    char  def[80];
-    char  strparm[100];
-    if (fscanf (fp, "%79s %99[^\n]\n", def, strparm) == 2) {
-      int v = atoi(strparm);
-      if (!strcmp(def,"default_skill")) {
-        if (verbose) printf("config file sets default_skill to %d\n",v);
-        sp->skill = v-1;
-      } else if (!strcmp(def,"default_compatibility_level")) {
-        if (verbose) printf("config file sets compatibility_level to %d\n",v);
-	if (v == -1) v = MAX_COMPATIBILITY_LEVEL-1; //e6y: -1 => maxcompat
-        sp->complevel = v;
-      } else {
-        int i;
-        for (i=0; i<num_gameopts; i++) {
-	  if (!!strcmp(gameopt_config_names[i],def)) continue;
-	  if (verbose) printf("config file sets %s to %d\n",def,v);
-	  gameopt[i] = v;
-	}
+  switch (packet->type) {
+  case PKT_DTICS:
+    {
+      static ticcmd_t cmds[256][MAXPLAYERS];
+      static byte ingame[256];
+      const byte *p = (byte*)(packet+1);
+      const byte *end = (byte*)packet + len;
+      int tic = ptic(packet), tics, i, j;
+
+      if (len < sizeof *packet + 1) break;
+      tics = *p++;
+      if (tic > s->historylen) { // Missed some
+        RelayAck(s);
+        break;
+      }
+      if (tic + tics <= s->historylen) break; // Won't help
+
+      for (i=0; i<tics && p < end; i++) {
+        ingame[i] = *p++;
+        for (j=0; j<MAXPLAYERS && p; j++)
+          if (ingame[i] & (1 << j)) {
+            ticcmd_t base = { 0 };
+            if (i > 0 && (ingame[i-1] & (1 << j)))
+              base = cmds[i-1][j];
+            p = DeltaToTic(&cmds[i][j], p, end, &base);
+          }
+        if (!p) break;
       }
+      if (i < tics) break; // Truncated
+
+      // Kept in network byte order, as they come from players
+      GrowHistory(s, tic + tics);
+      for (i = s->historylen - tic; i < tics; i++)
+        for (j=0; j<MAXPLAYERS; j++) {
+          ticcmd_t none = { 0 };
+          TicToRaw(&s->history[tic + i][j], ingame[i] & (1 << j) ? &cmds[i][j] : &none);
+        }
+      s->historylen = tic + tics;
+      ticupdate++;
+      AdvanceTics(s, s->historylen);
+      SendSpectators(s);
+      RelayAck(s);
+    }
+    break;
+  case PKT_QUIT:
+    {
+      int pn = *(byte*)(packet+1);
+
+      if (len < sizeof *packet + 1 || badplayer(pn) || s->playerleftgame[pn] != INT_MAX)
+        break; // Sent again, or not in the game
+      s->playerleftgame[pn] = ptic(packet);
+      DemoPlayerLeft(s, ptic(packet));
+      if (verbose) SessionPrintf(s, "%d quits at %ld\n", pn, ptic(packet));
+      if (!--s->curplayers) EndSession(s);
     }
+    // fallthrough
+  case PKT_EXTRA:
+    BroadcastPacket(s, packet, len);
+    break;
+  case PKT_DOWN:
+    SessionPrintf(s, "%s has ended the game\n", upstream);
+    EndSession(s);
+    break;
+  default:
+    break;
   }
+  return s;
 }
 
-static int badplayer(int n) { return (n < 0 || n >= MAXPLAYERS); }
+// Keeps in touch with upstream while the game is quiet
+static void RelayKeepAlive(session_t *s)
+{
+  time_t now = time(NULL);
+
+  if (s->ending)
+    return;
+  if (now - upstreamheard > SESSIONTIMEOUT) {
+    SessionPrintf(s, "%s has stopped sending\n", upstream);
+    EndSession(s);
+  } else if (now != upstreamacked)
+    RelayAck(s);
+}
+#endif
 
 int main(int argc, char** argv)
 {
@@ -343,18 +1744,14 @@ int main(int argc, char** argv)
 #else
   Uint16 localport = 5030;
 #endif
-  int numplayers = 2, xtratics = 0, ticdup = 1;
-  int exectics = 0; // gametics completed
-  struct setup_packet_s setupinfo = { 2, 0, 1, 1, 1, 0, best_compatibility, 0, 0};
-  char**wadname = NULL;
-  char**wadget = NULL;
-  int numwads = 0;
+  int ticdup = 1;
+  const char *netsim = NULL;
   {
     int opt;
     byte *gameopt = setupinfo.game_options;
 
     memcpy(gameopt, &def_game_options, sizeof (setupinfo.game_options));
-    while ((opt = getopt(argc, argv, "c:t:x:p:e:l:adrfns:N:vw:")) != EOF)
+    while ((opt = getopt(argc, argv, "c:t:x:p:e:l:adrfns:N:vw:m:S:V:R:u:")) != EOF)
       switch (opt) {
       case 'c':
         {
@@ -413,33 +1810,64 @@ int main(int argc, char** argv)
       *p++ = 0; wadget[numwads-1] = p;
     } else wadget[numwads-1] = NULL;
   }
+  break;
+      case 'm':
+  if (optarg) maxsessions = MAX(atoi(optarg), 0);
+  break;
+      case 'S':
+  netsim = optarg;
+  break;
+      case 'V':
+  if (optarg) maxspectators = MAX(atoi(optarg), 0);
+  break;
+      case 'R':
+  demoname = optarg;
+  break;
+      case 'u':
+#ifdef USE_SDL_NET
+  upstream = optarg;
+#else
+  I_Error("Relaying needs SDL_net\n");
+#endif
   break;
       }
   }
+#ifdef USE_SDL_NET
+  if (upstream && maxsessions)
+    I_Error("-u relays a single game, it can't be used with -m\n");
+  keephistory = maxspectators || upstream;
+#else
+  keephistory = maxspectators;
+#endif
+  // Set up after every -v is counted, three of them trace each packet
+  if (netsim)
+    I_SetNetSim(netsim, verbose > 2);
 
   setupinfo.ticdup = ticdup; setupinfo.extratic = xtratics;
-  { /* Random number seed
-     * Mirrors the corresponding code in G_ReadOptions */
-    int rngseed = (int)time(NULL);
-    setupinfo.game_options[13] = rngseed & 0xff;
-    rngseed >>= 8;
-    setupinfo.game_options[12] = rngseed & 0xff;
-    rngseed >>= 8;
-    setupinfo.game_options[11] = rngseed & 0xff;
-    rngseed >>= 8;
-    setupinfo.game_options[10] = rngseed & 0xff;
-  }
   I_InitSockets(localport);
 
-  printf("Listening on port %d, waiting for %d players\n", localport, numplayers);
+  if (maxsessions)
+    printf("Listening on port %d, hosting up to %d games of %d players\n", localport, maxsessions, numplayers);
+#ifdef USE_SDL_NET
+  else if (upstream) {
+    packet_header_t *packet = malloc(MAXPACKET);
+
+    printf("Listening on port %d for spectators\n", localport);
+    RelayConnect(packet);
+    free(packet);
+  }
+#endif
+  else
+    printf("Listening on port %d, waiting for %d players\n", localport, numplayers);
+  if (maxspectators)
+    printf("Up to %d spectators may watch each game\n", maxspectators);
 
-  { // no players initially
+  {
     int i;
-    for (i=0; i<MAXPLAYERS; i++) {
-      playerjoingame[i] = INT_MAX;
-      playerleftgame[i] = 0;
-      playerstate[i] = pc_unused;
-    }
+
+    // A single game is there from the start, hosted games open on demand
+    if (!maxsessions && !sessions)
+      NewSession();
 
     // Print wads
     for (i=0; i<numwads; i++)
@@ -457,288 +1885,62 @@ int main(int argc, char** argv)
 #endif
 
   {
-    int remoteticfrom[MAXPLAYERS] = { 0, 0, 0, 0 };
-    int remoteticto[MAXPLAYERS] = { 0, 0, 0, 0 };
-    int backoffcounter[MAXPLAYERS] = { 0, 0, 0, 0 };
-    int curplayers = 0;
-    int confirming = 0;
-    dboolean ingame = false;
-    ticcmd_t netcmds[MAXPLAYERS][BACKUPTICS];
+    packet_header_t *packet = malloc(MAXPACKET);
 
-    while (1) {
-  packet_header_t *packet = malloc(10000);
-  size_t len;
-
-  I_WaitForPacket(120*1000);
-  while ((len = I_GetPacket(packet, 10000))) {
-    if (verbose>2) printf("Received packet:");
-    switch (packet->type) {
-    case PKT_INIT:
-      if (!ingame) {
-        {
-    int n;
-    struct setup_packet_s *sinfo = (void*)(packet+1);
+    ticpacket = malloc(sizeof(packet_header_t) + 1 + MAXSENDTICS * TICBLOCKSIZE);
 
-    /* Find player number and add to the game */
-    n = *(short*)(packet+1);
+    while (1) {
+      session_t *pending = NULL;
+      size_t len;
+      int count = 0;
 
-    if (badplayer(n) || playerstate[n] != pc_unused)
-     for (n=0; n<numplayers; n++)
-      if (playerstate[n] == pc_unused) break;
+      // Wake at least once a second when hosting to time out dead games
+      // and spectators
+      I_WaitForPacket(maxsessions || keephistory ? 1000 : 120*1000);
 
-    if (n == numplayers) break; // Full game
-    playerstate[n] = pc_connected;
-#ifndef USE_SDL_NET
-    remoteaddr[n] = sentfrom;
-#else
-    if (sentfrom==-1)
-      remoteaddr[n]=I_RegisterPlayer(&sentfrom_addr);
-#endif
+      // Read what has arrived, a batch at a time so that busy games
+      // can't hold up the others
+      while (count++ < PACKETBATCH && (len = I_GetPacket(packet, MAXPACKET))) {
+        session_t *s;
 
-    printf("Join by ");
-    I_PrintAddress(stdout, &remoteaddr[n]);
 #ifdef USE_SDL_NET
-    printf(" (channel %d)",remoteaddr[n]);
+        if (upstream && FromUpstream())
+          s = HandleUpstream(sessions, packet, len);
+        else
 #endif
-    printf(" as player %d\n",n);
-    {
-      int i;
-      size_t extrabytes = 0;
-      // Send setup packet
-      packet_set(packet, PKT_SETUP, 0);
-      memcpy(sinfo, &setupinfo, sizeof setupinfo);
-      sinfo->yourplayer = n;
-      sinfo->numwads = numwads;
-      for (i=0; i<numwads; i++) {
-        strcpy(sinfo->wadnames + extrabytes, wadname[i]);
-        extrabytes += strlen(wadname[i]) + 1;
-      }
-      I_SendPacketTo(packet, sizeof *packet + sizeof setupinfo + extrabytes,
-         remoteaddr+n);
-      I_uSleep(10000);
-      I_SendPacketTo(packet, sizeof *packet + sizeof setupinfo + extrabytes,
-         remoteaddr+n);
-    }
-        }
-      }
-      break;
-    case PKT_GO:
-      if (!ingame) {
-        int from = *(byte*)(packet+1);
-
-	if (badplayer(from) || playerstate[from] == pc_unused) break;
-	if (confirming) {
-		if (playerstate[from] != pc_confirmedready) curplayers++;
-		playerstate[from] = pc_confirmedready;
-	} else
-		playerstate[from] = pc_ready;
-      }
-      break;
-    case PKT_TICC:
-      {
-        byte tics = *(byte*)(packet+1);
-        int from = *(((byte*)(packet+1))+1);
-
-	if (badplayer(from)) break;
-
-        if (verbose>2)
-            printf("tics %ld - %ld from %d\n", ptic(packet), ptic(packet) + tics - 1, from);
-        if (ptic(packet) > remoteticfrom[from]) {
-            // Missed tics, so request a resend
-            packet_set(packet, PKT_RETRANS, remoteticfrom[from]);
-            I_SendPacketTo(packet, sizeof *packet, remoteaddr+from);
-        } else {
-            ticcmd_t *newtic = (void*)(((byte*)(packet+1))+2);
-            if (ptic(packet) + tics < remoteticfrom[from]) break; // Won't help
-            remoteticfrom[from] = ptic(packet);
-            while (tics--)
-              netcmds[from][remoteticfrom[from]++%BACKUPTICS] =  *newtic++;
-        }
-      }
-      break;
-    case PKT_RETRANS:
-      {
-        int from = *(byte*)(packet+1);
-	if (badplayer(from)) break;
+        s = HandlePacket(packet, len);
 
-        if (verbose>2) printf("%d requests resend from %ld\n", from, ptic(packet));
-        remoteticto[from] = ptic(packet);
-      }
-      break;
-    case PKT_QUIT:
-      {
-        int from = *(byte*)(packet+1);
-	if (badplayer(from)) break;
-
-	if (!ingame && playerstate[from] != pc_unused) {
-	  // If we already got a PKT_GO, we have to remove this player frmo the count of ready players. And we then flag this player slot as vacant.
-	  printf("player %d pulls out\n", from);
-	  if (playerstate[from] == pc_confirmedready) curplayers--;
-	  playerstate[from] = pc_unused;
-	} else
-        if (playerleftgame[from] == INT_MAX) { // In the game
-	  playerleftgame[from] = ptic(packet);
-	  --curplayers;
-	  if (verbose) printf("%d quits at %ld (%d left)\n", from, ptic(packet),curplayers);
-	  if (ingame && !curplayers) exit(0); // All players have exited
+        if (s && !s->pending) {
+          s->pending = true;
+          s->nextpending = pending;
+          pending = s;
         }
       }
-      // fallthrough
-      // and broadcast it
-    case PKT_EXTRA:
-      BroadcastPacket(packet, len);
-      if (packet->type == PKT_EXTRA) {
-        if (verbose>2) printf("misc from %d\n", *(((byte*)(packet+1))+1));
-      }
-      break;
-    case PKT_WAD:
-      {
-        int i;
-        int from = *(byte*)(packet+1);
-        char *name = 1 + (char*)(packet+1);
-        size_t size = sizeof(packet_header_t);
-        packet_header_t *reply;
-
-	if (badplayer(from) || playerstate[from] != pc_unused) break;
-
-        if (verbose) printf("Request for %s ", name);
-        for (i=0; i<numwads; i++)
-    if (!strcasecmp(name, wadname[i]))
-      break;
 
-        if ((i==numwads) || !wadget[i]) {
-    if (verbose) printf("n/a\n");
-    *(char*)(packet+1) = 0;
-    I_SendPacketTo(packet, size+1, remoteaddr + from);
-        } else {
-    size += strlen(wadname[i]) + strlen(wadget[i]) + 2;
-    reply = malloc(size);
-    packet_set(reply, PKT_WAD, 0);
-    strcpy((char*)(reply+1), wadname[i]);
-    strcpy((char*)(reply+1) + strlen(wadname[i]) + 1, wadget[i]);
-    printf("sending %s\n", wadget[i]);
-    I_SendPacketTo(reply, size, remoteaddr + from);
-    free(reply);
-        }
-      }
-      break;
-    default:
-      printf("Unrecognised packet type %d\n", packet->type);
-      break;
-    }
-  }
-  free(packet);
-  if (!ingame && n_players_in_state(numplayers,pc_confirmedready)) {
-    int i;
-    packet_header_t gopacket;
-    packet = &gopacket;
-    ingame=true;
-    printf("All players joined, beginning game.\n");
-    for (i=0; i<MAXPLAYERS; i++) {
-      if (playerstate[i] == pc_confirmedready) {
-	      playerjoingame[i] = 0;
-	      playerleftgame[i] = INT_MAX;
-	      playerstate[i] = pc_playing;
-      }
-    }
-    packet_set(packet, PKT_GO, 0);
-    BroadcastPacket(packet, sizeof *packet);
-    I_uSleep(10000);
-    BroadcastPacket(packet, sizeof *packet);
-    I_uSleep(10000);
-  }
-  if (confirming && !--confirming && !ingame) {
-    int i;
-    curplayers = 0;
-    for (i=0; i<MAXPLAYERS; i++) {
-      if (playerstate[i] == pc_ready) {
-	      playerstate[i] = pc_unused;
-	      printf("Player %d dropped, no PKT_GO received in confirmation\n", i);
+      // A single game updates on every pass, as it always has
+      if (!maxsessions && !sessions->pending) {
+        sessions->pending = true;
+        sessions->nextpending = pending;
+        pending = sessions;
       }
-      if (playerstate[i] == pc_confirmedready) playerstate[i] = pc_ready;
-    }
-  }
-  if (!ingame && n_players_in_state(numplayers,pc_ready)) {
-	  printf("All players ready, now confirming.\n");
-	  confirming = 100;
-  }
-
-  if (ingame) { // Run some tics
-  int lowtic = INT_MAX;
-  int i;
-  for (i=0; i<MAXPLAYERS; i++)
-    if (playerstate[i] == pc_playing || playerstate[i] == pc_quit) {
-      if (remoteticfrom[i] < playerleftgame[i]-1 && remoteticfrom[i]<lowtic)
-        lowtic = remoteticfrom[i];
-    }
 
-  if (verbose>1) printf("%d new tics can be run\n", lowtic - exectics);
+      while (pending) {
+        session_t *s = pending;
 
-  if (lowtic > exectics)
-    exectics = lowtic; // count exec'ed tics
-  // Now send all tics up to lowtic
-  for (i=0; i<MAXPLAYERS; i++)
-    if (playerstate[i] == pc_playing) {
-      int tics;
-      if (lowtic <= remoteticto[i]) continue;
-      if ((remoteticto[i] -= xtratics) < 0) remoteticto[i] = 0;
-      tics = MIN(lowtic - remoteticto[i], 128); // limit number of sent tics (CVE-2019-20797)
-      {
-        byte *p;
-        packet = malloc(sizeof(packet_header_t) + 1 +
-         tics * (1 + numplayers * (1 + sizeof(ticcmd_t))));
-        p = (void*)(packet+1);
-        packet_set(packet, PKT_TICS, remoteticto[i]);
-        *p++ = tics;
-        if (verbose>1) printf("sending %d tics to %d\n", tics, i);
-        while (tics--) {
-    int j, playersthistic = 0;
-    byte *q = p++;
-    for (j=0; j<MAXPLAYERS; j++)
-      if ((playerjoingame[j] <= remoteticto[i]) &&
-          (playerleftgame[j] > remoteticto[i])) {
-        *p++ = j;
-        memcpy(p, &netcmds[j][remoteticto[i]%BACKUPTICS], sizeof(ticcmd_t));
-        p += sizeof(ticcmd_t);
-        playersthistic++;
-      }
-    *q = playersthistic;
-    remoteticto[i]++;
-        }
-        I_SendPacketTo(packet, p - ((byte*)packet), remoteaddr+i);
-        free(packet);
-      }
-      {
-        if (remoteticfrom[i] == remoteticto[i]) {
-	  backoffcounter[i] = 0;
-	} else if (remoteticfrom[i] > remoteticto[i]+1) {
-	  if ((backoffcounter[i] += remoteticfrom[i] - remoteticto[i] - 1) > 35) {
-	    packet_header_t *packet = malloc(sizeof(packet_header_t));
-	    packet_set(packet, PKT_BACKOFF, remoteticto[i]);
-	    I_SendPacketTo(packet,sizeof *packet,remoteaddr+i);
-	    backoffcounter[i] = 0;
-	    if (verbose) printf("telling client %d to back off\n",i);
-	    free(packet);
-	  }
-	}
-      }
-    }
-  }
-      if (!((ingame ? 0xff : 0xf) & displaycounter++)) { 
-        int i;
-        fprintf(stderr,"Player states: [");
-        for (i=0;i<MAXPLAYERS;i++) {
-            switch (playerstate[i]) {
-                case pc_unused: fputc(' ',stderr); break;
-                case pc_connected: fputc('c',stderr); break;
-                case pc_ready: fputc('r',stderr); break;
-                case pc_confirmedready: fputc('g',stderr); break;
-                case pc_playing: fputc('p',stderr); break;
-                case pc_quit: fputc('x',stderr); break;
-            }
-        }
-        fprintf(stderr,"]\n");
+        pending = s->nextpending;
+        s->pending = false;
+        if (!s->ended)
+          UpdateSession(s);
+        if (s->ended)
+          FreeSession(s);
       }
+
+      if (maxsessions)
+        ReapSessions();
+#ifdef USE_SDL_NET
+      if (upstream)
+        RelayKeepAlive(sessions);
+#endif
     }
   }
 }
@@ -144,6 +144,15 @@ typedef uint64_t uint_64_t;
   #define INLINE inline        /* use standard inline */
 #endif
 
+/* Per-thread renderer state, see r_threads.h */
+#if defined(__cplusplus)
+  #define THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+  #define THREAD_LOCAL __declspec(thread)
+#else
+  #define THREAD_LOCAL __thread
+#endif
+
 /* cph - move compatibility levels here so we can use them in d_server.c */
 typedef enum {
   doom_12_compatibility,   /* Doom v1.2 */
@@ -117,6 +117,8 @@ int key_nextlevel;
 int key_demo_jointogame;
 int key_demo_endlevel;
 int key_demo_skip;
+int key_demo_rewind;
+int key_demo_fastforward;
 int key_walkcamera;
 int key_showalive;
 
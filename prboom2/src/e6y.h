@@ -105,6 +105,8 @@ extern int key_nextlevel;
 extern int key_demo_jointogame;
 extern int key_demo_endlevel;
 extern int key_demo_skip;
+extern int key_demo_rewind;
+extern int key_demo_fastforward;
 extern int key_walkcamera;
 extern int key_showalive;
 
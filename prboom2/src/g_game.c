@@ -79,6 +79,7 @@
 #include "d_deh.h"              // Ty 3/27/98 deh declarations
 #include "p_inter.h"
 #include "g_game.h"
+#include "g_keyframe.h"
 #include "lprintf.h"
 #include "i_main.h"
 #include "i_system.h"
@@ -86,6 +87,7 @@
 #include "r_fps.h"
 #include "e6y.h"//e6y
 #include "statdump.h"
+#include "m_bench.h"
 
 #include "m_io.h"
 
@@ -261,6 +263,7 @@ int     mb_weapon8;
 int     mb_weapon9;
 
 int     key_screenshot;             // killough 2/22/98: screenshot key
+int     key_zoneprofile;            // write the -zoneprofile report
 int     mousebfire;
 int     mousebstrafe;
 int     mousebforward;
@@ -947,7 +950,7 @@ dboolean G_Responder (event_t* ev)
   //
   // killough 11/98: don't autorepeat spy mode switch
 
-  if (ev->data1 == key_spy && netgame && (demoplayback || !deathmatch) &&
+  if (ev->data1 == key_spy && netgame && (demoplayback || spectating || !deathmatch) &&
       gamestate == GS_LEVEL)
     {
       if (ev->type == ev_keyup)
@@ -1146,11 +1149,16 @@ void G_Ticker (void)
           M_ScreenShot ();
           gameaction = ga_nothing;
           break;
+        case ga_seekdemo:
+          G_DoSeekDemo ();
+          break;
         case ga_nothing:
           break;
         }
     }
 
+  G_KeyframeTicker();
+
   if (paused & 2 || (!demoplayback && menuactive && !netgame))
     basetic++;  // For revenant tracers and RNG -- we must maintain sync
   else {
@@ -1274,7 +1282,9 @@ void G_Ticker (void)
   switch (gamestate)
     {
     case GS_LEVEL:
+      BENCH_START(BENCH_TICKER);
       P_Ticker ();
+      BENCH_STOP(BENCH_TICKER);
       P_WalkTicker();
       mlooky = 0;
       AM_Ticker();
@@ -2392,6 +2402,164 @@ void (CheckSaveGame)(size_t size, const char* file, int line)
            savegamesize += (size+1023) & ~1023)) + pos;
 }
 
+/* G_BeginArchive/G_EndArchive
+ *
+ * Point save_p and CheckSaveGame at a caller-owned buffer, so that the
+ * p_saveg.c archivers can be used outside of savegames. The buffer is
+ * grown with realloc() as usual; G_EndArchive hands back the (possibly
+ * moved) buffer and its capacity, restores the savegame buffer and returns
+ * the number of bytes written.
+ */
+static byte   *archive_savebuffer;
+static byte   *archive_save_p;
+static size_t archive_savegamesize;
+
+void G_BeginArchive(byte *buffer, size_t size)
+{
+  archive_savebuffer = savebuffer;
+  archive_save_p = save_p;
+  archive_savegamesize = savegamesize;
+
+  save_p = savebuffer = buffer;
+  savegamesize = buffer ? size : 0;
+}
+
+size_t G_ArchiveOffset(void)
+{
+  return save_p - savebuffer;
+}
+
+size_t G_EndArchive(byte **buffer, size_t *size)
+{
+  size_t length = save_p - savebuffer;
+
+  *buffer = savebuffer;
+  *size = savegamesize;
+
+  savebuffer = archive_savebuffer;
+  save_p = archive_save_p;
+  savegamesize = archive_savegamesize;
+
+  return length;
+}
+
+/* G_ArchiveKeyframe/G_UnArchiveKeyframe
+ *
+ * A keyframe is the playsim part of a savegame plus the demo read position,
+ * used by g_keyframe.c to seek within demo playback. It is written to and
+ * read from the buffer set up with G_BeginArchive.
+ */
+static void G_ArchiveInt(int value)
+{
+  memcpy(save_p, &value, sizeof value);
+  save_p += sizeof value;
+}
+
+static int G_UnArchiveInt(void)
+{
+  int value;
+
+  memcpy(&value, save_p, sizeof value);
+  save_p += sizeof value;
+  return value;
+}
+
+void G_ArchiveKeyframe(void)
+{
+  int i;
+
+  CheckSaveGame(10 * sizeof(int) + MAXPLAYERS + 1);
+  G_ArchiveInt(gametic);
+  G_ArchiveInt(gametic - levelstarttic);
+  G_ArchiveInt(gametic - basetic);
+  G_ArchiveInt(demo_p - demobuffer);
+  G_ArchiveInt(demo_curr_tic);
+  G_ArchiveInt(leveltime);
+  G_ArchiveInt(totalleveltimes);
+  G_ArchiveInt(gameskill);
+  G_ArchiveInt(gameepisode);
+  G_ArchiveInt(gamemap);
+  for (i=0 ; i<MAXPLAYERS ; i++)
+    *save_p++ = playeringame[i];
+  *save_p++ = idmusnum;
+
+  P_ArchivePlayers();
+  P_ThinkerToIndex();
+  P_ArchiveWorld();
+  P_ArchiveThinkers();
+  P_IndexToThinker();
+  P_ArchiveSpecials();
+  P_ArchiveRNG();
+  P_ArchiveMap();
+
+  CheckSaveGame(1);
+  *save_p++ = 0xe6;   // consistancy marker
+}
+
+void G_UnArchiveKeyframe(void)
+{
+  int i, tic, leveltics, basetics, demopos;
+  skill_t skill;
+  int episode, map;
+  dboolean olduser = usergame;
+  int oldautomap = automapmode;
+
+  tic = G_UnArchiveInt();
+  leveltics = G_UnArchiveInt();
+  basetics = G_UnArchiveInt();
+  demopos = G_UnArchiveInt();
+  demo_curr_tic = G_UnArchiveInt();
+  leveltime = G_UnArchiveInt();
+  totalleveltimes = G_UnArchiveInt();
+  skill = G_UnArchiveInt();
+  episode = G_UnArchiveInt();
+  map = G_UnArchiveInt();
+  for (i=0 ; i<MAXPLAYERS ; i++)
+    playeringame[i] = *save_p++;
+  idmusnum = *save_p++;
+  if (idmusnum==255) idmusnum=-1;
+
+  // the tic loop is running, keep it the same number of tics ahead
+  maketic += tic - gametic;
+  gametic = tic;
+
+  // load a base level, G_InitNew would reset the times
+  {
+    int savedleveltime = leveltime;
+    int savedtotal = totalleveltimes;
+
+    G_InitNew(skill, episode, map);
+    leveltime = savedleveltime;
+    totalleveltimes = savedtotal;
+  }
+  usergame = olduser;
+  automapmode = oldautomap;
+  wipegamestate = gamestate;      // seeking is not a level change, no wipe
+
+  levelstarttic = gametic - leveltics;
+  basetic = gametic - basetics;
+  demo_p = demobuffer + demopos;
+
+  P_MapStart();
+  P_UnArchivePlayers();
+  P_UnArchiveWorld();
+  P_UnArchiveThinkers();
+  P_UnArchiveSpecials();
+  P_UnArchiveRNG();
+  P_UnArchiveMap();
+  P_MapEnd();
+  R_ActivateSectorInterpolations();
+  R_SmoothPlaying_Reset(NULL);
+
+  if (musinfo.current_item != -1)
+    S_ChangeMusInfoMusic(musinfo.current_item, true);
+
+  RecalculateDrawnSubsectors();
+
+  if (*save_p != 0xe6)
+    I_Error("G_UnArchiveKeyframe: Bad keyframe");
+}
+
 /* killough 3/22/98: form savegame name in one location
  * (previously code was scattered around in multiple places)
  * cph - Avoid possible buffer overflow problems by passing
@@ -4262,6 +4430,7 @@ void G_DoPlayDemo(void)
 
     demoplayback = true;
     R_SmoothPlaying_Reset(NULL); // e6y
+    G_ClearKeyframes();
   }
   else
   {
@@ -79,6 +79,11 @@ void G_ReadDemoContinueTiccmd (ticcmd_t* cmd);//e6y
 void G_ReadDemoTiccmd(ticcmd_t *cmd);
 void G_WriteDemoTiccmd(ticcmd_t *cmd);
 void G_DoWorldDone(void);
+void G_BeginArchive(byte *buffer, size_t size);
+size_t G_ArchiveOffset(void);
+size_t G_EndArchive(byte **buffer, size_t *size);
+void G_ArchiveKeyframe(void);
+void G_UnArchiveKeyframe(void);
 void G_Compatibility(void);
 const byte *G_ReadOptions(const byte *demo_p);   /* killough 3/1/98 - cph: const byte* */
 byte *G_WriteOptions(byte *demo_p);        // killough 3/1/98
@@ -196,6 +201,7 @@ extern int  key_map_rotate; // cph - map rotation
 extern int  key_map_overlay;// cph - map overlay
 extern int  key_map_textured;  //e6y: textured automap
 extern int  key_screenshot;    // killough 2/22/98 -- add key for screenshot
+extern int  key_zoneprofile;   // write the -zoneprofile report
 extern int  autorun;           // always running?                   // phares
 extern int  mousebfire;
 extern int  mousebstrafe;
@@ -0,0 +1,329 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Demo playback keyframes for seeking and rewinding.
+ *
+ *  Every demo_keyframe_interval seconds of playback the playsim is archived
+ *  with G_ArchiveKeyframe into memory. A seek restores the nearest keyframe
+ *  at or before the target tic and fast forwards the rest with the demo
+ *  skip code from e6y.c, instead of replaying the demo from its start.
+ *
+ *  Consecutive keyframes are mostly identical, so each one is stored as
+ *  the XOR against the previous keyframe, run length encoded on the zero
+ *  bytes. Every KEYFRAME_GROUP keyframes a full one is stored so that a
+ *  restore never has to decode more than one group. When the keyframes
+ *  outgrow demo_keyframe_budget the oldest group is dropped.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomstat.h"
+#include "e6y.h"
+#include "g_game.h"
+#include "g_keyframe.h"
+#include "lprintf.h"
+
+#define KEYFRAME_GROUP 16
+
+int demo_keyframe_interval;
+int demo_keyframe_budget;
+
+typedef struct {
+  int tic;
+  dboolean full;     // not a delta against the previous keyframe
+  size_t rawlength;  // length of the decoded archive
+  size_t length;
+  byte *data;
+} keyframe_t;
+
+static keyframe_t *keyframes;
+static int numkeyframes, maxkeyframes;
+static size_t keyframe_memory;
+static int keyframes_since_full;
+
+// the last keyframe taken, deltas are encoded against it
+static byte *lastframe;
+static size_t lastframesize, lastframelength;
+
+// scratch buffers for taking and restoring keyframes
+static byte *newframe, *encodebuf, *decodebuf[2];
+static size_t newframesize, encodebufsize, decodebufsize[2];
+
+static int seektic;
+
+static void G_GrowBuffer(byte **buffer, size_t *size, size_t needed)
+{
+  if (needed > *size)
+  {
+    *size = needed + needed / 4;
+    *buffer = realloc(*buffer, *size);
+  }
+}
+
+static byte *G_PutCount(byte *p, size_t count)
+{
+  while (count >= 0x80)
+  {
+    *p++ = (byte)(count | 0x80);
+    count >>= 7;
+  }
+  *p++ = (byte)count;
+  return p;
+}
+
+static const byte *G_GetCount(const byte *p, size_t *count)
+{
+  int shift = 0;
+
+  *count = 0;
+  do
+  {
+    *count |= (size_t)(*p & 0x7f) << shift;
+    shift += 7;
+  } while (*p++ & 0x80);
+  return p;
+}
+
+//
+// G_EncodeKeyframe
+// Writes data XOR base as (zero run, literal run, literal bytes) triples.
+// base may be NULL or shorter than data, missing base bytes count as zero.
+// The output needs room for 2 * length + 16 bytes.
+//
+static size_t G_EncodeKeyframe(byte *out, const byte *data, size_t length,
+                               const byte *base, size_t baselength)
+{
+  byte *p = out;
+  size_t i = 0;
+
+  if (!base)
+    baselength = 0;
+
+  while (i < length)
+  {
+    size_t zeros = i, literals;
+
+    while (i < length && data[i] == (i < baselength ? base[i] : 0))
+      i++;
+    zeros = i - zeros;
+
+    // a literal run ends at the first pair of unchanged bytes
+    literals = i;
+    while (i < length &&
+           (data[i] != (i < baselength ? base[i] : 0) ||
+            (i + 1 < length && data[i+1] != (i+1 < baselength ? base[i+1] : 0))))
+      i++;
+    literals = i - literals;
+
+    p = G_PutCount(p, zeros);
+    p = G_PutCount(p, literals);
+    for (; literals; literals--, p++)
+    {
+      size_t j = i - literals;
+      *p = data[j] ^ (j < baselength ? base[j] : 0);
+    }
+  }
+  return p - out;
+}
+
+static void G_DecodeKeyframe(byte *out, const keyframe_t *kf,
+                             const byte *base, size_t baselength)
+{
+  const byte *p = kf->data, *end = kf->data + kf->length;
+  size_t i = 0;
+
+  if (!base)
+    baselength = 0;
+
+  while (p < end)
+  {
+    size_t zeros, literals;
+
+    p = G_GetCount(p, &zeros);
+    p = G_GetCount(p, &literals);
+    for (; zeros; zeros--, i++)
+      out[i] = i < baselength ? base[i] : 0;
+    for (; literals; literals--, i++)
+      out[i] = *p++ ^ (i < baselength ? base[i] : 0);
+  }
+  if (i != kf->rawlength)
+    I_Error("G_DecodeKeyframe: Bad keyframe at tic %d", kf->tic);
+}
+
+static void G_FreeKeyframes(int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    keyframe_memory -= keyframes[i].length;
+    free(keyframes[i].data);
+  }
+  numkeyframes -= count;
+  memmove(keyframes, keyframes + count, numkeyframes * sizeof(*keyframes));
+}
+
+void G_ClearKeyframes(void)
+{
+  G_FreeKeyframes(numkeyframes);
+  keyframes_since_full = 0;
+  lastframelength = 0;
+}
+
+void G_KeyframeTicker(void)
+{
+  keyframe_t *kf;
+  size_t length, budget;
+  byte *swap;
+
+  if (!demoplayback || netgame || gamestate != GS_LEVEL ||
+      demo_keyframe_budget <= 0)
+    return;
+
+  // after seeking backwards keyframes already exist up to the last one
+  if (numkeyframes &&
+      gametic < keyframes[numkeyframes-1].tic + demo_keyframe_interval * TICRATE)
+    return;
+
+  G_BeginArchive(newframe, newframesize);
+  G_ArchiveKeyframe();
+  length = G_EndArchive(&newframe, &newframesize);
+
+  if (numkeyframes == maxkeyframes)
+  {
+    maxkeyframes = maxkeyframes ? maxkeyframes * 2 : 64;
+    keyframes = realloc(keyframes, maxkeyframes * sizeof(*keyframes));
+  }
+  kf = &keyframes[numkeyframes++];
+  kf->tic = gametic;
+  kf->full = !lastframelength || ++keyframes_since_full >= KEYFRAME_GROUP;
+  if (kf->full)
+    keyframes_since_full = 0;
+  kf->rawlength = length;
+
+  G_GrowBuffer(&encodebuf, &encodebufsize, 2 * length + 16);
+  kf->length = G_EncodeKeyframe(encodebuf, newframe, length,
+                                kf->full ? NULL : lastframe, lastframelength);
+  kf->data = malloc(kf->length);
+  memcpy(kf->data, encodebuf, kf->length);
+  keyframe_memory += kf->length;
+
+  swap = lastframe; lastframe = newframe; newframe = swap;
+  length = lastframesize; lastframesize = newframesize; newframesize = length;
+  lastframelength = kf->rawlength;
+
+  // drop the oldest groups that do not fit in the budget, but always keep
+  // the group being built
+  budget = (size_t)demo_keyframe_budget * 1024 * 1024;
+  while (keyframe_memory > budget)
+  {
+    int group = 1;
+
+    while (group < numkeyframes && !keyframes[group].full)
+      group++;
+    if (group == numkeyframes)
+      break;
+    G_FreeKeyframes(group);
+  }
+}
+
+//
+// G_RestoreKeyframe
+// Decodes keyframe n starting from the full keyframe of its group.
+//
+static void G_RestoreKeyframe(int n)
+{
+  int first = n, i, cur = 0;
+
+  while (!keyframes[first].full)
+    first--;
+
+  for (i = first; i <= n; i++)
+  {
+    int next = (i == first ? 0 : !cur);
+
+    G_GrowBuffer(&decodebuf[next], &decodebufsize[next], keyframes[i].rawlength);
+    G_DecodeKeyframe(decodebuf[next], &keyframes[i],
+                     i == first ? NULL : decodebuf[cur],
+                     i == first ? 0 : keyframes[i-1].rawlength);
+    cur = next;
+  }
+
+  G_BeginArchive(decodebuf[cur], decodebufsize[cur]);
+  G_UnArchiveKeyframe();
+  G_EndArchive(&decodebuf[cur], &decodebufsize[cur]);
+}
+
+void G_SeekDemo(int tic)
+{
+  if (!demoplayback || netgame || doSkip || gameaction != ga_nothing)
+    return;
+
+  seektic = MAX(tic, 0);
+  gameaction = ga_seekdemo;
+}
+
+void G_DoSeekDemo(void)
+{
+  int n;
+
+  gameaction = ga_nothing;
+
+  // the last keyframe at or before the target
+  for (n = numkeyframes - 1; n >= 0 && keyframes[n].tic > seektic; n--)
+    ;
+
+  // before the oldest keyframe, go back as far as the keyframes reach
+  if (n < 0 && seektic < gametic)
+  {
+    if (numkeyframes && keyframes[0].tic < gametic)
+    {
+      doom_printf("Rewound to the oldest keyframe");
+      seektic = keyframes[0].tic;
+      n = 0;
+    }
+    else
+    {
+      doom_printf("No keyframe to rewind to");
+      return;
+    }
+  }
+
+  // only restore when it gets closer to the target than playing on
+  if (n >= 0 && (seektic < gametic || keyframes[n].tic > gametic))
+    G_RestoreKeyframe(n);
+
+  if (seektic > gametic)
+  {
+    demo_skiptics = seektic;
+    G_SkipDemoStart();
+  }
+}
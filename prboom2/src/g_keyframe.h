@@ -0,0 +1,61 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Demo playback keyframes for seeking and rewinding.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#ifndef __G_KEYFRAME__
+#define __G_KEYFRAME__
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+/* how far the rewind and fast forward keys seek */
+#define DEMO_SEEK_STEP (10*TICRATE)
+
+extern int demo_keyframe_interval; /* seconds of game time between keyframes */
+extern int demo_keyframe_budget;   /* megabytes, 0 disables keyframes */
+
+/* called every tic from G_Ticker, takes a keyframe when one is due */
+void G_KeyframeTicker(void);
+
+/* drop all keyframes, done whenever a new demo starts */
+void G_ClearKeyframes(void);
+
+/* seek demo playback to the given gametic, forwards or backwards */
+void G_SeekDemo(int tic);
+void G_DoSeekDemo(void);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif
@@ -2982,7 +2982,7 @@ int SetCustomMessage(int plr, const char *msg, int delay, int ticks, int cm, int
   }
   else
   {
-    message_thinker_t *message = Z_Calloc(1, sizeof(*message), PU_LEVEL, NULL);
+    message_thinker_t *message = P_AllocThinker(sizeof(*message));
     message->thinker.function = T_ShowMessage;
     message->delay = delay;
     message->plr = plr;
@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "i_sound.h"
 #include "i_video.h"
 #include "lprintf.h"
@@ -72,6 +73,533 @@ int cap_remove_tempfiles;
 int cap_fps;
 int cap_frac;
 int cap_wipescreen;
+int cap_queue;
+int cap_segment_frames;
+
+
+// Frames are copied out of the grab buffers into a queue per pipe, and a
+// writer thread per pipe feeds them to the encoder. The game only waits
+// when cap_queue frames are already waiting for a pipe.
+
+typedef struct capbuf_s
+{
+  struct capbuf_s *next;
+  unsigned char *data;
+  size_t size;
+  size_t alloc;
+  int width, height;      // of a video frame
+  int segment;            // native sink file it goes in
+} capbuf_t;
+
+typedef struct
+{ // a file written by the native sink
+  FILE *f;
+  int segment;            // number of the file
+  unsigned int bytes;     // bytes of wav samples in it
+  int width, height;      // of the y4m frames in it
+  unsigned char *yuv;     // converted frame
+  size_t yuvsize;
+} capfile_t;
+
+typedef struct capqueue_s
+{
+  pipeinfo_t *pipe;
+  const char *name;
+  void (*write) (struct capqueue_s *q, const capbuf_t *buf);
+  void (*close) (struct capqueue_s *q);
+  capfile_t file;
+  SDL_Thread *thread;
+  SDL_mutex *mutex;
+  SDL_cond *cond;         // signalled whenever the queue changes
+  capbuf_t *head, *tail;  // frames waiting to be written
+  capbuf_t *free;         // buffers that have been written
+  int buffers;            // buffers allocated
+  int done;               // no more frames coming
+} capqueue_t;
+
+static capqueue_t soundqueue;
+static capqueue_t videoqueue;
+
+static int capqueue_writer (void *data)
+{
+  capqueue_t *q = (capqueue_t *) data;
+  capbuf_t *buf;
+
+  SDL_LockMutex (q->mutex);
+  while (1)
+  {
+    while (!q->head && !q->done)
+      SDL_CondWait (q->cond, q->mutex);
+    if (!q->head)
+      break;
+
+    buf = q->head;
+    q->head = buf->next;
+    if (!q->head)
+      q->tail = NULL;
+    SDL_UnlockMutex (q->mutex);
+
+    q->write (q, buf);
+
+    SDL_LockMutex (q->mutex);
+    buf->next = q->free;
+    q->free = buf;
+    SDL_CondSignal (q->cond);
+  }
+  SDL_UnlockMutex (q->mutex);
+  return 1;
+}
+
+static void capqueue_start (capqueue_t *q, pipeinfo_t *p, const char *name,
+                            void (*write) (capqueue_t *q, const capbuf_t *buf),
+                            void (*close) (capqueue_t *q))
+{
+  q->pipe = p;
+  q->name = name;
+  q->write = write;
+  q->close = close;
+  memset (&q->file, 0, sizeof (q->file));
+  q->head = q->tail = q->free = NULL;
+  q->buffers = 0;
+  q->done = 0;
+  q->mutex = SDL_CreateMutex ();
+  q->cond = SDL_CreateCond ();
+  q->thread = SDL_CreateThread (capqueue_writer, name, q);
+}
+
+// copies a frame into the queue, waiting for a buffer if it is full
+static void capqueue_push (capqueue_t *q, const unsigned char *data, size_t size,
+                           int width, int height, int segment)
+{
+  capbuf_t *buf;
+
+  SDL_LockMutex (q->mutex);
+  while (!q->free && q->buffers >= cap_queue)
+    SDL_CondWait (q->cond, q->mutex);
+  if (q->free)
+  {
+    buf = q->free;
+    q->free = buf->next;
+  }
+  else
+  {
+    buf = calloc (1, sizeof (*buf));
+    q->buffers++;
+  }
+  SDL_UnlockMutex (q->mutex);
+
+  if (buf->alloc < size)
+  {
+    buf->alloc = size;
+    buf->data = realloc (buf->data, size);
+  }
+  memcpy (buf->data, data, size);
+  buf->size = size;
+  buf->width = width;
+  buf->height = height;
+  buf->segment = segment;
+  buf->next = NULL;
+
+  SDL_LockMutex (q->mutex);
+  if (q->tail)
+    q->tail->next = buf;
+  else
+    q->head = buf;
+  q->tail = buf;
+  SDL_CondSignal (q->cond);
+  SDL_UnlockMutex (q->mutex);
+}
+
+// writes out what is left and stops the writer
+static void capqueue_finish (capqueue_t *q)
+{
+  int s;
+
+  SDL_LockMutex (q->mutex);
+  q->done = 1;
+  SDL_CondSignal (q->cond);
+  SDL_UnlockMutex (q->mutex);
+  SDL_WaitThread (q->thread, &s);
+
+  if (q->close)
+    q->close (q);
+
+  while (q->free)
+  {
+    capbuf_t *next = q->free->next;
+
+    free (q->free->data);
+    free (q->free);
+    q->free = next;
+  }
+
+  SDL_DestroyCond (q->cond);
+  SDL_DestroyMutex (q->mutex);
+}
+
+static void capqueue_writepipe (capqueue_t *q, const capbuf_t *buf)
+{
+  if (fwrite (buf->data, buf->size, 1, q->pipe->f_stdin) != 1)
+    lprintf(LO_WARN, "I_CaptureFrame: error writing %s.\n", q->name);
+}
+
+// Native sink: when the -viddump file ends in .y4m, frames are converted
+// to YUV 4:2:0 and written straight to <base>.y4m, and the sound to
+// <base>.wav, with no encoder processes. With cap_segment_frames set,
+// a new <base>-NNNN pair is started every that many frames, and one is
+// also started when the resolution changes or the .wav would pass 4 GB.
+
+static int capturing_native;
+static char native_base[PATH_MAX];
+
+// the file pair the last frame went in
+static int native_segment;
+static int native_frames;
+static int native_width, native_height;
+static unsigned int native_wavbytes;
+
+// RIFF sizes are 32 bit
+#define CAP_WAV_MAX (0xffffffffu - 44)
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define CAP_SIMD_X86
+  #define CAP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #define CAP_SIMD_X86
+  #define CAP_TARGET_SSSE3
+#endif
+
+#ifdef CAP_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// BT.601 full range, which the header says with XCOLORRANGE=FULL;
+// C420jpeg only gives the chroma siting
+
+static INLINE unsigned char cap_luma (const unsigned char *p)
+{
+  return (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8;
+}
+
+static INLINE unsigned char cap_chroma (int x)
+{
+  x = (((x >> 7) + 1) >> 1) + 128;
+  return x > 255 ? 255 : x;
+}
+
+static void cap_luma_row (const unsigned char *src, unsigned char *dst, int x, int width)
+{
+  for (; x < width; x++)
+    dst[x] = cap_luma (src + x * 3);
+}
+
+// odd pixels on the right edge are paired with themselves
+static void cap_chroma_row (const unsigned char *src0, const unsigned char *src1,
+                            unsigned char *u, unsigned char *v, int x, int width)
+{
+  for (; x < width; x += 2)
+  {
+    const unsigned char *a = src0 + x * 3;
+    const unsigned char *b = src1 + x * 3;
+    int n = x + 1 < width ? 3 : 0;
+    int r = (a[0] + a[n + 0] + b[0] + b[n + 0] + 2) >> 2;
+    int g = (a[1] + a[n + 1] + b[1] + b[n + 1] + 2) >> 2;
+    int bl = (a[2] + a[n + 2] + b[2] + b[n + 2] + 2) >> 2;
+
+    u[x >> 1] = cap_chroma (128 * bl - 43 * r - 85 * g);
+    v[x >> 1] = cap_chroma (128 * r - 107 * g - 21 * bl);
+  }
+}
+
+#ifdef CAP_SIMD_X86
+
+// splits 16 RGB24 pixels into 16 bytes each of R, G and B
+#define CAP_DEINTERLEAVE(p, r, g, b) \
+  { \
+    const __m128i a0 = _mm_loadu_si128 ((const __m128i *) (p)); \
+    const __m128i a1 = _mm_loadu_si128 ((const __m128i *) (p) + 1); \
+    const __m128i a2 = _mm_loadu_si128 ((const __m128i *) (p) + 2); \
+    r = _mm_or_si128 (_mm_or_si128 ( \
+      _mm_shuffle_epi8 (a0, _mm_setr_epi8 (0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)), \
+      _mm_shuffle_epi8 (a1, _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))), \
+      _mm_shuffle_epi8 (a2, _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13))); \
+    g = _mm_or_si128 (_mm_or_si128 ( \
+      _mm_shuffle_epi8 (a0, _mm_setr_epi8 (1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)), \
+      _mm_shuffle_epi8 (a1, _mm_setr_epi8 (-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))), \
+      _mm_shuffle_epi8 (a2, _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14))); \
+    b = _mm_or_si128 (_mm_or_si128 ( \
+      _mm_shuffle_epi8 (a0, _mm_setr_epi8 (2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)), \
+      _mm_shuffle_epi8 (a1, _mm_setr_epi8 (-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))), \
+      _mm_shuffle_epi8 (a2, _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15))); \
+  }
+
+CAP_TARGET_SSSE3
+static __m128i cap_luma8_SSSE3 (__m128i r, __m128i g, __m128i b)
+{ // 8 pixels in 16 bit lanes; the sum fits unsigned 16 bits
+  __m128i y = _mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (77)),
+                             _mm_mullo_epi16 (g, _mm_set1_epi16 (150)));
+  y = _mm_add_epi16 (y, _mm_mullo_epi16 (b, _mm_set1_epi16 (29)));
+  y = _mm_add_epi16 (y, _mm_set1_epi16 (128));
+  return _mm_srli_epi16 (y, 8);
+}
+
+CAP_TARGET_SSSE3
+static void cap_luma_row_SSSE3 (const unsigned char *src, unsigned char *dst, int x, int width)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  for (; x + 16 <= width; x += 16)
+  {
+    __m128i r, g, b, lo, hi;
+
+    CAP_DEINTERLEAVE (src + x * 3, r, g, b);
+    lo = cap_luma8_SSSE3 (_mm_unpacklo_epi8 (r, zero), _mm_unpacklo_epi8 (g, zero),
+                          _mm_unpacklo_epi8 (b, zero));
+    hi = cap_luma8_SSSE3 (_mm_unpackhi_epi8 (r, zero), _mm_unpackhi_epi8 (g, zero),
+                          _mm_unpackhi_epi8 (b, zero));
+    _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (lo, hi));
+  }
+  cap_luma_row (src, dst, x, width);
+}
+
+CAP_TARGET_SSSE3
+static __m128i cap_average8_SSSE3 (__m128i a, __m128i b)
+{ // 2x2 averages of 16 pixels from each of two rows
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero));
+  __m128i hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero));
+  __m128i s = _mm_add_epi16 (_mm_hadd_epi16 (lo, hi), _mm_set1_epi16 (2));
+  return _mm_srli_epi16 (s, 2);
+}
+
+CAP_TARGET_SSSE3
+static __m128i cap_chroma8_SSSE3 (__m128i x)
+{
+  x = _mm_add_epi16 (_mm_srai_epi16 (x, 7), _mm_set1_epi16 (1));
+  return _mm_add_epi16 (_mm_srai_epi16 (x, 1), _mm_set1_epi16 (128));
+}
+
+CAP_TARGET_SSSE3
+static void cap_chroma_row_SSSE3 (const unsigned char *src0, const unsigned char *src1,
+                                  unsigned char *u, unsigned char *v, int x, int width)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  for (; x + 16 <= width; x += 16)
+  {
+    __m128i r0, g0, b0, r1, g1, b1, r, g, b, cu, cv;
+
+    CAP_DEINTERLEAVE (src0 + x * 3, r0, g0, b0);
+    CAP_DEINTERLEAVE (src1 + x * 3, r1, g1, b1);
+    r = cap_average8_SSSE3 (r0, r1);
+    g = cap_average8_SSSE3 (g0, g1);
+    b = cap_average8_SSSE3 (b0, b1);
+
+    // both stay within +-128*255, so signed 16 bit products are exact
+    cu = _mm_sub_epi16 (_mm_slli_epi16 (b, 7),
+                        _mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (43)),
+                                       _mm_mullo_epi16 (g, _mm_set1_epi16 (85))));
+    cv = _mm_sub_epi16 (_mm_slli_epi16 (r, 7),
+                        _mm_add_epi16 (_mm_mullo_epi16 (g, _mm_set1_epi16 (107)),
+                                       _mm_mullo_epi16 (b, _mm_set1_epi16 (21))));
+    _mm_storel_epi64 ((__m128i *) (u + (x >> 1)), _mm_packus_epi16 (cap_chroma8_SSSE3 (cu), zero));
+    _mm_storel_epi64 ((__m128i *) (v + (x >> 1)), _mm_packus_epi16 (cap_chroma8_SSSE3 (cv), zero));
+  }
+  cap_chroma_row (src0, src1, u, v, x, width);
+}
+
+#endif
+
+static void (*cap_luma_rowfunc) (const unsigned char *, unsigned char *, int, int) = cap_luma_row;
+static void (*cap_chroma_rowfunc) (const unsigned char *, const unsigned char *,
+                                   unsigned char *, unsigned char *, int, int) = cap_chroma_row;
+
+static void cap_rgbtoyuv (const unsigned char *rgb, int width, int height, unsigned char *yuv)
+{
+  int cw = (width + 1) / 2;
+  int ch = (height + 1) / 2;
+  unsigned char *u = yuv + width * height;
+  unsigned char *v = u + cw * ch;
+  int y;
+
+  for (y = 0; y < height; y++)
+    cap_luma_rowfunc (rgb + y * width * 3, yuv + y * width, 0, width);
+
+  // an odd last row is paired with itself
+  for (y = 0; y < height; y += 2)
+    cap_chroma_rowfunc (rgb + y * width * 3, rgb + MIN(y + 1, height - 1) * width * 3,
+                        u + (y >> 1) * cw, v + (y >> 1) * cw, 0, width);
+}
+
+// Picks the segment for the next frame on the game thread, so the video
+// and sound writers split their files at the same frame
+static int capfile_segment (int width, int height, size_t soundbytes)
+{
+  if (native_frames &&
+      ((width && (width != native_width || height != native_height)) ||
+       (cap_segment_frames > 0 && native_frames >= cap_segment_frames) ||
+       soundbytes > CAP_WAV_MAX - native_wavbytes))
+  {
+    native_segment++;
+    native_frames = 0;
+    native_wavbytes = 0;
+  }
+  if (width)
+  {
+    native_width = width;
+    native_height = height;
+  }
+  native_frames++;
+  native_wavbytes += soundbytes;
+  return native_segment;
+}
+
+static FILE *capfile_open (capqueue_t *q, const char *ext, int segment)
+{
+  char name[PATH_MAX];
+
+  // without cap_segment_frames the first pair keeps the plain name
+  if (cap_segment_frames > 0 || segment > 0)
+    snprintf (name, sizeof(name), "%s-%04d.%s", native_base, segment, ext);
+  else
+    snprintf (name, sizeof(name), "%s.%s", native_base, ext);
+  q->file.segment = segment;
+  q->file.bytes = 0;
+
+  q->file.f = M_fopen (name, "wb");
+  if (!q->file.f)
+    lprintf (LO_WARN, "I_CaptureFrame: couldn't open %s\n", name);
+  else
+    lprintf (LO_INFO, "I_CaptureFrame: writing %s\n", name);
+  return q->file.f;
+}
+
+static void capfile_close (capqueue_t *q)
+{
+  if (q->file.f)
+    fclose (q->file.f);
+  q->file.f = NULL;
+}
+
+static void capfile_closey4m (capqueue_t *q)
+{
+  capfile_close (q);
+  free (q->file.yuv);
+  q->file.yuv = NULL;
+  q->file.yuvsize = 0;
+}
+
+static void capfile_writey4m (capqueue_t *q, const capbuf_t *buf)
+{
+  capfile_t *file = &q->file;
+  size_t size = buf->width * buf->height + 2 * ((buf->width + 1) / 2) * ((buf->height + 1) / 2);
+
+  // y4m can't change size mid-stream, capfile_segment starts a new file
+  if (file->f && buf->segment != file->segment)
+    capfile_close (q);
+
+  if (!file->f)
+  {
+    if (!capfile_open (q, "y4m", buf->segment))
+      return;
+    file->width = buf->width;
+    file->height = buf->height;
+    fprintf (file->f, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+             file->width, file->height, cap_fps);
+  }
+
+  if (size > file->yuvsize)
+  {
+    file->yuvsize = size;
+    file->yuv = realloc (file->yuv, size);
+  }
+  cap_rgbtoyuv (buf->data, buf->width, buf->height, file->yuv);
+
+  if (fputs ("FRAME\n", file->f) < 0 || fwrite (file->yuv, size, 1, file->f) != 1)
+    lprintf (LO_WARN, "I_CaptureFrame: error writing %s.\n", q->name);
+}
+
+static void capfile_put32 (unsigned char *p, unsigned int x)
+{
+  p[0] = x;
+  p[1] = x >> 8;
+  p[2] = x >> 16;
+  p[3] = x >> 24;
+}
+
+// 16 bit stereo pcm at snd_samplerate; sizes are filled in on close
+static void capfile_wavheader (FILE *f, unsigned int bytes)
+{
+  unsigned char h[44];
+
+  memcpy (h, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0", 24);
+  capfile_put32 (h + 4, 36 + bytes);
+  capfile_put32 (h + 24, snd_samplerate);
+  capfile_put32 (h + 28, snd_samplerate * 4);
+  memcpy (h + 32, "\x04\0\x10\0data", 8);
+  capfile_put32 (h + 40, bytes);
+  fwrite (h, sizeof(h), 1, f);
+}
+
+static void capfile_closewav (capqueue_t *q)
+{
+  if (q->file.f && !fseek (q->file.f, 0, SEEK_SET))
+    capfile_wavheader (q->file.f, q->file.bytes);
+  capfile_close (q);
+}
+
+static void capfile_writewav (capqueue_t *q, const capbuf_t *buf)
+{
+  capfile_t *file = &q->file;
+
+  if (file->f && buf->segment != file->segment)
+    capfile_closewav (q);
+
+  if (!file->f)
+  {
+    if (!capfile_open (q, "wav", buf->segment))
+      return;
+    capfile_wavheader (file->f, 0);
+  }
+
+#ifdef WORDS_BIGENDIAN
+  {
+    unsigned char *p = buf->data;
+    size_t i;
+
+    for (i = 0; i + 1 < buf->size; i += 2)
+    {
+      unsigned char t = p[i];
+      p[i] = p[i + 1];
+      p[i + 1] = t;
+    }
+  }
+#endif
+
+  if (fwrite (buf->data, buf->size, 1, file->f) != 1)
+    lprintf (LO_WARN, "I_CaptureFrame: error writing %s.\n", q->name);
+  file->bytes += buf->size;
+}
+
+static dboolean I_CaptureNative (const char *fn)
+{
+  size_t len = strlen (fn);
+
+  if (len < 4 || strcasecmp (fn + len - 4, ".y4m"))
+    return false;
+
+  snprintf (native_base, sizeof(native_base), "%.*s", (int) (len - 4), fn);
+  native_segment = native_frames = native_wavbytes = 0;
+
+#ifdef CAP_SIMD_X86
+  if (SDL_HasSSSE3 ())
+  {
+    cap_luma_rowfunc = cap_luma_row_SSSE3;
+    cap_chroma_rowfunc = cap_chroma_row_SSSE3;
+  }
+#endif
+  return true;
+}
 
 // parses a command with simple printf-style replacements.
 
@@ -502,6 +1030,20 @@ void I_CapturePrep (const char *fn)
 {
   vid_fname = fn;
 
+  capturing_native = I_CaptureNative (fn);
+  if (capturing_native)
+  {
+    I_SetSoundCap ();
+    lprintf (LO_INFO, "I_CapturePrep: video capture started\n");
+    capturing_video = 1;
+
+    capqueue_start (&soundqueue, NULL, "wav", capfile_writewav, capfile_closewav);
+    capqueue_start (&videoqueue, NULL, "y4m", capfile_writey4m, capfile_closey4m);
+
+    I_AtExit (I_CaptureFinish, true);
+    return;
+  }
+
   if (!parsecommand (soundpipe.command, cap_soundcommand, sizeof(soundpipe.command)))
   {
     lprintf (LO_ERROR, "I_CapturePrep: malformed command %s\n", cap_soundcommand);
@@ -550,6 +1092,9 @@ void I_CapturePrep (const char *fn)
   videopipe.outthread = SDL_CreateThread (threadstdoutproc, "videopipe.outthread", &videopipe);
   videopipe.errthread = SDL_CreateThread (threadstderrproc, "videopipe.errthread", &videopipe);
 
+  capqueue_start (&soundqueue, &soundpipe, "soundpipe", capqueue_writepipe, NULL);
+  capqueue_start (&videoqueue, &videopipe, "videopipe", capqueue_writepipe, NULL);
+
   I_AtExit (I_CaptureFinish, true);
 }
 
@@ -564,6 +1109,7 @@ void I_CaptureFrame (void)
   unsigned char *vid;
   static int partsof35 = 0; // correct for sync when samplerate % 35 != 0
   int nsampreq;
+  int segment = 0;
 
   if (!capturing_video)
     return;
@@ -577,19 +1123,13 @@ void I_CaptureFrame (void)
   }
 
   snd = I_GrabSound (nsampreq);
-  if (snd)
-  {
-    if (fwrite (snd, nsampreq * 4, 1, soundpipe.f_stdin) != 1)
-      lprintf(LO_WARN, "I_CaptureFrame: error writing soundpipe.\n");
-    //free (snd); // static buffer
-  }
   vid = I_GrabScreen ();
+  if (capturing_native)
+    segment = capfile_segment (vid ? renderW : 0, vid ? renderH : 0, snd ? nsampreq * 4 : 0);
+  if (snd)
+    capqueue_push (&soundqueue, snd, nsampreq * 4, 0, 0, segment); // static buffer, copied
   if (vid)
-  {
-    if (fwrite (vid, renderW * renderH * 3, 1, videopipe.f_stdin) != 1)
-      lprintf(LO_WARN, "I_CaptureFrame: error writing videopipe.\n");
-    //free (vid); // static buffer
-  }
+    capqueue_push (&videoqueue, vid, renderW * renderH * 3, renderW, renderH, segment);
 
 }
 
@@ -603,6 +1143,12 @@ void I_CaptureFinish (void)
     return;
   capturing_video = 0;
 
+  capqueue_finish (&videoqueue);
+  capqueue_finish (&soundqueue);
+
+  if (capturing_native)
+    return;
+
   // on linux, we have to close videopipe first, because it has a copy of the write
   // end of soundpipe_stdin (so that stream will never see EOF).
   // is there a better way to do this?
@@ -49,6 +49,9 @@ extern int cap_remove_tempfiles;
 extern int cap_fps;
 extern int cap_frac;
 extern int cap_wipescreen;
+// frames that may wait for each encoder before the game has to
+extern int cap_queue;
+extern int cap_segment_frames;
 
 // true if we're capturing video
 extern int capturing_video;
@@ -59,13 +59,17 @@ void I_InitNetwork(void);
 size_t I_GetPacket(packet_header_t* buffer, size_t buflen);
 void I_SendPacket(packet_header_t* packet, size_t len);
 void I_WaitForPacket(int ms);
+void I_SetNetSim(const char *spec, dboolean trace);
+dboolean I_NetSimEnabled(void);
 
 #ifdef USE_SDL_NET
 UDP_SOCKET I_Socket(Uint16 port);
 int I_ConnectToServer(const char *serv);
 UDP_CHANNEL I_RegisterPlayer(IPaddress *ipaddr);
 void I_UnRegisterPlayer(UDP_CHANNEL channel);
+void I_SendPacketToAddress(packet_header_t* packet, size_t len, IPaddress *to);
 extern IPaddress sentfrom_addr;
+extern IPaddress serverIP;
 #endif
 
 #ifdef AF_INET
@@ -52,6 +52,7 @@ extern "C" {
 
 extern int snd_pcspeaker;
 extern int lowpass_filter;
+extern int snd_resample;
 
 // Init at program start...
 void I_InitSound(void);
@@ -69,6 +70,9 @@ void I_SetChannels(void);
 // Get raw data lump index for sound descriptor.
 int I_GetSfxLumpNum(sfxinfo_t* sfxinfo);
 
+// Prepares a sound lump so it is ready the first time it plays.
+void I_PrecacheSound(int lump);
+
 // Starts a sound in a particular sound channel.
 int I_StartSound(int id, int channel, int vol, int sep, int pitch, int priority);
 
@@ -136,6 +140,10 @@ void I_StopSong(int handle);
 // See above (register), then think backwards
 void I_UnRegisterSong(int handle);
 
+// -oplbench: renders every D_* lump with the OPL player offline, and
+// reports samples per second for each core and render mode
+void I_OPL_Benchmark(void);
+
 // Allegro card support jff 1/18/98
 extern int snd_card;
 extern int mus_card;
@@ -149,6 +157,10 @@ extern int mus_fluidsynth_chorus;
 extern int mus_fluidsynth_reverb;
 extern int mus_fluidsynth_gain;              // NSM  fine tune fluidsynth output level
 extern int mus_opl_gain;                     // NSM  fine tune OPL output level
+extern int mus_opl_core;                     // OPL emulator: 0 = DBOPL, 1 = DBOPL at half rate
+extern int mus_opl_block;                    // render OPL music in blocks between callbacks
+extern int mus_cache;                        // play synth music from pre-rendered files
+extern int mus_cache_size;                   // megabytes of pre-rendered music kept, 0 = no limit
 extern const char* mus_portmidi_reset_type;  // portmidi reset type
 extern int mus_portmidi_reset_delay;         // portmidi delay after reset
 extern int mus_portmidi_filter_sysex;        // portmidi block sysex from midi files
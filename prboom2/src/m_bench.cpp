@@ -0,0 +1,282 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      -benchmark: per-subsystem frame timings.
+ *
+ *  The playsim, the renderer stages and the blit are timed on the main
+ *  thread and summed over every frame; the sound mixer runs on the audio
+ *  thread and is timed per callback, and screen wipes are timed whole and
+ *  kept out of the frames they end. At exit the samples of every section
+ *  are written out as percentiles, so two builds can be compared by
+ *  running the same -timedemo with each and diffing the results.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "m_bench.h"
+#include "i_system.h"
+#include "lprintf.h"
+#include "m_io.h"
+
+dboolean benchmarking;
+
+namespace {
+
+using bench_clock_t = std::chrono::steady_clock;
+
+constexpr int BENCH_HISTOGRAM_BUCKETS = 24;  // powers of two up to ~8 s
+
+struct bench_info_t {
+  const char* name;
+  const char* unit;
+};
+
+constexpr std::array<bench_info_t, NUMBENCH> bench_info = {{
+  {"frame", "frame"},
+  {"P_Ticker", "frame"},
+  {"R_RenderBSPNode", "frame"},
+  {"R_DrawPlanes", "frame"},
+  {"R_DrawMasked", "frame"},
+  {"I_FinishUpdate", "frame"},
+  {"sound mixer", "callback"},
+  {"screen wipe", "wipe"},
+}};
+
+std::string bench_filename;
+
+// microseconds per frame (or per mixer callback or wipe) of every section
+std::array<std::vector<double>, NUMBENCH> bench_samples;
+
+// Mixer timings on their way from the audio thread, which must not wait
+// on a lock or allocate: it fills the ring up to mixer_head and the main
+// thread empties it up to mixer_tail into bench_samples
+constexpr std::size_t MIXER_RING_SIZE = 4096;
+std::array<double, MIXER_RING_SIZE> mixer_ring;
+std::atomic<std::size_t> mixer_head;
+std::atomic<std::size_t> mixer_tail;
+std::atomic<std::size_t> mixer_dropped;  // found the ring full
+
+// the frame being timed, main thread only
+std::array<double, NUMBENCH> frame_us;
+std::array<bool, NUMBENCH> frame_ran;
+bench_clock_t::time_point frame_start;
+bool frame_started;
+
+thread_local std::array<bench_clock_t::time_point, NUMBENCH> section_start;
+
+auto Microseconds(const bench_clock_t::duration d) -> double {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// nearest-rank percentile of sorted samples
+auto Percentile(const std::vector<double>& sorted, const double p) -> double {
+  if (sorted.empty()) {
+    return 0;
+  }
+
+  const auto rank = static_cast<std::size_t>(std::ceil(p / 100 * sorted.size()));
+  return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+void M_BenchPushMixer(const double us) {
+  const std::size_t head = mixer_head.load(std::memory_order_relaxed);
+
+  if (head - mixer_tail.load(std::memory_order_acquire) == MIXER_RING_SIZE) {
+    mixer_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  mixer_ring[head % MIXER_RING_SIZE] = us;
+  mixer_head.store(head + 1, std::memory_order_release);
+}
+
+void M_BenchDrainMixer() {
+  const std::size_t head = mixer_head.load(std::memory_order_acquire);
+  std::size_t tail = mixer_tail.load(std::memory_order_relaxed);
+
+  for (; tail != head; ++tail) {
+    bench_samples[BENCH_MIXER].push_back(mixer_ring[tail % MIXER_RING_SIZE]);
+  }
+  mixer_tail.store(tail, std::memory_order_release);
+}
+
+struct bench_summary_t {
+  std::size_t count;
+  double total_ms, mean, p50, p95, p99, max;
+  std::array<int, BENCH_HISTOGRAM_BUCKETS> histogram;  // [2^(i-1), 2^i) us
+};
+
+auto Summarize(std::vector<double> samples) -> bench_summary_t {
+  bench_summary_t s{};
+
+  std::sort(samples.begin(), samples.end());
+
+  s.count = samples.size();
+  for (const double us : samples) {
+    int bucket = 0;
+
+    while (bucket < BENCH_HISTOGRAM_BUCKETS - 1 && us >= static_cast<double>(1 << bucket)) {
+      ++bucket;
+    }
+    ++s.histogram[bucket];
+    s.total_ms += us / 1000;
+  }
+
+  if (s.count) {
+    s.mean = s.total_ms * 1000 / s.count;
+    s.p50 = Percentile(samples, 50);
+    s.p95 = Percentile(samples, 95);
+    s.p99 = Percentile(samples, 99);
+    s.max = samples.back();
+  }
+
+  return s;
+}
+
+void M_WriteBenchmark() {
+  const bool json = bench_filename.size() >= 5 &&
+                    bench_filename.compare(bench_filename.size() - 5, 5, ".json") == 0;
+  std::FILE* const out = M_fopen(bench_filename.c_str(), "w");
+
+  if (out == nullptr) {
+    lprintf(LO_WARN, "M_WriteBenchmark: could not write %s\n", bench_filename.c_str());
+    return;
+  }
+
+  M_BenchDrainMixer();
+  if (mixer_dropped.load(std::memory_order_relaxed)) {
+    lprintf(LO_WARN, "M_WriteBenchmark: %zu mixer timings lost\n", mixer_dropped.load(std::memory_order_relaxed));
+  }
+
+  if (json) {
+    std::fprintf(out, "[\n");
+  } else {
+    std::fprintf(out, "section,unit,samples,total_ms,mean_us,p50_us,p95_us,p99_us,max_us\n");
+  }
+
+  for (int i = 0; i < NUMBENCH; ++i) {
+    const auto s = Summarize(bench_samples[i]);
+
+    if (json) {
+      std::fprintf(out,
+                   "  {\"section\": \"%s\", \"unit\": \"%s\", \"samples\": %zu, \"total_ms\": %.3f, "
+                   "\"mean_us\": %.1f, \"p50_us\": %.1f, \"p95_us\": %.1f, \"p99_us\": %.1f, "
+                   "\"max_us\": %.1f, \"histogram_us\": [",
+                   bench_info[i].name, bench_info[i].unit, s.count, s.total_ms,
+                   s.mean, s.p50, s.p95, s.p99, s.max);
+      for (int b = 0; b < BENCH_HISTOGRAM_BUCKETS; ++b) {
+        std::fprintf(out, "%s%d", b ? ", " : "", s.histogram[b]);
+      }
+      std::fprintf(out, "]}%s\n", (i + 1 < NUMBENCH) ? "," : "");
+    } else {
+      std::fprintf(out, "\"%s\",%s,%zu,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                   bench_info[i].name, bench_info[i].unit, s.count, s.total_ms,
+                   s.mean, s.p50, s.p95, s.p99, s.max);
+    }
+  }
+
+  if (json) {
+    std::fprintf(out, "]\n");
+  }
+
+  std::fclose(out);
+  lprintf(LO_INFO, "M_WriteBenchmark: timings written to %s\n", bench_filename.c_str());
+}
+
+}  // namespace
+
+void M_BeginBenchmark(const char* const filename) {
+  bench_filename = filename;
+  benchmarking = true;
+  I_AtExit(M_WriteBenchmark, true);
+}
+
+void M_BenchStart(const bench_section_t section) {
+  section_start[section] = bench_clock_t::now();
+}
+
+void M_BenchStop(const bench_section_t section) {
+  const double us = Microseconds(bench_clock_t::now() - section_start[section]);
+
+  if (section == BENCH_MIXER) {
+    M_BenchPushMixer(us);
+    return;
+  }
+  if (section == BENCH_WIPE) {
+    bench_samples[section].push_back(us);
+    return;
+  }
+
+  frame_us[section] += us;
+  frame_ran[section] = true;
+}
+
+void M_BenchFrame(void) {
+  const auto now = bench_clock_t::now();
+
+  if (frame_started) {
+    frame_us[BENCH_FRAME] = Microseconds(now - frame_start);
+    frame_ran[BENCH_FRAME] = true;
+  }
+  frame_start = now;
+  frame_started = true;
+
+  for (int i = 0; i < NUMBENCH; ++i) {
+    if (frame_ran[i]) {
+      bench_samples[i].push_back(frame_us[i]);
+    }
+  }
+
+  frame_us.fill(0);
+  frame_ran.fill(false);
+
+  M_BenchDrainMixer();
+}
+
+void M_BenchSkipFrame(void) {
+  frame_start = bench_clock_t::now();
+  frame_started = true;
+
+  frame_us.fill(0);
+  frame_ran.fill(false);
+
+  M_BenchDrainMixer();
+}
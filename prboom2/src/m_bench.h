@@ -0,0 +1,80 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      -benchmark: per-subsystem frame timings.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#ifndef __M_BENCH__
+#define __M_BENCH__
+
+#include "doomtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+typedef enum {
+  BENCH_FRAME,    // one frame to the next
+  BENCH_TICKER,   // P_Ticker
+  BENCH_BSP,      // R_RenderBSPNode
+  BENCH_PLANES,   // R_DrawPlanes
+  BENCH_MASKED,   // R_DrawMasked
+  BENCH_BLIT,     // I_FinishUpdate
+  BENCH_MIXER,    // one sound mixer callback
+  BENCH_WIPE,     // one screen wipe
+  NUMBENCH
+} bench_section_t;
+
+extern dboolean benchmarking;
+
+/* Starts collecting timings, written to filename at exit: JSON if it ends
+ * in .json, CSV otherwise */
+void M_BeginBenchmark(const char *filename);
+
+/* Times a section. Sections on the main thread add up over a frame, the
+ * mixer runs on the audio thread and is timed per callback, and a wipe
+ * is timed whole */
+void M_BenchStart(bench_section_t section);
+void M_BenchStop(bench_section_t section);
+
+/* Closes the frame on the main thread */
+void M_BenchFrame(void);
+
+/* Drops the frame on the main thread, for one that ended in a wipe */
+void M_BenchSkipFrame(void);
+
+#define BENCH_START(section) do { if (benchmarking) M_BenchStart(section); } while (0)
+#define BENCH_STOP(section) do { if (benchmarking) M_BenchStop(section); } while (0)
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif
@@ -52,6 +52,7 @@
 #include "hu_stuff.h"
 #include "st_stuff.h"
 #include "g_game.h"
+#include "g_keyframe.h"
 #include "s_sound.h"
 #include "sounds.h"
 #include "m_menu.h"
@@ -2609,11 +2610,13 @@ setup_menu_t keys_settings6[] =  // Key Binding screen strings
   {"END LEVEL"            ,S_KEY     ,m_scrn,KB_X,KB_Y+ 7*8,{&key_demo_endlevel}},
   {"CAMERA MODE"          ,S_KEY     ,m_scrn,KB_X,KB_Y+ 8*8,{&key_walkcamera}},
   {"JOIN"                 ,S_KEY     ,m_scrn,KB_X,KB_Y+ 9*8,{&key_demo_jointogame}},
-  {"MISC"                 ,S_SKIP|S_TITLE,m_null,KB_X,KB_Y+10*8},
-  {"RESTART LEVEL/DEMO"   ,S_KEY     ,m_scrn,KB_X,KB_Y+ 11*8,{&key_level_restart}},
-  {"NEXT LEVEL"           ,S_KEY     ,m_scrn,KB_X,KB_Y+ 12*8,{&key_nextlevel}},
+  {"REWIND"               ,S_KEY     ,m_scrn,KB_X,KB_Y+10*8,{&key_demo_rewind}},
+  {"FAST FORWARD"         ,S_KEY     ,m_scrn,KB_X,KB_Y+11*8,{&key_demo_fastforward}},
+  {"MISC"                 ,S_SKIP|S_TITLE,m_null,KB_X,KB_Y+12*8},
+  {"RESTART LEVEL/DEMO"   ,S_KEY     ,m_scrn,KB_X,KB_Y+ 13*8,{&key_level_restart}},
+  {"NEXT LEVEL"           ,S_KEY     ,m_scrn,KB_X,KB_Y+ 14*8,{&key_nextlevel}},
 #ifdef GL_DOOM
-  {"Show Alive Monsters"  ,S_KEY     ,m_scrn,KB_X,KB_Y+13*8,{&key_showalive}},
+  {"Show Alive Monsters"  ,S_KEY     ,m_scrn,KB_X,KB_Y+15*8,{&key_showalive}},
 #endif
 
   {"<- PREV",S_SKIP|S_PREV,m_null,KB_PREV,KB_Y+20*8, {keys_settings5}},
@@ -4793,6 +4796,9 @@ dboolean M_Responder (event_t* ev) {
     // Don't eat the keypress in this case. See sf bug #1843280.
     }
 
+  if (key_zoneprofile && ch == key_zoneprofile)
+    Z_ProfileDump();
+
   // If there is no active menu displayed...
 
   if (!menuactive) {                                           // phares
@@ -4977,6 +4983,16 @@ dboolean M_Responder (event_t* ev) {
       }
     }
 
+    if (ch == key_demo_rewind || ch == key_demo_fastforward)
+    {
+      if (demoplayback && !doSkip && singledemo)
+      {
+        G_SeekDemo(ch == key_demo_rewind ?
+                   gametic - DEMO_SEEK_STEP : gametic + DEMO_SEEK_STEP);
+        return true;
+      }
+    }
+
     if (ch == key_demo_skip)
     {
       if (demoplayback && singledemo)
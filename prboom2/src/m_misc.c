@@ -51,6 +51,7 @@
 #include "doomstat.h"
 #include "m_argv.h"
 #include "g_game.h"
+#include "g_keyframe.h"
 #include "m_menu.h"
 #include "am_map.h"
 #include "w_wad.h"
@@ -73,6 +74,7 @@
 #include "r_fps.h"
 #include "r_main.h"
 #include "r_things.h"
+#include "r_threads.h"
 #include "r_sky.h"
 
 //e6y
@@ -451,12 +453,18 @@ default_t defaults[] =
   {"snd_mididev",{NULL, &snd_mididev},{0,""},UL,UL,def_str,ss_none}, // midi device to use for portmidiplayer and alsaplayer
   {"lowpass_filter",{&lowpass_filter},{0},0,1,
   def_bool,ss_none}, // low-pass filter borrowed from Chocolate Doom so upscaling old audio doesn't sound too horrible
+  {"snd_resample",{&snd_resample},{1},0,2,
+  def_int,ss_none}, // resample sounds once when first played: 0 = no, 1 = linear, 2 = windowed sinc
   {"full_sounds",{&full_sounds},{0},0,1,def_bool,ss_none}, // disable sound cutoffs
 
   {"mus_fluidsynth_chorus",{&mus_fluidsynth_chorus},{0},0,1,def_bool,ss_none},
   {"mus_fluidsynth_reverb",{&mus_fluidsynth_reverb},{0},0,1,def_bool,ss_none},
   {"mus_fluidsynth_gain",{&mus_fluidsynth_gain},{50},0,1000,def_int,ss_none}, // NSM  fine tune fluidsynth output level
   {"mus_opl_gain",{&mus_opl_gain},{50},0,1000,def_int,ss_none}, // NSM  fine tune opl output level
+  {"mus_opl_core",{&mus_opl_core},{0},0,1,def_int,ss_none}, // opl emulator: 0 = dbopl, 1 = dbopl at half the sample rate (faster)
+  {"mus_opl_block",{&mus_opl_block},{0},0,1,def_bool,ss_none}, // render opl music in blocks, applying register writes at 140 Hz like DMX
+  {"mus_cache",{&mus_cache},{0},0,1,def_bool,ss_none}, // render opl2/fluidsynth music once in the background and play it from musiccache/ after
+  {"mus_cache_size",{&mus_cache_size},{512},0,65536,def_int,ss_none}, // megabytes musiccache/ may use before the least recently played songs are removed, 0 = no limit
   {"mus_portmidi_reset_type",{NULL, &mus_portmidi_reset_type},{0,"gm"},UL,UL,def_str,ss_none}, // portmidi reset type (none, gs, gm, gm2, xg)
   {"mus_portmidi_reset_delay",{&mus_portmidi_reset_delay},{0},0,2000,def_int,ss_none}, // portmidi delay after reset (milliseconds)
   {"mus_portmidi_filter_sysex",{&mus_portmidi_filter_sysex},{1},0,1,def_bool,ss_none}, // portmidi block sysex from midi files
@@ -772,6 +780,8 @@ default_t defaults[] =
   // killough 2/22/98: screenshot key
   {"key_screenshot",  {&key_screenshot},      {'*'}            ,
    0,MAX_KEY,def_key,ss_keys}, // key to take a screenshot
+  {"key_zoneprofile", {&key_zoneprofile},     {0}              ,
+   0,MAX_KEY,def_key,ss_keys}, // key to write the -zoneprofile report
 
   {"Joystick settings",{NULL},{0},UL,UL,def_none,ss_none},
   {"use_joystick",{&usejoystick},{0},0,2,
@@ -975,6 +985,10 @@ default_t defaults[] =
    0,MAX_KEY,def_key,ss_keys},
   {"key_demo_endlevel", {&key_demo_endlevel}, {KEYD_END},
    0,MAX_KEY,def_key,ss_keys},
+  {"key_demo_rewind", {&key_demo_rewind}, {'['},
+   0,MAX_KEY,def_key,ss_keys},
+  {"key_demo_fastforward", {&key_demo_fastforward}, {']'},
+   0,MAX_KEY,def_key,ss_keys},
   {"key_walkcamera", {&key_walkcamera}, {KEYD_KEYPAD0},
    0,MAX_KEY,def_key,ss_keys},
   {"key_showalive", {&key_showalive}, {KEYD_KEYPADDIVIDE},
@@ -1032,6 +1046,10 @@ default_t defaults[] =
    def_bool,ss_stat},
   {"quickstart_window_ms", {&quickstart_window_ms},  {0},0,1000,
    def_int,ss_stat},
+  {"demo_keyframe_interval", {&demo_keyframe_interval},  {5},1,600,
+   def_int,ss_none}, // seconds of playback between seek keyframes
+  {"demo_keyframe_budget", {&demo_keyframe_budget},  {64},0,4096,
+   def_int,ss_none}, // megabytes kept for seek keyframes, 0 disables them
 
   {"Prboom-plus game settings",{NULL},{0},UL,UL,def_none,ss_none},
   {"movement_strafe50", {&movement_strafe50},  {0},0,1,
@@ -1067,6 +1085,8 @@ default_t defaults[] =
   {"cap_remove_tempfiles", {&cap_remove_tempfiles},{1},0,1,def_bool,ss_none},
   {"cap_fps", {&cap_fps},{60},16,300,def_int,ss_none},
   {"cap_wipescreen", {&cap_wipescreen},{0},0,1,def_bool,ss_none},
+  {"cap_queue", {&cap_queue},{8},1,64,def_int,ss_none},
+  {"cap_segment_frames", {&cap_segment_frames},{0},0,1000000,def_int,ss_none},
 
   {"Prboom-plus video settings",{NULL},{0},UL,UL,def_none,ss_none},
   {"sdl_video_window_pos", {NULL,&sdl_video_window_pos}, {0,"center"},UL,UL,
@@ -1089,6 +1109,10 @@ default_t defaults[] =
    def_bool,ss_stat},
   {"fake_contrast", {&fake_contrast},  {1},0,1,
    def_bool,ss_stat}, /* cph - allow crappy fake contrast to be disabled */
+  {"render_threads", {&render_threads},  {1},0,MAX_RENDER_THREADS,
+   def_int,ss_none}, /* 0 = one per CPU core */
+  {"render_simd", {&render_simd},  {1},0,2,
+   def_int,ss_none}, /* 1 = SSE2 columns, 2 = also AVX2 spans */
   {"render_stretch_hud", {&render_stretch_hud_default},{patch_stretch_16x10},0,patch_stretch_max - 1,
   def_int,ss_stat},
   {"render_patches_scalex", {&render_patches_scalex},{0},0,16,
@@ -1099,6 +1123,8 @@ default_t defaults[] =
    def_bool,ss_none},
   {"sprites_doom_order", {&sprites_doom_order}, {DOOM_ORDER_STATIC},0,DOOM_ORDER_LAST - 1,
    def_int,ss_stat},
+  {"sprites_radix_sort", {&sprites_radix_sort}, {1},0,1,
+   def_bool,ss_none}, /* 0 = merge sort with the exact order of older versions */
 
   {"movement_mouselook", {&movement_mouselook},  {0},0,1,
    def_bool,ss_stat},
@@ -5,9 +5,12 @@
 #include "i_system.h" /* I_AtExit() */
 
 #include "p_checksum.h"
-#include "md5.h"
 #include "doomstat.h" /* players{,ingame} */
 #include "lprintf.h"
+#include "m_random.h"
+#include "p_tick.h"
+#include "p_spec.h"
+#include "r_state.h"
 
 #include "m_io.h"
 
@@ -19,12 +22,48 @@ void checksum_gamestate(int tic);
 static void p_checksum_nop(int tic){} /* do nothing */
 void (*P_Checksum)(int) = p_checksum_nop;
 
+checksum_level_t checksum_level = CHECKSUM_THINKERS;
+
+/*
+ * Incremental 64-bit hash
+ *
+ * cph's original implementation MD5'd snprintf'd player health. That is far
+ * too slow to cover the whole gamestate every tic, so the state is fed one
+ * 32-bit word at a time through an xxHash64-style round instead.
+ */
+#define HASH_PRIME1 LONGLONG(0x9E3779B185EBCA87)
+#define HASH_PRIME2 LONGLONG(0xC2B2AE3D27D4EB4F)
+#define HASH_PRIME3 LONGLONG(0x165667B19E3779F9)
+#define HASH_PRIME4 LONGLONG(0x85EBCA77C2B2AE63)
+#define HASH_PRIME5 LONGLONG(0x27D4EB2F165667C5)
+
+#define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint_64_t hash_global;
+
+static inline uint_64_t checksum_word(uint_64_t h, uint32_t word)
+{
+  h ^= (uint_64_t)word * HASH_PRIME1;
+  return HASH_ROTL(h, 23) * HASH_PRIME2 + HASH_PRIME3;
+}
+
+static inline uint_64_t checksum_final(uint_64_t h)
+{
+  h ^= h >> 33;
+  h *= HASH_PRIME2;
+  h ^= h >> 29;
+  h *= HASH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+#define HASH(h, v) ((h) = checksum_word((h), (uint32_t)(v)))
+
 /*
  * P_RecordChecksum
  * sets up the file and function pointers to write out checksum data
  */
 static FILE *outfile = NULL;
-static struct MD5Context md5global;
 
 void P_RecordChecksum(const char *file) {
     size_t fnsize;
@@ -43,24 +82,18 @@ void P_RecordChecksum(const char *file) {
         I_AtExit(p_checksum_cleanup, true);
     }
 
-    MD5Init(&md5global);
+    hash_global = HASH_PRIME5;
 
     P_Checksum = checksum_gamestate;
 }
 
 void P_ChecksumFinal(void) {
-    int i;
-    unsigned char digest[16];
-
     if (!outfile)
       return;
 
-    MD5Final(digest, &md5global);
-    fprintf(outfile, "final: ");
-    for (i=0; i<16; i++)
-        fprintf(outfile,"%x", digest[i]);
-    fprintf(outfile, "\n");
-    MD5Init(&md5global);
+    fprintf(outfile, "final: %016llx\n",
+            (unsigned long long)checksum_final(hash_global));
+    hash_global = HASH_PRIME5;
 }
 
 static void p_checksum_cleanup(void) {
@@ -68,32 +101,116 @@ static void p_checksum_cleanup(void) {
         fclose(outfile);
 }
 
+/*
+ * checksum_thinkerclass
+ * Thinker functions are not stable across builds, so hash a class number
+ * instead of the pointer (same classification as P_ArchiveSpecials)
+ */
+static int checksum_thinkerclass(const thinker_t *th)
+{
+  think_t f = th->function;
+
+  return
+    f == P_MobjThinker   ? 1  :
+    f == T_MoveCeiling   ? 2  :
+    f == T_VerticalDoor  ? 3  :
+    f == T_MoveFloor     ? 4  :
+    f == T_PlatRaise     ? 5  :
+    f == T_LightFlash    ? 6  :
+    f == T_StrobeFlash   ? 7  :
+    f == T_Glow          ? 8  :
+    f == T_MoveElevator  ? 9  :
+    f == T_Scroll        ? 10 :
+    f == T_Pusher        ? 11 :
+    f == T_FireFlicker   ? 12 :
+    f == T_Friction      ? 13 :
+    f == NULL            ? 0  : 14;
+}
+
+static uint_64_t checksum_mobj(uint_64_t h, const mobj_t *mo)
+{
+  HASH(h, mo->type);
+  HASH(h, mo->x);
+  HASH(h, mo->y);
+  HASH(h, mo->z);
+  HASH(h, mo->momx);
+  HASH(h, mo->momy);
+  HASH(h, mo->momz);
+  HASH(h, mo->angle);
+  HASH(h, mo->floorz);
+  HASH(h, mo->ceilingz);
+  HASH(h, mo->health);
+  HASH(h, mo->tics);
+  HASH(h, mo->state ? mo->state - states : -1);
+  HASH(h, mo->flags);
+  HASH(h, mo->flags >> 32);
+  HASH(h, mo->movedir);
+  HASH(h, mo->movecount);
+  HASH(h, mo->reactiontime);
+  HASH(h, mo->threshold);
+  HASH(h, mo->target ? mo->target->type : -1);
+  HASH(h, mo->tracer ? mo->tracer->type : -1);
+  return h;
+}
+
 /*
  * runs on each tic when recording checksums
  */
 void checksum_gamestate(int tic) {
     int i;
-    struct MD5Context md5ctx;
-    unsigned char digest[16];
-    char buffer[2048];
-
-    fprintf(outfile,"%6d, ", tic);
+    uint_64_t h = HASH_PRIME5;
 
     /* based on "ArchivePlayers" */
-    MD5Init(&md5ctx);
     for (i=0 ; i<MAXPLAYERS ; i++) {
+        const player_t *player = &players[i];
+
         if (!playeringame[i]) continue;
 
-        doom_snprintf (buffer, sizeof(buffer), "%d", players[i].health);
-        buffer[sizeof(buffer)-1] = 0;
+        HASH(h, i);
+        HASH(h, player->health);
+        HASH(h, player->armorpoints);
+        HASH(h, player->readyweapon);
+        if (player->mo) {
+            HASH(h, player->mo->x);
+            HASH(h, player->mo->y);
+            HASH(h, player->mo->z);
+            HASH(h, player->mo->angle);
+        }
+    }
 
-        MD5Update(&md5ctx, (md5byte const *)&buffer, strlen(buffer));
+    if (checksum_level >= CHECKSUM_RNG) {
+        for (i=0 ; i<NUMPRCLASS ; i++)
+            HASH(h, rng.seed[i]);
+        HASH(h, rng.rndindex);
+        HASH(h, rng.prndindex);
     }
-    MD5Final(digest, &md5ctx);
-    for (i=0; i<16; i++) {
-        MD5Update(&md5global, (md5byte const *)&digest[i], sizeof(digest[i]));
-        fprintf(outfile,"%x", digest[i]);
+
+    if (checksum_level >= CHECKSUM_SECTORS) {
+        const sector_t *sec = sectors;
+
+        for (i=0 ; i<numsectors ; i++, sec++) {
+            HASH(h, sec->floorheight);
+            HASH(h, sec->ceilingheight);
+            HASH(h, sec->lightlevel);
+            HASH(h, sec->special);
+            HASH(h, sec->floorpic | (sec->ceilingpic << 16));
+        }
     }
 
-    fprintf(outfile,"\n");
+    if (checksum_level >= CHECKSUM_MOBJS) {
+        thinker_t *th;
+
+        for (th = thinkercap.next ; th != &thinkercap ; th = th->next) {
+            if (th->function == P_MobjThinker)
+                h = checksum_mobj(h, (mobj_t *)th);
+            else if (checksum_level >= CHECKSUM_THINKERS)
+                HASH(h, checksum_thinkerclass(th));
+        }
+    }
+
+    h = checksum_final(h);
+    HASH(hash_global, h);
+    HASH(hash_global, h >> 32);
+
+    fprintf(outfile, "%6d, %016llx\n", tic, (unsigned long long)h);
 }
@@ -2,6 +2,18 @@
 extern "C" {
 #endif  // __cplusplus
 
+/* Granularity of the per-tic gamestate hash; each level includes the ones
+ * before it */
+typedef enum {
+  CHECKSUM_PLAYERS = 1, /* player health, armor, weapon and position */
+  CHECKSUM_RNG,         /* + random number generator state */
+  CHECKSUM_SECTORS,     /* + sector heights, light, specials and flats */
+  CHECKSUM_MOBJS,       /* + every mobj's position, momentum, state, etc */
+  CHECKSUM_THINKERS,    /* + the class of every other thinker */
+} checksum_level_t;
+
+extern checksum_level_t checksum_level;
+
 extern void (*P_Checksum)(int);
 extern void P_ChecksumFinal(void);
 void P_RecordChecksum(const char* file);
@@ -0,0 +1,487 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Per-tic gamestate snapshots for locating demo desyncs.
+ *
+ *  -desyncrecord runs the savegame archivers (P_ArchiveRNG, P_ArchiveWorld
+ *  and P_ArchiveThinkers) after every tic and writes a compacted copy of
+ *  their output to a file. -desynccheck rebuilds the same snapshot on a
+ *  later run and stops at the first tic that differs, naming the mobjs,
+ *  sectors and fields involved.
+ *
+ *  Archived mobjs still hold raw pointers (block and sector links, info,
+ *  ...) that differ from run to run, so only the fields listed in
+ *  mobj_fields[] are kept. target, tracer, lastenemy, state and player are
+ *  already turned into indices by P_ArchiveThinkers.
+ *
+ *  The file is written in host byte order; it is meant to be compared on
+ *  the machine that recorded it.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include <errno.h>
+
+#include "doomstat.h"
+#include "g_game.h"
+#include "i_system.h"
+#include "lprintf.h"
+#include "m_io.h"
+#include "m_random.h"
+#include "p_desync.h"
+#include "p_enemy.h"
+#include "p_saveg.h"
+#include "p_tick.h"
+#include "r_state.h"
+
+static void p_desync_nop(int tic) {}
+void (*P_DesyncSnapshot)(int) = p_desync_nop;
+
+typedef struct {
+  const char *name;
+  size_t offset;
+  size_t size;
+} desync_field_t;
+
+#define MOBJ_FIELD(f) { #f, offsetof(mobj_t, f), sizeof(((mobj_t *)0)->f) }
+
+static const desync_field_t mobj_fields[] = {
+  MOBJ_FIELD(type),
+  MOBJ_FIELD(x),
+  MOBJ_FIELD(y),
+  MOBJ_FIELD(z),
+  MOBJ_FIELD(angle),
+  MOBJ_FIELD(sprite),
+  MOBJ_FIELD(frame),
+  MOBJ_FIELD(floorz),
+  MOBJ_FIELD(ceilingz),
+  MOBJ_FIELD(dropoffz),
+  MOBJ_FIELD(radius),
+  MOBJ_FIELD(height),
+  MOBJ_FIELD(momx),
+  MOBJ_FIELD(momy),
+  MOBJ_FIELD(momz),
+  MOBJ_FIELD(tics),
+  MOBJ_FIELD(state),
+  MOBJ_FIELD(flags),
+  MOBJ_FIELD(intflags),
+  MOBJ_FIELD(health),
+  MOBJ_FIELD(movedir),
+  MOBJ_FIELD(movecount),
+  MOBJ_FIELD(strafecount),
+  MOBJ_FIELD(target),
+  MOBJ_FIELD(reactiontime),
+  MOBJ_FIELD(threshold),
+  MOBJ_FIELD(pursuecount),
+  MOBJ_FIELD(gear),
+  MOBJ_FIELD(player),
+  MOBJ_FIELD(lastlook),
+  MOBJ_FIELD(tracer),
+  MOBJ_FIELD(lastenemy),
+  MOBJ_FIELD(friction),
+  MOBJ_FIELD(movefactor),
+};
+
+#define NUM_MOBJ_FIELDS (sizeof(mobj_fields) / sizeof(mobj_fields[0]))
+
+/* Layout of one sector in P_ArchiveWorld */
+static const desync_field_t sector_fields[] = {
+  { "floorheight",   0, sizeof(fixed_t) },
+  { "ceilingheight", 4, sizeof(fixed_t) },
+  { "floorpic",      8, sizeof(short) },
+  { "ceilingpic",   10, sizeof(short) },
+  { "lightlevel",   12, sizeof(short) },
+  { "special",      14, sizeof(short) },
+  { "tag",          16, sizeof(short) },
+};
+
+#define NUM_SECTOR_FIELDS (sizeof(sector_fields) / sizeof(sector_fields[0]))
+#define SECTOR_RECORD_SIZE 18
+
+typedef struct {
+  int tic;
+  int episode, map;
+  int rnglen;         /* P_ArchiveRNG */
+  int worldlen;       /* P_ArchiveWorld */
+  int brainlen;       /* boss brain state from P_ArchiveThinkers */
+  int nummobjs;       /* mobj records, mobj_record_size bytes each */
+  int soundtargetlen; /* sector soundtargets from P_ArchiveThinkers */
+} desync_header_t;
+
+typedef struct {
+  desync_header_t header;
+  byte *data;
+  size_t size, maxsize;
+} desync_snapshot_t;
+
+static FILE *desyncfile;
+
+static byte *archive;
+static size_t archivesize;
+static size_t mobj_record_size;
+
+static desync_snapshot_t current;
+static desync_snapshot_t reference;
+
+static void P_SnapshotReserve(desync_snapshot_t *snap, size_t size)
+{
+  if (snap->size + size > snap->maxsize)
+  {
+    snap->maxsize = (snap->size + size) * 2;
+    snap->data = realloc(snap->data, snap->maxsize);
+  }
+}
+
+static void P_SnapshotAppend(desync_snapshot_t *snap, const void *data, size_t size)
+{
+  P_SnapshotReserve(snap, size);
+  memcpy(snap->data + snap->size, data, size);
+  snap->size += size;
+}
+
+//
+// P_BuildSnapshot
+// Runs the savegame archivers and keeps the deterministic part of the output
+//
+static void P_BuildSnapshot(desync_snapshot_t *snap, int tic)
+{
+  size_t rngend, worldend, pos, length;
+  int i;
+
+  G_BeginArchive(archive, archivesize);
+  P_ArchiveRNG();
+  rngend = G_ArchiveOffset();
+  P_ArchiveWorld();
+  worldend = G_ArchiveOffset();
+  P_ThinkerToIndex();
+  P_ArchiveThinkers();
+  P_IndexToThinker();
+  length = G_EndArchive(&archive, &archivesize);
+
+  snap->size = 0;
+  snap->header.tic = tic;
+  snap->header.episode = gameepisode;
+  snap->header.map = gamemap;
+  snap->header.rnglen = rngend;
+  snap->header.worldlen = worldend - rngend;
+  snap->header.brainlen = sizeof brain;
+  snap->header.nummobjs = 0;
+
+  P_SnapshotAppend(snap, archive, worldend + sizeof brain);
+
+  // walk the P_ArchiveThinkers output, mirroring PADSAVEP
+  for (pos = worldend + sizeof brain; archive[pos++] == tc_mobj; pos += sizeof(mobj_t))
+  {
+    const byte *mobj;
+
+    pos += (4 - (pos & 3)) & 3;
+    mobj = archive + pos;
+
+    P_SnapshotReserve(snap, mobj_record_size);
+    for (i = 0; i < NUM_MOBJ_FIELDS; i++)
+    {
+      memcpy(snap->data + snap->size, mobj + mobj_fields[i].offset, mobj_fields[i].size);
+      snap->size += mobj_fields[i].size;
+    }
+    snap->header.nummobjs++;
+  }
+
+  snap->header.soundtargetlen = length - pos;
+  P_SnapshotAppend(snap, archive + pos, length - pos);
+}
+
+static int_64_t P_FieldValue(const byte *record, const desync_field_t *field)
+{
+  switch (field->size)
+  {
+    case 1: return *(const signed char *)(record + field->offset);
+    case 2: { short v; memcpy(&v, record + field->offset, 2); return v; }
+    case 4: { int v; memcpy(&v, record + field->offset, 4); return v; }
+    default: { int_64_t v; memcpy(&v, record + field->offset, 8); return v; }
+  }
+}
+
+//
+// P_ReportFields
+// Prints every field of a record that differs, returns the number printed
+//
+static int P_ReportFields(const char *what, int index,
+                          const desync_field_t *fields, int numfields,
+                          const byte *ref, const byte *cur)
+{
+  int i, count = 0;
+
+  for (i = 0; i < numfields; i++)
+  {
+    if (memcmp(ref + fields[i].offset, cur + fields[i].offset, fields[i].size))
+    {
+      lprintf(LO_INFO, "  %s %d: %s reference %lld, candidate %lld\n",
+              what, index, fields[i].name,
+              (long long)P_FieldValue(ref, &fields[i]),
+              (long long)P_FieldValue(cur, &fields[i]));
+      count++;
+    }
+  }
+
+  return count;
+}
+
+//
+// P_FindLine
+// Returns the line whose P_ArchiveWorld record contains the given offset
+//
+static int P_FindLine(size_t offset)
+{
+  int i, j;
+
+  for (i = 0; i < numlines; i++)
+  {
+    size_t size = 3 * sizeof(short);
+
+    for (j = 0; j < 2; j++)
+      if (lines[i].sidenum[j] != NO_INDEX)
+        size += 2 * sizeof(fixed_t) + 3 * sizeof(short);
+
+    if (offset < size)
+      return i;
+    offset -= size;
+  }
+
+  return -1;
+}
+
+//
+// P_CompareSnapshots
+// Returns true if the snapshots differ, after reporting the differences
+//
+static dboolean P_CompareSnapshots(const desync_snapshot_t *ref, const desync_snapshot_t *cur)
+{
+  const desync_header_t *rh = &ref->header, *ch = &cur->header;
+  const byte *rp = ref->data, *cp = cur->data;
+  dboolean desynced = false;
+  int i;
+
+  if (rh->tic != ch->tic || rh->episode != ch->episode || rh->map != ch->map)
+  {
+    lprintf(LO_INFO, "P_VerifyDesync: reference is at tic %d (episode %d map %d), "
+            "candidate at tic %d (episode %d map %d)\n",
+            rh->tic, rh->episode, rh->map, ch->tic, ch->episode, ch->map);
+    return true;
+  }
+
+  if (ref->size == cur->size && !memcmp(rp, cp, ref->size) &&
+      !memcmp(rh, ch, sizeof(*rh)))
+    return false;
+
+  lprintf(LO_INFO, "P_VerifyDesync: first difference at tic %d (episode %d map %d)\n",
+          ch->tic, ch->episode, ch->map);
+
+  if (rh->rnglen != ch->rnglen || memcmp(rp, cp, ch->rnglen))
+  {
+    const rng_t *rrng = (const rng_t *)rp, *crng = (const rng_t *)cp;
+
+    lprintf(LO_INFO, "  rng: rndindex reference %d, candidate %d; "
+            "prndindex reference %d, candidate %d\n",
+            rrng->rndindex, crng->rndindex, rrng->prndindex, crng->prndindex);
+    desynced = true;
+  }
+  rp += rh->rnglen;
+  cp += ch->rnglen;
+
+  if (rh->worldlen != ch->worldlen)
+  {
+    lprintf(LO_INFO, "  world: reference %d bytes, candidate %d bytes\n",
+            rh->worldlen, ch->worldlen);
+    desynced = true;
+  }
+  else if (memcmp(rp, cp, ch->worldlen))
+  {
+    // P_ArchiveWorld pads to 4 bytes before the sectors
+    size_t base = (4 - (ch->rnglen & 3)) & 3;
+    size_t lineoffset = base + numsectors * SECTOR_RECORD_SIZE;
+    size_t offset;
+
+    for (i = 0; i < numsectors; i++)
+    {
+      size_t at = base + i * SECTOR_RECORD_SIZE;
+
+      if (memcmp(rp + at, cp + at, SECTOR_RECORD_SIZE))
+      {
+        P_ReportFields("sector", i, sector_fields, NUM_SECTOR_FIELDS, rp + at, cp + at);
+        break;
+      }
+    }
+
+    for (offset = lineoffset; offset < (size_t)ch->worldlen; offset++)
+    {
+      if (rp[offset] != cp[offset])
+      {
+        int line = P_FindLine(offset - lineoffset);
+
+        if (line >= 0)
+          lprintf(LO_INFO, "  line %d (or its sidedefs) differs\n", line);
+        else
+          lprintf(LO_INFO, "  music info differs\n");
+        break;
+      }
+    }
+    desynced = true;
+  }
+  rp += rh->worldlen;
+  cp += ch->worldlen;
+
+  if (rh->brainlen != ch->brainlen || memcmp(rp, cp, ch->brainlen))
+  {
+    lprintf(LO_INFO, "  boss brain state differs\n");
+    desynced = true;
+  }
+  rp += rh->brainlen;
+  cp += ch->brainlen;
+
+  if (rh->nummobjs != ch->nummobjs)
+  {
+    lprintf(LO_INFO, "  mobjs: reference %d, candidate %d\n", rh->nummobjs, ch->nummobjs);
+    desynced = true;
+  }
+  for (i = 0; i < MIN(rh->nummobjs, ch->nummobjs); i++)
+  {
+    const byte *rm = rp + i * mobj_record_size;
+    const byte *cm = cp + i * mobj_record_size;
+
+    if (memcmp(rm, cm, mobj_record_size))
+    {
+      // mobj records are packed, so rebase the field offsets
+      desync_field_t packed[NUM_MOBJ_FIELDS];
+      size_t offset = 0;
+      int j;
+
+      for (j = 0; j < NUM_MOBJ_FIELDS; j++)
+      {
+        packed[j] = mobj_fields[j];
+        packed[j].offset = offset;
+        offset += mobj_fields[j].size;
+      }
+
+      lprintf(LO_INFO, "  mobj %d (type %lld at %lld,%lld):\n",
+              i, (long long)P_FieldValue(cm, &packed[0]),
+              (long long)P_FieldValue(cm, &packed[1]) >> FRACBITS,
+              (long long)P_FieldValue(cm, &packed[2]) >> FRACBITS);
+      P_ReportFields("mobj", i, packed, NUM_MOBJ_FIELDS, rm, cm);
+      desynced = true;
+      break;
+    }
+  }
+  rp += rh->nummobjs * mobj_record_size;
+  cp += ch->nummobjs * mobj_record_size;
+
+  if (rh->soundtargetlen != ch->soundtargetlen || memcmp(rp, cp, ch->soundtargetlen))
+  {
+    lprintf(LO_INFO, "  sector soundtargets differ\n");
+    desynced = true;
+  }
+
+  return desynced;
+}
+
+static void P_WriteSnapshot(int tic)
+{
+  if (gamestate != GS_LEVEL)
+    return;
+
+  P_BuildSnapshot(&current, tic);
+  fwrite(&current.header, sizeof(current.header), 1, desyncfile);
+  fwrite(current.data, 1, current.size, desyncfile);
+}
+
+static dboolean P_ReadSnapshot(desync_snapshot_t *snap)
+{
+  size_t size;
+
+  if (fread(&snap->header, sizeof(snap->header), 1, desyncfile) != 1)
+    return false;
+
+  size = snap->header.rnglen + snap->header.worldlen + snap->header.brainlen +
+         snap->header.nummobjs * mobj_record_size + snap->header.soundtargetlen;
+  snap->size = 0;
+  P_SnapshotReserve(snap, size);
+  snap->size = fread(snap->data, 1, size, desyncfile);
+
+  return snap->size == size;
+}
+
+static void P_CheckSnapshot(int tic)
+{
+  if (gamestate != GS_LEVEL)
+    return;
+
+  P_BuildSnapshot(&current, tic);
+
+  if (!P_ReadSnapshot(&reference))
+  {
+    lprintf(LO_INFO, "P_VerifyDesync: reference ends before tic %d, stopping comparison\n", tic);
+    P_DesyncSnapshot = p_desync_nop;
+    return;
+  }
+
+  if (P_CompareSnapshots(&reference, &current))
+    I_Error("P_VerifyDesync: demo desynced at tic %d", tic);
+}
+
+static void P_DesyncCleanup(void)
+{
+  if (desyncfile)
+    fclose(desyncfile);
+  desyncfile = NULL;
+}
+
+static void P_OpenDesync(const char *file, const char *mode)
+{
+  int i;
+
+  desyncfile = M_fopen(file, mode);
+  if (!desyncfile)
+    I_Error("P_OpenDesync: cannot open %s:\n%s\n", file, strerror(errno));
+  I_AtExit(P_DesyncCleanup, true);
+
+  mobj_record_size = 0;
+  for (i = 0; i < NUM_MOBJ_FIELDS; i++)
+    mobj_record_size += mobj_fields[i].size;
+}
+
+void P_RecordDesync(const char *file)
+{
+  P_OpenDesync(file, "wb");
+  P_DesyncSnapshot = P_WriteSnapshot;
+}
+
+void P_VerifyDesync(const char *file)
+{
+  P_OpenDesync(file, "rb");
+  P_DesyncSnapshot = P_CheckSnapshot;
+}
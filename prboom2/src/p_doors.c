@@ -375,8 +375,7 @@ manual_door://e6y
 
     // new door thinker
     rtn = 1;
-    door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
-    memset(door, 0, sizeof(*door));
+    door = P_AllocThinker(sizeof(*door));
     P_AddThinker (&door->thinker);
     sec->ceilingdata = door; //jff 2/22/98
 
@@ -588,8 +587,7 @@ int EV_VerticalDoor
   }
 
   // new door thinker
-  door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
-  memset(door, 0, sizeof(*door));
+  door = P_AllocThinker(sizeof(*door));
   P_AddThinker (&door->thinker);
   sec->ceilingdata = door; //jff 2/22/98
   door->thinker.function = T_VerticalDoor;
@@ -660,9 +658,7 @@ void P_SpawnDoorCloseIn30 (sector_t* sec)
 {
   vldoor_t* door;
 
-  door = Z_Malloc ( sizeof(*door), PU_LEVSPEC, 0);
-
-  memset(door, 0, sizeof(*door));
+  door = P_AllocThinker(sizeof(*door));
   P_AddThinker (&door->thinker);
 
   sec->ceilingdata = door; //jff 2/22/98
@@ -692,9 +688,7 @@ void P_SpawnDoorRaiseIn5Mins
 {
   vldoor_t* door;
 
-  door = Z_Malloc ( sizeof(*door), PU_LEVSPEC, 0);
-
-  memset(door, 0, sizeof(*door));
+  door = P_AllocThinker(sizeof(*door));
   P_AddThinker (&door->thinker);
 
   sec->ceilingdata = door; //jff 2/22/98
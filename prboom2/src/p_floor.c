@@ -470,8 +470,7 @@ manual_floor://e6y
 
     // new floor thinker
     rtn = 1;
-    floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
-    memset(floor, 0, sizeof(*floor));
+    floor = P_AllocThinker(sizeof(*floor));
     P_AddThinker (&floor->thinker);
     sec->floordata = floor; //jff 2/22/98
     floor->thinker.function = T_MoveFloor;
@@ -785,8 +784,7 @@ manual_stair://e6y
 
     // create new floor thinker for first step
     rtn = 1;
-    floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
-    memset(floor, 0, sizeof(*floor));
+    floor = P_AllocThinker(sizeof(*floor));
     P_AddThinker (&floor->thinker);
     sec->floordata = floor;
     floor->thinker.function = T_MoveFloor;
@@ -887,8 +885,7 @@ manual_stair://e6y
         secnum = newsecnum;
 
         // create and initialize a thinker for the next step
-        floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
-        memset(floor, 0, sizeof(*floor));
+        floor = P_AllocThinker(sizeof(*floor));
         P_AddThinker (&floor->thinker);
 
         sec->floordata = floor; //jff 2/22/98
@@ -1046,8 +1043,7 @@ int EV_DoDonut(line_t*  line)
       }
 
       //  Spawn rising slime
-      floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
-      memset(floor, 0, sizeof(*floor));
+      floor = P_AllocThinker(sizeof(*floor));
       P_AddThinker (&floor->thinker);
       s2->floordata = floor; //jff 2/22/98
       floor->thinker.function = T_MoveFloor;
@@ -1061,8 +1057,7 @@ int EV_DoDonut(line_t*  line)
       floor->floordestheight = s3_floorheight;
 
       //  Spawn lowering donut-hole pillar
-      floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
-      memset(floor, 0, sizeof(*floor));
+      floor = P_AllocThinker(sizeof(*floor));
       P_AddThinker (&floor->thinker);
       s1->floordata = floor; //jff 2/22/98
       floor->thinker.function = T_MoveFloor;
@@ -1109,8 +1104,7 @@ int EV_DoElevator
 
     // create and initialize new elevator thinker
     rtn = 1;
-    elevator = Z_Malloc (sizeof(*elevator), PU_LEVSPEC, 0);
-    memset(elevator, 0, sizeof(*elevator));
+    elevator = P_AllocThinker(sizeof(*elevator));
     P_AddThinker (&elevator->thinker);
     sec->floordata = elevator; //jff 2/22/98
     sec->ceilingdata = elevator; //jff 2/22/98
@@ -51,6 +51,7 @@
 #include "r_demo.h"
 #include "g_overflow.h"
 #include "e6y.h"//e6y
+#include "z_bmalloc.h"
 
 // [FG] colored blood and gibs
 dboolean colored_blood;
@@ -884,6 +885,9 @@ mobj_t *P_SubstNullMobj(mobj_t *mobj)
     return mobj;
 }
 
+// Mobjs come and go by the thousand on some maps
+IMPLEMENT_BLOCK_MEMORY_ALLOC_ZONE(mobjzone, sizeof(mobj_t), PU_LEVEL, 256, "Mobjs");
+
 //
 // P_SpawnMobj
 //
@@ -893,8 +897,7 @@ mobj_t* P_SpawnMobj(fixed_t x,fixed_t y,fixed_t z,mobjtype_t type)
   state_t*    st;
   mobjinfo_t* info;
 
-  mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
-  memset (mobj, 0, sizeof (*mobj));
+  mobj = Z_BCalloc(&mobjzone);
   info = &mobjinfo[type];
   mobj->type = type;
   mobj->info = info;
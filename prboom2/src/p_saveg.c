@@ -45,6 +45,9 @@
 #include "lprintf.h"
 #include "s_advsound.h"
 #include "e6y.h"//e6y
+#include "z_bmalloc.h"
+
+DECLARE_BLOCK_MEMORY_ALLOC_ZONE(mobjzone);   // p_mobj.c
 
 byte *save_p;
 
@@ -260,11 +263,6 @@ void P_UnArchiveWorld (void)
 // Thinkers
 //
 
-typedef enum {
-  tc_end,
-  tc_mobj
-} thinkerclass_t;
-
 // phares 9/13/98: Moved this code outside of P_ArchiveThinkers so the
 // thinker indices could be used by the code that saves sector info.
 
@@ -441,7 +439,7 @@ void P_UnArchiveThinkers (void)
         P_RemoveThinkerDelayed(th); // fix mobj leak
       }
       else
-        Z_Free (th);
+        Z_BFreeAny (th);
       th = next;
     }
   P_InitThinkers ();
@@ -466,7 +464,7 @@ void P_UnArchiveThinkers (void)
   // read in saved thinkers
   for (size = 1; *save_p++ == tc_mobj; size++)    // killough 2/14/98
     {
-      mobj_t *mobj = Z_Malloc(sizeof(mobj_t), PU_LEVEL, NULL);
+      mobj_t *mobj = Z_BMalloc(&mobjzone);
 
       // killough 2/14/98 -- insert pointers to thinkers into table, in order:
       mobj_p[size] = mobj;
@@ -810,7 +808,7 @@ void P_UnArchiveSpecials (void)
       case tc_ceiling:
         PADSAVEP();
         {
-          ceiling_t *ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
+          ceiling_t *ceiling = P_AllocThinker (sizeof(*ceiling));
           memcpy (ceiling, save_p, sizeof(*ceiling));
           save_p += sizeof(*ceiling);
           ceiling->sector = &sectors[(size_t)ceiling->sector];
@@ -827,7 +825,7 @@ void P_UnArchiveSpecials (void)
       case tc_door:
         PADSAVEP();
         {
-          vldoor_t *door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
+          vldoor_t *door = P_AllocThinker (sizeof(*door));
           memcpy (door, save_p, sizeof(*door));
           save_p += sizeof(*door);
           door->sector = &sectors[(size_t)door->sector];
@@ -844,7 +842,7 @@ void P_UnArchiveSpecials (void)
       case tc_floor:
         PADSAVEP();
         {
-          floormove_t *floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
+          floormove_t *floor = P_AllocThinker (sizeof(*floor));
           memcpy (floor, save_p, sizeof(*floor));
           save_p += sizeof(*floor);
           floor->sector = &sectors[(size_t)floor->sector];
@@ -857,7 +855,7 @@ void P_UnArchiveSpecials (void)
       case tc_plat:
         PADSAVEP();
         {
-          plat_t *plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
+          plat_t *plat = P_AllocThinker (sizeof(*plat));
           memcpy (plat, save_p, sizeof(*plat));
           save_p += sizeof(*plat);
           plat->sector = &sectors[(size_t)plat->sector];
@@ -874,7 +872,7 @@ void P_UnArchiveSpecials (void)
       case tc_flash:
         PADSAVEP();
         {
-          lightflash_t *flash = Z_Malloc (sizeof(*flash), PU_LEVEL, NULL);
+          lightflash_t *flash = P_AllocThinker (sizeof(*flash));
           memcpy (flash, save_p, sizeof(*flash));
           save_p += sizeof(*flash);
           flash->sector = &sectors[(size_t)flash->sector];
@@ -886,7 +884,7 @@ void P_UnArchiveSpecials (void)
       case tc_strobe:
         PADSAVEP();
         {
-          strobe_t *strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL);
+          strobe_t *strobe = P_AllocThinker (sizeof(*strobe));
           memcpy (strobe, save_p, sizeof(*strobe));
           save_p += sizeof(*strobe);
           strobe->sector = &sectors[(size_t)strobe->sector];
@@ -898,7 +896,7 @@ void P_UnArchiveSpecials (void)
       case tc_glow:
         PADSAVEP();
         {
-          glow_t *glow = Z_Malloc (sizeof(*glow), PU_LEVEL, NULL);
+          glow_t *glow = P_AllocThinker (sizeof(*glow));
           memcpy (glow, save_p, sizeof(*glow));
           save_p += sizeof(*glow);
           glow->sector = &sectors[(size_t)glow->sector];
@@ -910,7 +908,7 @@ void P_UnArchiveSpecials (void)
       case tc_flicker:           // killough 10/4/98
         PADSAVEP();
         {
-          fireflicker_t *flicker = Z_Malloc (sizeof(*flicker), PU_LEVEL, NULL);
+          fireflicker_t *flicker = P_AllocThinker (sizeof(*flicker));
           memcpy (flicker, save_p, sizeof(*flicker));
           save_p += sizeof(*flicker);
           flicker->sector = &sectors[(size_t)flicker->sector];
@@ -923,7 +921,7 @@ void P_UnArchiveSpecials (void)
       case tc_elevator:
         PADSAVEP();
         {
-          elevator_t *elevator = Z_Malloc (sizeof(*elevator), PU_LEVEL, NULL);
+          elevator_t *elevator = P_AllocThinker (sizeof(*elevator));
           memcpy (elevator, save_p, sizeof(*elevator));
           save_p += sizeof(*elevator);
           elevator->sector = &sectors[(size_t)elevator->sector];
@@ -936,7 +934,7 @@ void P_UnArchiveSpecials (void)
 
       case tc_scroll:       // killough 3/7/98: scroll effect thinkers
         {
-          scroll_t *scroll = Z_Malloc (sizeof(scroll_t), PU_LEVEL, NULL);
+          scroll_t *scroll = P_AllocThinker (sizeof(scroll_t));
           memcpy (scroll, save_p, sizeof(scroll_t));
           save_p += sizeof(scroll_t);
           scroll->thinker.function = T_Scroll;
@@ -946,7 +944,7 @@ void P_UnArchiveSpecials (void)
 
       case tc_pusher:   // phares 3/22/98: new Push/Pull effect thinkers
         {
-          pusher_t *pusher = Z_Malloc (sizeof(pusher_t), PU_LEVEL, NULL);
+          pusher_t *pusher = P_AllocThinker (sizeof(pusher_t));
           memcpy (pusher, save_p, sizeof(pusher_t));
           save_p += sizeof(pusher_t);
           pusher->thinker.function = T_Pusher;
@@ -959,7 +957,7 @@ void P_UnArchiveSpecials (void)
       case tc_friction:
         PADSAVEP();
         {
-          friction_t *friction = Z_Malloc (sizeof(friction_t), PU_LEVEL, NULL);
+          friction_t *friction = P_AllocThinker (sizeof(friction_t));
           memcpy (friction, save_p, sizeof(friction_t));
           save_p += sizeof(friction_t);
           friction->thinker.function = T_Friction;
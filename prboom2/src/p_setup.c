@@ -57,6 +57,7 @@
 #include "g_overflow.h"
 #include "am_map.h"
 #include "e6y.h"//e6y
+#include "z_bmalloc.h"
 
 #include "config.h"
 #ifdef HAVE_LIBZ
@@ -2628,6 +2629,7 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   S_Start();
 
   Z_FreeTags(PU_LEVEL, PU_PURGELEVEL-1);
+  Z_BFreeTags(PU_LEVEL, PU_PURGELEVEL-1);
   if (rejectlump != -1) { // cph - unlock the reject table
     W_UnlockLumpNum(rejectlump);
     rejectlump = -1;
@@ -2658,6 +2660,13 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   // Avoid segfaults on levels without nodes.
   P_CheckLevelWadStructure(lumpname);
 
+  // start reading the map lumps in ahead of the loaders below
+  for (i = ML_THINGS; i <= ML_BLOCKMAP; i++)
+    W_WillNeedLumpNum(lumpnum + i);
+  if (gl_lumpnum >= 0)
+    for (i = ML_GL_VERTS; i <= ML_GL_NODES && gl_lumpnum + i < numlumps; i++)
+      W_WillNeedLumpNum(gl_lumpnum + i);
+
   leveltime = 0; totallive = 0;
 
   // note: most of this ordering is important
@@ -39,6 +39,8 @@
 #include "r_fps.h"
 #include "e6y.h"
 #include "s_advsound.h"
+#include "lprintf.h"
+#include "z_bmalloc.h"
 
 int leveltime;
 
@@ -46,12 +48,43 @@ static dboolean newthinkerpresent;
 
 //
 // THINKERS
-// All thinkers should be allocated by Z_Malloc
-// so they can be operated on uniformly.
+// All thinkers should be allocated by P_AllocThinker
+// (mobjs from mobjzone) so they can be operated on uniformly.
 // The actual structures will vary in size,
 // but the first element must be thinker_t.
 //
 
+// Special thinkers come from block zones by size class, so the
+// floors, doors and so on a level churns through reuse each other's
+// memory. Mobjs have mobjzone to themselves.
+#define THINKER_CLASS 16
+#define THINKER_CLASSES 16
+
+static struct block_memory_alloc_s thinkerzones[THINKER_CLASSES];
+static char thinkerzonedesc[THINKER_CLASSES][16];
+
+void *P_AllocThinker(size_t size)
+{
+  int c = (int)((size + THINKER_CLASS - 1) / THINKER_CLASS) - 1;
+  struct block_memory_alloc_s *pzone;
+
+  if (c < 0 || c >= THINKER_CLASSES)
+    I_Error("P_AllocThinker: No zone for %u byte thinkers", (unsigned int)size);
+
+  pzone = &thinkerzones[c];
+
+  if (!pzone->size)
+  {
+    sprintf(thinkerzonedesc[c], "Thinkers %d", (c + 1) * THINKER_CLASS);
+    pzone->size = (c + 1) * THINKER_CLASS;
+    pzone->perpool = 64;
+    pzone->tag = PU_LEVEL;
+    pzone->desc = thinkerzonedesc[c];
+  }
+
+  return Z_BCalloc(pzone);
+}
+
 // killough 8/29/98: we maintain several separate threads, each containing
 // a special class of thinkers, to allow more efficient searches.
 thinker_t thinkerclasscap[th_all+1];
@@ -161,7 +194,7 @@ void P_RemoveThinkerDelayed(thinker_t *thinker)
         thinker_t *th = thinker->cnext;
         (th->cprev = thinker->cprev)->cnext = th;
       }
-      Z_Free(thinker);
+      Z_BFreeAny(thinker);
     }
 }
 
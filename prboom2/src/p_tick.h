@@ -45,6 +45,7 @@ extern "C" {
 void P_Ticker(void);
 
 void P_InitThinkers(void);
+void *P_AllocThinker(size_t size);   // zeroed, for thinkers other than mobjs
 void P_AddThinker(thinker_t *thinker);
 void P_RemoveThinker(thinker_t *thinker);
 void P_RemoveThinkerDelayed(thinker_t *thinker);    // killough 4/25/98
@@ -72,6 +73,12 @@ extern thinker_t thinkerclasscap[];
 /* cph 2002/01/13 - iterator for thinker lists */
 thinker_t* P_NextThinker(thinker_t*,th_class);
 
+/* Marks each thinker archived by P_ArchiveThinkers */
+typedef enum {
+  tc_end,
+  tc_mobj
+} thinkerclass_t;
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif  // __cplusplus
@@ -53,6 +53,9 @@ enum packet_type_e {
   PKT_DOWN,    // Server downed
   PKT_WAD,     // Wad file request
   PKT_BACKOFF, // Request for client back-off
+  PKT_DTICC,   // delta coded tics from client
+  PKT_DTICS,   // delta coded tics from server
+  PKT_WATCH,   // spectator joining a game
 };
 
 typedef struct {
@@ -65,6 +68,29 @@ typedef struct {
 static inline void packet_set(packet_header_t* p, enum packet_type_e t, unsigned long tic)
 { p->tic = doom_htonl(tic); p->type = t; p->reserved[0] = 0; p->reserved[1] = 0; }
 
+/* Protocol version, carried in reserved[0] of PKT_INIT (the highest the
+ * client speaks) and of PKT_SETUP (the one the server picked). Older
+ * programs leave it 0 and ignore it, so they keep to version 0.
+ *  0 - PKT_TICC and PKT_TICS with raw ticcmds
+ *  1 - PKT_DTICC and PKT_DTICS with delta coded ticcmds
+ */
+#define NET_PROTOCOL_VERSION 1
+
+/* From version 1 each tic packet repeats at least this many of the tics
+ * before the new ones, so a lost packet is made good by the next one
+ * rather than by a PKT_RETRANS round trip
+ */
+#define NET_REDUNDANCY 2
+
+static inline int packet_version(const packet_header_t* p)
+{ return p->reserved[0] < NET_PROTOCOL_VERSION ? p->reserved[0] : NET_PROTOCOL_VERSION; }
+
+/* Flags in reserved[1] of PKT_SETUP */
+enum {
+  SETUP_SPECTATOR = 1, // joined to watch, send no tics
+  SETUP_SHORTTICS = 2, // the server records a demo without longtics
+};
+
 #ifndef GAME_OPTIONS_SIZE
 // From g_game.h
 #define GAME_OPTIONS_SIZE 64
@@ -102,6 +128,123 @@ inline static void TicToRaw(void* dst, const ticcmd_t* src)
   memcpy(dst,&tmp,sizeof tmp);
 }
 
+/* Delta coded ticcmds for PKT_DTICC and PKT_DTICS
+ *
+ * A ticcmd is a byte flagging the fields that differ from a base ticcmd,
+ * then just those fields; angleturn and consistancy as zigzag varints of
+ * their change. The base is the same player's previous ticcmd in the
+ * packet, or all zeroes for the first, so every packet decodes alone.
+ *
+ * PKT_DTICC: byte tics, byte player, then tics ticcmds
+ * PKT_DTICS: byte tics, then for each tic a byte with a bit set for each
+ *            player in it, then their ticcmds in player order
+ */
+enum {
+  TD_FORWARD = 1, TD_SIDE = 2, TD_ANGLE = 4, TD_CONSISTANCY = 8,
+  TD_CHAT = 16, TD_BUTTONS = 32
+};
+
+#define DELTA_TICCMD_MAX 11 // Most bytes one ticcmd can take
+
+inline static byte* PutDelta16(byte* p, int d)
+{
+  unsigned int v = d >= 0 ? (unsigned int)d << 1 : ((unsigned int)(-(d + 1)) << 1) | 1;
+
+  while (v >= 0x80) {
+    *p++ = (byte)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (byte)v;
+  return p;
+}
+
+inline static const byte* GetDelta16(const byte* p, const byte* end, int* d)
+{
+  unsigned int v = 0;
+  int shift;
+
+  for (shift = 0; shift < 21; shift += 7) {
+    if (p >= end)
+      return NULL;
+    v |= (unsigned int)(*p & 0x7f) << shift;
+    if (!(*p++ & 0x80)) {
+      *d = (v & 1) ? -(int)(v >> 1) - 1 : (int)(v >> 1);
+      return p;
+    }
+  }
+  return NULL; // malformed
+}
+
+// Writes cmd as a change from base, returns the end of what was written
+inline static byte* TicToDelta(byte* dst, const ticcmd_t* cmd, const ticcmd_t* base)
+{
+  byte* flags = dst++;
+
+  *flags = 0;
+  if (cmd->forwardmove != base->forwardmove) {
+    *flags |= TD_FORWARD;
+    *dst++ = (byte)cmd->forwardmove;
+  }
+  if (cmd->sidemove != base->sidemove) {
+    *flags |= TD_SIDE;
+    *dst++ = (byte)cmd->sidemove;
+  }
+  if (cmd->angleturn != base->angleturn) {
+    *flags |= TD_ANGLE;
+    dst = PutDelta16(dst, (short)(cmd->angleturn - base->angleturn));
+  }
+  if (cmd->consistancy != base->consistancy) {
+    *flags |= TD_CONSISTANCY;
+    dst = PutDelta16(dst, (short)(cmd->consistancy - base->consistancy));
+  }
+  if (cmd->chatchar != base->chatchar) {
+    *flags |= TD_CHAT;
+    *dst++ = cmd->chatchar;
+  }
+  if (cmd->buttons != base->buttons) {
+    *flags |= TD_BUTTONS;
+    *dst++ = cmd->buttons;
+  }
+  return dst;
+}
+
+// Reads a ticcmd written by TicToDelta, returns NULL if it runs past end
+inline static const byte* DeltaToTic(ticcmd_t* cmd, const byte* src, const byte* end, const ticcmd_t* base)
+{
+  byte flags;
+  int d;
+
+  if (src >= end)
+    return NULL;
+  flags = *src++;
+  *cmd = *base;
+  if (flags & TD_FORWARD) {
+    if (src >= end) return NULL;
+    cmd->forwardmove = (signed char)*src++;
+  }
+  if (flags & TD_SIDE) {
+    if (src >= end) return NULL;
+    cmd->sidemove = (signed char)*src++;
+  }
+  if (flags & TD_ANGLE) {
+    if (!(src = GetDelta16(src, end, &d))) return NULL;
+    cmd->angleturn = (short)(base->angleturn + d);
+  }
+  if (flags & TD_CONSISTANCY) {
+    if (!(src = GetDelta16(src, end, &d))) return NULL;
+    cmd->consistancy = (short)(base->consistancy + d);
+  }
+  if (flags & TD_CHAT) {
+    if (src >= end) return NULL;
+    cmd->chatchar = *src++;
+  }
+  if (flags & TD_BUTTONS) {
+    if (src >= end) return NULL;
+    cmd->buttons = *src++;
+  }
+  return src;
+}
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif  // __cplusplus
@@ -43,11 +43,11 @@
 
 int currentsubsectornum;
 
-seg_t     *curline;
+THREAD_LOCAL seg_t     *curline;
 side_t    *sidedef;
 line_t    *linedef;
-sector_t  *frontsector;
-sector_t  *backsector;
+THREAD_LOCAL sector_t  *frontsector;
+THREAD_LOCAL sector_t  *backsector;
 drawseg_t *ds_p;
 
 // killough 4/7/98: indicates doors closed wrt automap bugfix:
@@ -38,11 +38,11 @@
 extern "C" {
 #endif  // __cplusplus
 
-extern seg_t    *curline;
+extern THREAD_LOCAL seg_t    *curline;
 extern side_t   *sidedef;
 extern line_t   *linedef;
-extern sector_t *frontsector;
-extern sector_t *backsector;
+extern THREAD_LOCAL sector_t *frontsector;
+extern THREAD_LOCAL sector_t *backsector;
 
 /* old code -- killough:
  * extern drawseg_t drawsegs[MAXDRAWSEGS];
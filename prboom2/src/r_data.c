@@ -34,6 +34,7 @@
 
 #include "doomstat.h"
 #include "w_wad.h"
+#include "w_stream.h"
 #include "r_draw.h"
 #include "r_main.h"
 #include "r_sky.h"
@@ -639,44 +640,97 @@ int PUREFUNC R_SafeTextureNumForName(const char *name, int snum)
 // Totally rewritten by Lee Killough to use less memory,
 // to avoid using alloca(), and to improve performance.
 // cph - new wad lump handling, calls cache functions but acquires no locks
+//
+// The lumps are streamed in on a worker thread when the WAD cache allows it
+// (see w_stream.cpp), walls and flats before sprites, and each nearest the
+// player first. The map itself was read by P_SetupLevel before this.
 
 static inline void precache_lump(int l)
 {
   W_CacheLumpNum(l); W_UnlockLumpNum(l);
 }
 
+static int precache_x, precache_y;
+static const int *precache_key;
+
+// Same approximation as P_AproxDistance, in map units so it can't overflow
+static int PrecacheDistance(fixed_t x, fixed_t y)
+{
+  int dx = D_abs((x >> FRACBITS) - precache_x);
+  int dy = D_abs((y >> FRACBITS) - precache_y);
+  return dx+dy-((dx < dy ? dx : dy)>>1);
+}
+
+static void PrecacheLump(int *key, int lump, int k)
+{
+  if (key[lump] > k)
+    key[lump] = k;
+}
+
+static int PrecacheCompare(const void *a, const void *b)
+{
+  return precache_key[*(const int *)a] - precache_key[*(const int *)b];
+}
+
+#define PRECACHE_SPRITES (1<<24)  // added to sprite keys, so they go last
+
 void R_PrecacheLevel(void)
 {
   register int i;
-  register byte *hitlist;
+  int *dist, *key, *queue;
+  int queued = 0;
 
   if (timingdemo)
     return;
 
   {
     int size = numflats > numsprites  ? numflats : numsprites;
-    hitlist = malloc(numtextures > size ? numtextures : size);
+    dist = malloc((numtextures > size ? numtextures : size) * sizeof *dist);
+  }
+  key = malloc(numlumps * sizeof *key);
+  for (i = 0; i < numlumps; i++)
+    key[i] = INT_MAX;
+
+  precache_x = precache_y = 0;
+  if (players[displayplayer].mo)
+  {
+    precache_x = players[displayplayer].mo->x >> FRACBITS;
+    precache_y = players[displayplayer].mo->y >> FRACBITS;
   }
 
   // Precache flats.
 
-  memset(hitlist, 0, numflats);
+  for (i = 0; i < numflats; i++)
+    dist[i] = INT_MAX;
 
   for (i = numsectors; --i >= 0; )
-    hitlist[sectors[i].floorpic] = hitlist[sectors[i].ceilingpic] = 1;
+  {
+    int d = PrecacheDistance(sectors[i].soundorg.x, sectors[i].soundorg.y);
+    if (dist[sectors[i].floorpic] > d)
+      dist[sectors[i].floorpic] = d;
+    if (dist[sectors[i].ceilingpic] > d)
+      dist[sectors[i].ceilingpic] = d;
+  }
 
   for (i = numflats; --i >= 0; )
-    if (hitlist[i])
-      precache_lump(firstflat + i);
+    if (dist[i] != INT_MAX)
+      PrecacheLump(key, firstflat + i, dist[i]);
 
   // Precache textures.
 
-  memset(hitlist, 0, numtextures);
+  for (i = 0; i < numtextures; i++)
+    dist[i] = INT_MAX;
 
   for (i = numsides; --i >= 0;)
-    hitlist[sides[i].bottomtexture] =
-      hitlist[sides[i].toptexture] =
-      hitlist[sides[i].midtexture] = 1;
+  {
+    int d = PrecacheDistance(sides[i].sector->soundorg.x, sides[i].sector->soundorg.y);
+    if (dist[sides[i].bottomtexture] > d)
+      dist[sides[i].bottomtexture] = d;
+    if (dist[sides[i].toptexture] > d)
+      dist[sides[i].toptexture] = d;
+    if (dist[sides[i].midtexture] > d)
+      dist[sides[i].midtexture] = d;
+  }
 
   // Sky texture is always present.
   // Note that F_SKY1 is the name used to
@@ -685,41 +739,63 @@ void R_PrecacheLevel(void)
   //  a wall texture, with an episode dependend
   //  name.
 
-  hitlist[skytexture] = 1;
+  dist[skytexture] = 0;
 
   for (i = numtextures; --i >= 0; )
-    if (hitlist[i])
+    if (dist[i] != INT_MAX)
       {
         texture_t *texture = textures[i];
         int j = texture->patchcount;
         while (--j >= 0)
-          precache_lump(texture->patches[j].patch);
+          PrecacheLump(key, texture->patches[j].patch, dist[i]);
       }
 
   // Precache sprites.
-  memset(hitlist, 0, numsprites);
+
+  for (i = 0; i < numsprites; i++)
+    dist[i] = INT_MAX;
 
   {
     thinker_t *th = NULL;
     while ((th = P_NextThinker(th,th_all)) != NULL)
       if (th->function == P_MobjThinker)
-        hitlist[((mobj_t *)th)->sprite] = 1;
+      {
+        mobj_t *mo = (mobj_t *)th;
+        int d = PrecacheDistance(mo->x, mo->y);
+        if (dist[mo->sprite] > d)
+          dist[mo->sprite] = d;
+      }
   }
 
   for (i=numsprites; --i >= 0;)
-    if (hitlist[i])
+    if (dist[i] != INT_MAX)
       {
         int j = sprites[i].numframes;
         while (--j >= 0)
           {
             short *sflump = sprites[i].spriteframes[j].lump;
-            int k = 7;
+            int k = 15;
             do
-              precache_lump(firstspritelump + sflump[k]);
+              if (sflump[k] >= 0)
+                PrecacheLump(key, firstspritelump + sflump[k], PRECACHE_SPRITES + dist[i]);
             while (--k >= 0);
           }
       }
-  free(hitlist);
+
+  queue = malloc(numlumps * sizeof *queue);
+  for (i = 0; i < numlumps; i++)
+    if (key[i] != INT_MAX)
+      queue[queued++] = i;
+  precache_key = key;
+  qsort(queue, queued, sizeof *queue, PrecacheCompare);
+
+  if (!W_StreamLumps(queue, queued))
+    for (i = 0; i < queued; i++)
+      precache_lump(queue[i]);
+
+  free(queue);
+  free(key);
+  free(dist);
 }
 
 // Proff - Added for OpenGL
@@ -34,12 +34,16 @@
  *-----------------------------------------------------------------------------*/
 
 #include <stdint.h>
+#include <string.h>
+
+#include "SDL_cpuinfo.h"
 
 #include "doomstat.h"
 #include "w_wad.h"
 #include "r_main.h"
 #include "r_draw.h"
 #include "r_filter.h"
+#include "r_threads.h"
 #include "v_video.h"
 #include "st_stuff.h"
 #include "g_game.h"
@@ -68,7 +72,7 @@ int  viewwindowy;
 //
 
 // CPhipps - made const*'s
-const byte *tranmap;          // translucency filter maps 256x256   // phares
+THREAD_LOCAL const byte *tranmap; // translucency filter maps 256x256   // phares
 const byte *main_tranmap;     // killough 4/11/98
 
 //
@@ -87,20 +91,25 @@ typedef enum
    COL_FLEXADD
 } columntype_e;
 
-static int    temp_x = 0;
-static int    tempyl[4], tempyh[4];
+// The column buffer is per thread, see r_threads.h
+static THREAD_LOCAL int    temp_x = 0;
+static THREAD_LOCAL int    tempyl[4], tempyh[4];
 
 // e6y: resolution limitation is removed
-static byte           *byte_tempbuf;
-static unsigned short *short_tempbuf;
-static unsigned int   *int_tempbuf;
-
-static int    startx = 0;
-static int    temptype = COL_NONE;
-static int    commontop, commonbot;
-static const byte *temptranmap = NULL;
+static THREAD_LOCAL byte           *byte_tempbuf;
+static THREAD_LOCAL unsigned short *short_tempbuf;
+static THREAD_LOCAL unsigned int   *int_tempbuf;
+
+static byte           *byte_tempbufs[MAX_RENDER_THREADS];
+static unsigned short *short_tempbufs[MAX_RENDER_THREADS];
+static unsigned int   *int_tempbufs[MAX_RENDER_THREADS];
+
+static THREAD_LOCAL int    startx = 0;
+static THREAD_LOCAL int    temptype = COL_NONE;
+static THREAD_LOCAL int    commontop, commonbot;
+static THREAD_LOCAL const byte *temptranmap = NULL;
 // SoM 7-28-04: Fix the fuzz problem.
-static const byte   *tempfuzzmap;
+static THREAD_LOCAL const byte   *tempfuzzmap;
 
 //
 // Spectre/Invisibility.
@@ -178,9 +187,9 @@ static void R_QuadFlushError(void)
    I_Error("R_FlushQuadColumn called without being initialized.\n");
 }
 
-static void (*R_FlushWholeColumns)(void) = R_FlushWholeError;
-static void (*R_FlushHTColumns)(void)    = R_FlushHTError;
-static void (*R_FlushQuadColumn)(void) = R_QuadFlushError;
+static THREAD_LOCAL void (*R_FlushWholeColumns)(void) = R_FlushWholeError;
+static THREAD_LOCAL void (*R_FlushHTColumns)(void)    = R_FlushHTError;
+static THREAD_LOCAL void (*R_FlushQuadColumn)(void) = R_QuadFlushError;
 
 static void R_FlushColumns(void)
 {
@@ -668,10 +677,16 @@ static R_DrawColumn_f drawcolumnfuncs[VID_MODEMAX][RDRAW_FILTER_MAXFILTERS][RDRA
   },
 };
 
+int render_simd = 1;
+
+#include "r_drawsimd.inl"
+
 R_DrawColumn_f R_GetDrawColumnFunc(enum column_pipeline_e type,
                                    enum draw_filter_type_e filter,
                                    enum draw_filter_type_e filterz) {
-  R_DrawColumn_f result = drawcolumnfuncs[V_GetMode()][filterz][filter][type];
+  R_DrawColumn_f result = simdcolumnfuncs[V_GetMode()][filterz][filter][type];
+  if (result == NULL)
+    result = drawcolumnfuncs[V_GetMode()][filterz][filter][type];
   if (result == NULL)
     I_Error("R_GetDrawColumnFunc: undefined function (%d, %d, %d)",
             type, filter, filterz);
@@ -979,7 +994,9 @@ static R_DrawSpan_f drawspanfuncs[VID_MODEMAX][RDRAW_FILTER_MAXFILTERS][RDRAW_FI
 
 R_DrawSpan_f R_GetDrawSpanFunc(enum draw_filter_type_e filter,
                                enum draw_filter_type_e filterz) {
-  R_DrawSpan_f result = drawspanfuncs[V_GetMode()][filterz][filter];
+  R_DrawSpan_f result = simdspanfuncs[V_GetMode()][filterz][filter];
+  if (result == NULL)
+    result = drawspanfuncs[V_GetMode()][filterz][filter];
   if (result == NULL)
     I_Error("R_GetDrawSpanFunc: undefined function (%d, %d)",
             filter, filterz);
@@ -990,19 +1007,43 @@ void R_DrawSpan(draw_span_vars_t *dsvars) {
   R_GetDrawSpanFunc(drawvars.filterfloor, drawvars.filterz)(dsvars);
 }
 
+//
+// R_SelectColumnBuffer
+// Gives the calling render thread its own column buffer
+//
+
+void R_SelectColumnBuffer(int part)
+{
+  if (!byte_tempbufs[part])
+  {
+    byte_tempbufs[part] = calloc(1, (SCREENHEIGHT * 4) * sizeof(*byte_tempbuf));
+    short_tempbufs[part] = calloc(1, (SCREENHEIGHT * 4) * sizeof(*short_tempbuf));
+    int_tempbufs[part] = calloc(1, (SCREENHEIGHT * 4) * sizeof(*int_tempbuf));
+  }
+
+  byte_tempbuf = byte_tempbufs[part];
+  short_tempbuf = short_tempbufs[part];
+  int_tempbuf = int_tempbufs[part];
+}
+
 void R_InitBuffersRes(void)
 {
   extern byte *solidcol;
+  int i;
 
   if (solidcol) free(solidcol);
-  if (byte_tempbuf) free(byte_tempbuf);
-  if (short_tempbuf) free(short_tempbuf);
-  if (int_tempbuf) free(int_tempbuf);
-
   solidcol = calloc(1, SCREENWIDTH * sizeof(*solidcol));
-  byte_tempbuf = calloc(1, (SCREENHEIGHT * 4) * sizeof(*byte_tempbuf));
-  short_tempbuf = calloc(1, (SCREENHEIGHT * 4) * sizeof(*short_tempbuf));
-  int_tempbuf = calloc(1, (SCREENHEIGHT * 4) * sizeof(*int_tempbuf));
+
+  for (i = 0; i < MAX_RENDER_THREADS; i++)
+  {
+    free(byte_tempbufs[i]);
+    free(short_tempbufs[i]);
+    free(int_tempbufs[i]);
+    byte_tempbufs[i] = NULL;
+    short_tempbufs[i] = NULL;
+    int_tempbufs[i] = NULL;
+  }
+  R_SelectColumnBuffer(0);
 
   temp_x = 0;
 }
@@ -1045,6 +1086,8 @@ void R_InitBuffer(int width, int height)
     for (i=0; i<FUZZTABLE; i++)
       fuzzoffset[i] = fuzzoffset_org[i]*screens[0].int_pitch;
   }
+
+  R_InitSIMDDrawers();
 }
 
 //
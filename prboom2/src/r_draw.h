@@ -154,10 +154,17 @@ R_DrawSpan_f R_GetDrawSpanFunc(enum draw_filter_type_e filter,
                                enum draw_filter_type_e filterz);
 void R_DrawSpan(draw_span_vars_t *dsvars);
 
+// render_simd config: 0 = portable drawers only, 1 = SSE2 column drawers,
+// 2 = also the AVX2 span drawers
+extern int render_simd;
+
 void R_InitBuffer(int width, int height);
 
 void R_InitBuffersRes(void);
 
+// Switches the calling thread to the column buffer of a render part
+void R_SelectColumnBuffer(int part);
+
 // Initialize color translation tables, for player rendering etc.
 void R_InitTranslationTables(void);
 
@@ -0,0 +1,438 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      SSE2 and AVX2 drawers for the truecolor pipelines.
+ *
+ *  The AVX2 span drawers compute texture coordinates and filter weights
+ *  for eight pixels at a time and gather the texels, colormap entries and
+ *  palette colors. The SSE2 column drawers are the r_drawcolumn.inl ones
+ *  with a vector quad flush.
+ *  Every drawer here is pixel-identical to its scalar counterpart, which
+ *  stays in use on other CPUs and when render_simd is 0.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define R_SIMD_X86
+  #define R_TARGET_SSE2 __attribute__((target("sse2")))
+  #define R_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #define R_SIMD_X86
+  #define R_TARGET_SSE2
+  #define R_TARGET_AVX2
+#endif
+
+static R_DrawSpan_f simdspanfuncs[VID_MODEMAX][RDRAW_FILTER_MAXFILTERS][RDRAW_FILTER_MAXFILTERS];
+static R_DrawColumn_f simdcolumnfuncs[VID_MODEMAX][RDRAW_FILTER_MAXFILTERS][RDRAW_FILTER_MAXFILTERS][RDC_PIPELINE_MAXPIPELINES];
+
+#ifdef R_SIMD_X86
+
+#include <immintrin.h>
+
+typedef union {
+  __m256i v;
+  int i[8];
+} r_lanes8_t;
+
+//
+// Span drawers
+//
+// AVX2 only: without a gather the texel and palette lookups are scalar
+// anyway, and an SSE2 version measured slower than the plain loop. Even
+// with one, spans are bound by the three dependent lookups per texel, and
+// on CPUs with slow gathers these lose to the scalar loop, so they are
+// only used with render_simd 2.
+//
+
+// fixed_t coordinates of eight consecutive span pixels
+static INLINE R_TARGET_AVX2 __m256i R_SpanLanes_AVX2(fixed_t frac, fixed_t step)
+{
+  const unsigned int f = frac, s = step;
+
+  return _mm256_setr_epi32(f, f + s, f + 2 * s, f + 3 * s,
+                           f + 4 * s, f + 5 * s, f + 6 * s, f + 7 * s);
+}
+
+// Elements of a byte or short table, gathered from the aligned dwords that
+// hold them. An aligned dword never crosses a page, so reading the bytes
+// next to the wanted ones cannot fault.
+static INLINE R_TARGET_AVX2 __m256i R_GatherSmall_AVX2(const void *table, __m256i index, int size)
+{
+  const int misalign = (int)((uintptr_t)table & 3);
+  const int *base = (const int *)((const byte *)table - misalign);
+  const __m256i at = _mm256_add_epi32(_mm256_slli_epi32(index, size >> 1), _mm256_set1_epi32(misalign));
+  const __m256i dword = _mm256_i32gather_epi32(base, _mm256_srli_epi32(at, 2), 4);
+  const __m256i shift = _mm256_slli_epi32(_mm256_and_si256(at, _mm256_set1_epi32(3)), 3);
+
+  return _mm256_and_si256(_mm256_srlv_epi32(dword, shift), _mm256_set1_epi32((1 << (size * 8)) - 1));
+}
+
+// Colormapped texels at eight flat offsets
+static INLINE R_TARGET_AVX2 __m256i R_SpanTexels_AVX2(const byte *source, const byte *colormap, __m256i spot)
+{
+  return R_GatherSmall_AVX2(colormap, R_GatherSmall_AVX2(source, spot, 1), 1);
+}
+
+static INLINE R_TARGET_AVX2 __m256i R_SpanPalette_AVX2(int bits, __m256i index)
+{
+  if (bits == 32)
+    return _mm256_i32gather_epi32((const int *)V_Palette32, index, sizeof(*V_Palette32));
+  else if (bits == 16)
+    return R_GatherSmall_AVX2(V_Palette16, index, sizeof(*V_Palette16));
+  else
+    return R_GatherSmall_AVX2(V_Palette15, index, sizeof(*V_Palette15));
+}
+
+// Palette index of a texel and a filter weight of (u*v)>>26, the high
+// half of the 16x16 bit product shifted down the rest of the way
+static INLINE R_TARGET_AVX2 __m256i R_SpanIndex_AVX2(const byte *source, const byte *colormap,
+                                                      __m256i spot, __m256i u, __m256i v)
+{
+  const __m256i weight = _mm256_srli_epi32(_mm256_mulhi_epu16(u, v), 16 - VID_COLORWEIGHTBITS);
+
+  return _mm256_add_epi32(_mm256_slli_epi32(R_SpanTexels_AVX2(source, colormap, spot), VID_COLORWEIGHTBITS), weight);
+}
+
+// GETCOL_POINT of r_drawspan.inl
+static INLINE R_TARGET_AVX2 __m256i R_SpanPoint_AVX2(int bits, const byte *source, const byte *colormap,
+                                                      __m256i xfrac, __m256i yfrac)
+{
+  const __m256i spot = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(xfrac, 16), _mm256_set1_epi32(63)),
+                                       _mm256_and_si256(_mm256_srli_epi32(yfrac, 10), _mm256_set1_epi32(4032)));
+  const __m256i index = _mm256_or_si256(_mm256_slli_epi32(R_SpanTexels_AVX2(source, colormap, spot), VID_COLORWEIGHTBITS),
+                                        _mm256_set1_epi32(VID_COLORWEIGHTMASK));
+
+  return R_SpanPalette_AVX2(bits, index);
+}
+
+// filter_getFilteredForSpan32/16/15 of r_filter.h
+static INLINE R_TARGET_AVX2 __m256i R_SpanLinear_AVX2(int bits, const byte *source, const byte *colormap,
+                                                       __m256i xfrac, __m256i yfrac)
+{
+  const __m256i ffff = _mm256_set1_epi32(0xffff);
+  const __m256i x0 = _mm256_and_si256(_mm256_srli_epi32(xfrac, 16), _mm256_set1_epi32(63));
+  const __m256i x1 = _mm256_and_si256(_mm256_add_epi32(x0, _mm256_set1_epi32(1)), _mm256_set1_epi32(63));
+  const __m256i y0 = _mm256_and_si256(_mm256_srli_epi32(yfrac, 10), _mm256_set1_epi32(4032));
+  const __m256i y1 = _mm256_and_si256(_mm256_add_epi32(y0, _mm256_set1_epi32(64)), _mm256_set1_epi32(4032));
+  const __m256i u = _mm256_and_si256(xfrac, ffff), iu = _mm256_xor_si256(u, ffff);
+  const __m256i v = _mm256_and_si256(yfrac, ffff), iv = _mm256_xor_si256(v, ffff);
+  __m256i col;
+
+  col = R_SpanPalette_AVX2(bits, R_SpanIndex_AVX2(source, colormap, _mm256_or_si256(x1, y1), u, v));
+  col = _mm256_add_epi32(col, R_SpanPalette_AVX2(bits, R_SpanIndex_AVX2(source, colormap, _mm256_or_si256(x0, y1), iu, v)));
+  col = _mm256_add_epi32(col, R_SpanPalette_AVX2(bits, R_SpanIndex_AVX2(source, colormap, _mm256_or_si256(x0, y0), iu, iv)));
+  col = _mm256_add_epi32(col, R_SpanPalette_AVX2(bits, R_SpanIndex_AVX2(source, colormap, _mm256_or_si256(x1, y0), u, iv)));
+  return col;
+}
+
+//
+// R_DrawSpanAVX2
+//
+// The last group of a span is computed whole and stored partially; the
+// extra lanes only read texels inside the flat.
+//
+static INLINE R_TARGET_AVX2 void R_DrawSpanAVX2(draw_span_vars_t *dsvars, int bits, dboolean linear)
+{
+  int count = dsvars->x2 - dsvars->x1 + 1;
+  const byte *source = dsvars->source;
+  const byte *colormap = dsvars->colormap;
+  __m256i xfrac = R_SpanLanes_AVX2(dsvars->xfrac, dsvars->xstep);
+  __m256i yfrac = R_SpanLanes_AVX2(dsvars->yfrac, dsvars->ystep);
+  const __m256i xstep = _mm256_set1_epi32((unsigned int)dsvars->xstep * 8);
+  const __m256i ystep = _mm256_set1_epi32((unsigned int)dsvars->ystep * 8);
+  unsigned int *dest32 = drawvars.int_topleft + dsvars->y*drawvars.int_pitch + dsvars->x1;
+  unsigned short *dest16 = drawvars.short_topleft + dsvars->y*drawvars.short_pitch + dsvars->x1;
+
+  for (; count > 0; count -= 8)
+  {
+    __m256i col = linear ? R_SpanLinear_AVX2(bits, source, colormap, xfrac, yfrac)
+                         : R_SpanPoint_AVX2(bits, source, colormap, xfrac, yfrac);
+
+    if (bits == 32)
+    {
+      if (count >= 8)
+        _mm256_storeu_si256((__m256i *)dest32, col);
+      else
+      {
+        r_lanes8_t c;
+
+        c.v = col;
+        memcpy(dest32, c.i, count * sizeof(*dest32));
+      }
+      dest32 += 8;
+    }
+    else
+    {
+      // keep the low 16 bits like the scalar store does
+      __m128i col16;
+
+      col = _mm256_srai_epi32(_mm256_slli_epi32(col, 16), 16);
+      col16 = _mm_packs_epi32(_mm256_castsi256_si128(col), _mm256_extracti128_si256(col, 1));
+      if (count >= 8)
+        _mm_storeu_si128((__m128i *)dest16, col16);
+      else
+      {
+        unsigned short c[8];
+
+        _mm_storeu_si128((__m128i *)c, col16);
+        memcpy(dest16, c, count * sizeof(*dest16));
+      }
+      dest16 += 8;
+    }
+
+    xfrac = _mm256_add_epi32(xfrac, xstep);
+    yfrac = _mm256_add_epi32(yfrac, ystep);
+  }
+}
+
+// drop back to point filtering if we're minifying, as r_drawspan.inl does
+#define R_SPAN_MINIFIED(dsvars) \
+  ((D_abs((dsvars)->xstep) > drawvars.mag_threshold) || \
+   (D_abs((dsvars)->ystep) > drawvars.mag_threshold))
+
+static R_TARGET_AVX2 void R_DrawSpan15_PointUV_PointZ_AVX2(draw_span_vars_t *dsvars)
+{
+  R_DrawSpanAVX2(dsvars, 15, false);
+}
+
+static R_TARGET_AVX2 void R_DrawSpan15_LinearUV_PointZ_AVX2(draw_span_vars_t *dsvars)
+{
+  if (R_SPAN_MINIFIED(dsvars))
+    R_GetDrawSpanFunc(RDRAW_FILTER_POINT, drawvars.filterz)(dsvars);
+  else
+    R_DrawSpanAVX2(dsvars, 15, true);
+}
+
+static R_TARGET_AVX2 void R_DrawSpan16_PointUV_PointZ_AVX2(draw_span_vars_t *dsvars)
+{
+  R_DrawSpanAVX2(dsvars, 16, false);
+}
+
+static R_TARGET_AVX2 void R_DrawSpan16_LinearUV_PointZ_AVX2(draw_span_vars_t *dsvars)
+{
+  if (R_SPAN_MINIFIED(dsvars))
+    R_GetDrawSpanFunc(RDRAW_FILTER_POINT, drawvars.filterz)(dsvars);
+  else
+    R_DrawSpanAVX2(dsvars, 16, true);
+}
+
+static R_TARGET_AVX2 void R_DrawSpan32_PointUV_PointZ_AVX2(draw_span_vars_t *dsvars)
+{
+  R_DrawSpanAVX2(dsvars, 32, false);
+}
+
+static R_TARGET_AVX2 void R_DrawSpan32_LinearUV_PointZ_AVX2(draw_span_vars_t *dsvars)
+{
+  if (R_SPAN_MINIFIED(dsvars))
+    R_GetDrawSpanFunc(RDRAW_FILTER_POINT, drawvars.filterz)(dsvars);
+  else
+    R_DrawSpanAVX2(dsvars, 32, true);
+}
+
+//
+// Column drawers
+//
+// Each row of a quad flush is four adjacent 32 bit pixels, one vector.
+//
+
+static R_TARGET_SSE2 void R_FlushQuad32_SSE2(void)
+{
+  const unsigned int *source = &int_tempbuf[commontop << 2];
+  unsigned int *dest = drawvars.int_topleft + commontop*drawvars.int_pitch + startx;
+  int count = commonbot - commontop + 1;
+
+  while (--count >= 0)
+  {
+    _mm_storeu_si128((__m128i *)dest, _mm_loadu_si128((const __m128i *)source));
+    source += 4;
+    dest += drawvars.int_pitch;
+  }
+}
+
+// GETBLENDED32_3268 on 16 bit channels, dropping alpha like the scalar one
+static R_TARGET_SSE2 void R_FlushQuadTL32_SSE2(void)
+{
+  const unsigned int *source = &int_tempbuf[commontop << 2];
+  unsigned int *dest = drawvars.int_topleft + commontop*drawvars.int_pitch + startx;
+  int count = commonbot - commontop + 1;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i destweight = _mm_set1_epi16(5);
+  const __m128i srcweight = _mm_set1_epi16(11);
+  const __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+
+  while (--count >= 0)
+  {
+    const __m128i d = _mm_loadu_si128((const __m128i *)dest);
+    const __m128i s = _mm_loadu_si128((const __m128i *)source);
+    const __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), destweight),
+                                                    _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), srcweight)), 4);
+    const __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), destweight),
+                                                    _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), srcweight)), 4);
+
+    _mm_storeu_si128((__m128i *)dest, _mm_and_si128(_mm_packus_epi16(lo, hi), rgbmask));
+    source += 4;
+    dest += drawvars.int_pitch;
+  }
+}
+
+#define R_DRAWCOLUMN_PIPELINE_TYPE RDC_PIPELINE_STANDARD
+#define R_DRAWCOLUMN_PIPELINE_BASE RDC_STANDARD
+#define R_DRAWCOLUMN_PIPELINE_BITS 32
+#define R_DRAWCOLUMN_FUNCNAME_COMPOSITE(postfix) R_DrawColumn32_SSE2 ## postfix
+#define R_FLUSHWHOLE_FUNCNAME R_FlushWhole32
+#define R_FLUSHHEADTAIL_FUNCNAME R_FlushHT32
+#define R_FLUSHQUAD_FUNCNAME R_FlushQuad32_SSE2
+#include "r_drawcolpipeline.inl"
+#undef R_DRAWCOLUMN_PIPELINE_BASE
+#undef R_DRAWCOLUMN_PIPELINE_TYPE
+
+#define R_DRAWCOLUMN_PIPELINE_TYPE RDC_PIPELINE_TRANSLUCENT
+#define R_DRAWCOLUMN_PIPELINE_BASE RDC_TRANSLUCENT
+#define R_DRAWCOLUMN_PIPELINE_BITS 32
+#define R_DRAWCOLUMN_FUNCNAME_COMPOSITE(postfix) R_DrawTLColumn32_SSE2 ## postfix
+#define R_FLUSHWHOLE_FUNCNAME R_FlushWholeTL32
+#define R_FLUSHHEADTAIL_FUNCNAME R_FlushHTTL32
+#define R_FLUSHQUAD_FUNCNAME R_FlushQuadTL32_SSE2
+#include "r_drawcolpipeline.inl"
+#undef R_DRAWCOLUMN_PIPELINE_BASE
+#undef R_DRAWCOLUMN_PIPELINE_TYPE
+
+#define R_DRAWCOLUMN_PIPELINE_TYPE RDC_PIPELINE_TRANSLATED
+#define R_DRAWCOLUMN_PIPELINE_BASE RDC_TRANSLATED
+#define R_DRAWCOLUMN_PIPELINE_BITS 32
+#define R_DRAWCOLUMN_FUNCNAME_COMPOSITE(postfix) R_DrawTranslatedColumn32_SSE2 ## postfix
+#define R_FLUSHWHOLE_FUNCNAME R_FlushWhole32
+#define R_FLUSHHEADTAIL_FUNCNAME R_FlushHT32
+#define R_FLUSHQUAD_FUNCNAME R_FlushQuad32_SSE2
+#include "r_drawcolpipeline.inl"
+#undef R_DRAWCOLUMN_PIPELINE_BASE
+#undef R_DRAWCOLUMN_PIPELINE_TYPE
+
+// Same layout as the VID_MODE32 part of drawcolumnfuncs, fuzz excluded
+static const R_DrawColumn_f drawcolumnfuncs32_sse2[RDRAW_FILTER_MAXFILTERS][RDRAW_FILTER_MAXFILTERS][RDC_PIPELINE_FUZZ] = {
+  {
+    {NULL, NULL, NULL,},
+    {R_DrawColumn32_SSE2_PointUV,
+     R_DrawTLColumn32_SSE2_PointUV,
+     R_DrawTranslatedColumn32_SSE2_PointUV,},
+    {R_DrawColumn32_SSE2_LinearUV,
+     R_DrawTLColumn32_SSE2_LinearUV,
+     R_DrawTranslatedColumn32_SSE2_LinearUV,},
+    {R_DrawColumn32_SSE2_RoundedUV,
+     R_DrawTLColumn32_SSE2_RoundedUV,
+     R_DrawTranslatedColumn32_SSE2_RoundedUV,},
+  },
+  {
+    {NULL, NULL, NULL,},
+    {R_DrawColumn32_SSE2_PointUV_PointZ,
+     R_DrawTLColumn32_SSE2_PointUV_PointZ,
+     R_DrawTranslatedColumn32_SSE2_PointUV_PointZ,},
+    {R_DrawColumn32_SSE2_LinearUV_PointZ,
+     R_DrawTLColumn32_SSE2_LinearUV_PointZ,
+     R_DrawTranslatedColumn32_SSE2_LinearUV_PointZ,},
+    {R_DrawColumn32_SSE2_RoundedUV_PointZ,
+     R_DrawTLColumn32_SSE2_RoundedUV_PointZ,
+     R_DrawTranslatedColumn32_SSE2_RoundedUV_PointZ,},
+  },
+  {
+    {NULL, NULL, NULL,},
+    {R_DrawColumn32_SSE2_PointUV_LinearZ,
+     R_DrawTLColumn32_SSE2_PointUV_LinearZ,
+     R_DrawTranslatedColumn32_SSE2_PointUV_LinearZ,},
+    {R_DrawColumn32_SSE2_LinearUV_LinearZ,
+     R_DrawTLColumn32_SSE2_LinearUV_LinearZ,
+     R_DrawTranslatedColumn32_SSE2_LinearUV_LinearZ,},
+    {R_DrawColumn32_SSE2_RoundedUV_LinearZ,
+     R_DrawTLColumn32_SSE2_RoundedUV_LinearZ,
+     R_DrawTranslatedColumn32_SSE2_RoundedUV_LinearZ,},
+  },
+};
+
+#endif // R_SIMD_X86
+
+//
+// R_InitSIMDDrawers
+//
+// Fills the override tables checked by R_GetDrawSpanFunc and
+// R_GetDrawColumnFunc from what the CPU supports.
+//
+static void R_InitSIMDDrawers(void)
+{
+  static int last_simd = -1;
+  int simd = render_simd;
+
+#ifdef R_SIMD_X86
+  if (simd >= 2 && !SDL_HasAVX2())
+    simd = 1;
+  if (simd >= 1 && !SDL_HasSSE2())
+    simd = 0;
+#else
+  simd = 0;
+#endif
+
+  if (simd == last_simd)
+    return;
+  last_simd = simd;
+
+  memset(simdspanfuncs, 0, sizeof(simdspanfuncs));
+  memset(simdcolumnfuncs, 0, sizeof(simdcolumnfuncs));
+
+#ifdef R_SIMD_X86
+  if (simd >= 1)
+  {
+    int filterz, filter, type;
+
+    for (filterz = 0; filterz < RDRAW_FILTER_MAXFILTERS; filterz++)
+      for (filter = 0; filter < RDRAW_FILTER_MAXFILTERS; filter++)
+        for (type = 0; type < RDC_PIPELINE_FUZZ; type++)
+          simdcolumnfuncs[VID_MODE32][filterz][filter][type] = drawcolumnfuncs32_sse2[filterz][filter][type];
+  }
+
+  if (simd >= 2)
+  {
+    simdspanfuncs[VID_MODE15][RDRAW_FILTER_POINT][RDRAW_FILTER_POINT] = R_DrawSpan15_PointUV_PointZ_AVX2;
+    simdspanfuncs[VID_MODE15][RDRAW_FILTER_POINT][RDRAW_FILTER_LINEAR] = R_DrawSpan15_LinearUV_PointZ_AVX2;
+    simdspanfuncs[VID_MODE16][RDRAW_FILTER_POINT][RDRAW_FILTER_POINT] = R_DrawSpan16_PointUV_PointZ_AVX2;
+    simdspanfuncs[VID_MODE16][RDRAW_FILTER_POINT][RDRAW_FILTER_LINEAR] = R_DrawSpan16_LinearUV_PointZ_AVX2;
+    simdspanfuncs[VID_MODE32][RDRAW_FILTER_POINT][RDRAW_FILTER_POINT] = R_DrawSpan32_PointUV_PointZ_AVX2;
+    simdspanfuncs[VID_MODE32][RDRAW_FILTER_POINT][RDRAW_FILTER_LINEAR] = R_DrawSpan32_LinearUV_PointZ_AVX2;
+  }
+
+  if (simd)
+    lprintf(LO_INFO, "R_InitSIMDDrawers: using %s drawers\n", simd >= 2 ? "SSE2 and AVX2" : "SSE2");
+#endif
+}
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
@@ -46,6 +46,7 @@
 #include "r_plane.h"
 #include "r_bsp.h"
 #include "r_draw.h"
+#include "r_threads.h"
 #include "m_bbox.h"
 #include "r_sky.h"
 #include "v_video.h"
@@ -56,6 +57,7 @@
 #include "g_game.h"
 #include "r_demo.h"
 #include "r_fps.h"
+#include "m_bench.h"
 #include <math.h>
 #include "e6y.h"//e6y
 #include "xs_Float.h"
@@ -116,8 +118,8 @@ int viewport[4];
 float modelMatrix[16];
 float projMatrix[16];
 
-extern const lighttable_t **walllights;
-extern const lighttable_t **walllightsnext;
+extern THREAD_LOCAL const lighttable_t **walllights;
+extern THREAD_LOCAL const lighttable_t **walllightsnext;
 
 //
 // precalculated math tables
@@ -1048,6 +1050,7 @@ static void R_SetupFrame (player_t *player)
 // R_ShowStats
 //
 int rendered_visplanes, rendered_segs, rendered_vissprites;
+int rendered_planebatches, rendered_spritesegs;
 dboolean rendering_stats;
 int renderer_fps = 0;
 
@@ -1061,10 +1064,15 @@ void R_ShowStats(void)
     renderer_fps = 1000 * FPS_FrameCount / (tick - FPS_SavedTick);
     if (rendering_stats)
     {
-      doom_printf((V_GetMode() == VID_MODEGL)
-                  ?"Frame rate %d fps\nWalls %d, Flats %d, Sprites %d"
-                  :"Frame rate %d fps\nSegs %d, Visplanes %d, Sprites %d",
-      renderer_fps, rendered_segs, rendered_visplanes, rendered_vissprites);
+      if (V_GetMode() == VID_MODEGL)
+        doom_printf("Frame rate %d fps\nWalls %d, Flats %d, Sprites %d",
+        renderer_fps, rendered_segs, rendered_visplanes, rendered_vissprites);
+      else
+        doom_printf("Frame rate %d fps\nSegs %d, Visplanes %d (%d batches), Sprites %d"
+                    " (%d drawsegs each)",
+        renderer_fps, rendered_segs, rendered_visplanes, rendered_planebatches,
+        rendered_vissprites,
+        rendered_vissprites ? rendered_spritesegs / rendered_vissprites : 0);
     }
     FPS_SavedTick = tick;
     FPS_FrameCount = 0;
@@ -1074,6 +1082,8 @@ void R_ShowStats(void)
 void R_ClearStats(void)
 {
   rendered_visplanes = 0;
+  rendered_planebatches = 0;
+  rendered_spritesegs = 0;
   rendered_segs = 0;
   rendered_vissprites = 0;
 }
@@ -1088,6 +1098,7 @@ void R_RenderPlayerView (player_t* player)
   r_frame_count++;
 
   R_SetupFrame (player);
+  R_SetupRenderThreads ();
 
   // Clear buffers.
   R_ClearClipSegs ();
@@ -1133,14 +1144,20 @@ void R_RenderPlayerView (player_t* player)
 #endif
 
   // The head node is the last node output.
+  BENCH_START(BENCH_BSP);
   R_RenderBSPNode (numnodes-1);
+  BENCH_STOP(BENCH_BSP);
 
 #ifdef HAVE_NET
   NetUpdate ();
 #endif
 
   if (V_GetMode() != VID_MODEGL)
+  {
+    BENCH_START(BENCH_PLANES);
     R_DrawPlanes();
+    BENCH_STOP(BENCH_PLANES);
+  }
 
   R_ResetColumnBuffer();
 
@@ -1150,8 +1167,10 @@ void R_RenderPlayerView (player_t* player)
 #endif
 
   if (V_GetMode() != VID_MODEGL) {
+    BENCH_START(BENCH_MASKED);
     R_DrawMasked ();
     R_ResetColumnBuffer();
+    BENCH_STOP(BENCH_MASKED);
   }
 
   // Check for new console commands.
@@ -84,6 +84,7 @@ extern fixed_t viewfocratio;
 //
 
 extern int rendered_visplanes, rendered_segs, rendered_vissprites;
+extern int rendered_planebatches, rendered_spritesegs;
 extern dboolean rendering_stats;
 
 //
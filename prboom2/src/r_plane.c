@@ -60,6 +60,8 @@
 #include "r_main.h"
 #include "v_video.h"
 #include "lprintf.h"
+#include "r_segs.h"
+#include "r_threads.h"
 
 #define MAXVISPLANES 128    /* must be a power of 2 */
 
@@ -91,18 +93,35 @@ int *ceilingclip = NULL;
 // e6y: resolution limitation is removed
 static int *spanstart = NULL;                // killough 2/8/98
 
+// Flat visplanes of the frame, sorted by R_DrawPlanes so that planes with
+// the same flat are drawn together and planes that only differ in their
+// columns form one batch (see R_DoDrawFlat)
+static visplane_t **flatplanes = NULL;
+static int numflatplanes, maxflatplanes;
+
+// Span of the current batch waiting on each row, batchstart > batchstop
+// when there is none
+static int *batchstart = NULL;
+static int *batchstop = NULL;
+
+typedef struct {
+  draw_span_vars_t dsvars;
+  dboolean merge;
+  int top, bottom;          // rows that may hold a waiting span
+} span_batch_t;
+
 //
 // texture mapping
 //
 
-static const lighttable_t **planezlight;
-static fixed_t planeheight;
+static THREAD_LOCAL const lighttable_t **planezlight;
+static THREAD_LOCAL fixed_t planeheight;
 
 // killough 2/8/98: make variables static
 
 static fixed_t basexscale, baseyscale;
 static fixed_t *cachedheight = NULL;
-static fixed_t xoffs,yoffs;    // killough 2/28/98: flat offsets
+static THREAD_LOCAL fixed_t xoffs,yoffs;    // killough 2/28/98: flat offsets
 
 // e6y: resolution limitation is removed
 fixed_t *yslope = NULL;
@@ -110,9 +129,13 @@ fixed_t *distscale = NULL;
 
 void R_InitPlanesRes(void)
 {
+  int i;
+
   if (floorclip) free(floorclip);
   if (ceilingclip) free(ceilingclip);
   if (spanstart) free(spanstart);
+  if (batchstart) free(batchstart);
+  if (batchstop) free(batchstop);
 
   if (cachedheight) free(cachedheight);
 
@@ -122,6 +145,10 @@ void R_InitPlanesRes(void)
   floorclip = calloc(1, SCREENWIDTH * sizeof(*floorclip));
   ceilingclip = calloc(1, SCREENWIDTH * sizeof(*ceilingclip));
   spanstart = calloc(1, SCREENHEIGHT * sizeof(*spanstart));
+  batchstart = calloc(1, SCREENHEIGHT * sizeof(*batchstart));
+  batchstop = calloc(1, SCREENHEIGHT * sizeof(*batchstop));
+  for (i = 0; i < SCREENHEIGHT; i++)
+    batchstart[i] = 1;
 
   cachedheight = calloc(1, SCREENHEIGHT * sizeof(*cachedheight));
 
@@ -367,18 +394,76 @@ visplane_t *R_CheckPlane(visplane_t *pl, int start, int stop)
     return R_DupPlane(pl,start,stop);
 }
 
+//
+// R_BatchSpan
+//
+// Spans of planes that share height, flat, light and offsets map the
+// same way, so a span that continues one already waiting on its row is
+// joined to it and drawn with a single R_MapPlane.
+//
+
+static void R_BatchSpan(int y, int x1, int x2, span_batch_t *batch)
+{
+  if (!batch->merge)
+  {
+    R_MapPlane(y, x1, x2, &batch->dsvars);
+    return;
+  }
+
+  if (batchstart[y] <= batchstop[y])
+  {
+    if (x1 == batchstop[y] + 1)
+    {
+      batchstop[y] = x2;
+      return;
+    }
+    if (x2 == batchstart[y] - 1)
+    {
+      batchstart[y] = x1;
+      return;
+    }
+    R_MapPlane(y, batchstart[y], batchstop[y], &batch->dsvars);
+  }
+  else
+  {
+    if (y < batch->top)
+      batch->top = y;
+    if (y > batch->bottom)
+      batch->bottom = y;
+  }
+
+  batchstart[y] = x1;
+  batchstop[y] = x2;
+}
+
+static void R_FlushSpanBatch(span_batch_t *batch)
+{
+  int y;
+
+  for (y = batch->top; y <= batch->bottom; y++)
+    if (batchstart[y] <= batchstop[y])
+    {
+      R_MapPlane(y, batchstart[y], batchstop[y], &batch->dsvars);
+      batchstart[y] = 1;
+      batchstop[y] = 0;
+    }
+
+  batch->top = INT_MAX;
+  batch->bottom = INT_MIN;
+}
+
 //
 // R_MakeSpans
 //
 
 static void R_MakeSpans(int x, unsigned int t1, unsigned int b1,
                         unsigned int t2, unsigned int b2,
-                        draw_span_vars_t *dsvars)
+                        span_batch_t *batch)
 {
   for (; t1 < t2 && t1 <= b1; t1++)
-    R_MapPlane(t1, spanstart[t1], x-1, dsvars);
+    R_BatchSpan(t1, spanstart[t1], x-1, batch);
   for (; b1 > b2 && b1 >= t1; b1--)
-    R_MapPlane(b1, spanstart[b1] ,x-1, dsvars);
+    R_BatchSpan(b1, spanstart[b1] ,x-1, batch);
   while (t2 < t1 && t2 <= b2)
     spanstart[t2++] = x;
   while (b2 > b1 && b2 >= t2)
@@ -386,137 +471,241 @@ static void R_MakeSpans(int x, unsigned int t1, unsigned int b1,
 }
 
 // New function, by Lee Killough
+//
+// Sky planes are drawn by column strips, columns x1..x2.
 
-static void R_DoDrawPlane(visplane_t *pl)
+static void R_DoDrawSky(visplane_t *pl, int x1, int x2)
 {
   register int x;
   draw_column_vars_t dcvars;
   R_DrawColumn_f colfunc = R_GetDrawColumnFunc(RDC_PIPELINE_STANDARD, drawvars.filterwall, drawvars.filterz);
+  int texture;
+  const rpatch_t *tex_patch;
+  angle_t an, flip;
 
   R_SetDefaultDrawColumnVars(&dcvars);
 
-  if (pl->minx <= pl->maxx) {
-    if (pl->picnum == skyflatnum || pl->picnum & PL_SKYFLAT) { // sky flat
-      int texture;
-      const rpatch_t *tex_patch;
-      angle_t an, flip;
+  x1 = MAX(x1, pl->minx);
+  x2 = MIN(x2, pl->maxx);
+  if (x1 > x2)
+    return;
 
-      // killough 10/98: allow skies to come from sidedefs.
-      // Allows scrolling and/or animated skies, as well as
-      // arbitrary multiple skies per level without having
-      // to use info lumps.
+  // killough 10/98: allow skies to come from sidedefs.
+  // Allows scrolling and/or animated skies, as well as
+  // arbitrary multiple skies per level without having
+  // to use info lumps.
 
-      an = viewangle;
+  an = viewangle;
 
-      if (pl->picnum & PL_SKYFLAT)
-      {
-        // Sky Linedef
-        const line_t *l = &lines[pl->picnum & ~PL_SKYFLAT];
+  if (pl->picnum & PL_SKYFLAT)
+  {
+    // Sky Linedef
+    const line_t *l = &lines[pl->picnum & ~PL_SKYFLAT];
 
-        // Sky transferred from first sidedef
-        const side_t *s = *l->sidenum + sides;
+    // Sky transferred from first sidedef
+    const side_t *s = *l->sidenum + sides;
 
-        // Texture comes from upper texture of reference sidedef
-        texture = texturetranslation[s->toptexture];
+    // Texture comes from upper texture of reference sidedef
+    texture = texturetranslation[s->toptexture];
 
-        // Horizontal offset is turned into an angle offset,
-        // to allow sky rotation as well as careful positioning.
-        // However, the offset is scaled very small, so that it
-        // allows a long-period of sky rotation.
+    // Horizontal offset is turned into an angle offset,
+    // to allow sky rotation as well as careful positioning.
+    // However, the offset is scaled very small, so that it
+    // allows a long-period of sky rotation.
 
-        an += s->textureoffset;
+    an += s->textureoffset;
 
-        // Vertical offset allows careful sky positioning.
+    // Vertical offset allows careful sky positioning.
 
-        dcvars.texturemid = s->rowoffset - 28*FRACUNIT;
+    dcvars.texturemid = s->rowoffset - 28*FRACUNIT;
 
-        // We sometimes flip the picture horizontally.
-        //
-        // Doom always flipped the picture, so we make it optional,
-        // to make it easier to use the new feature, while to still
-        // allow old sky textures to be used.
+    // We sometimes flip the picture horizontally.
+    //
+    // Doom always flipped the picture, so we make it optional,
+    // to make it easier to use the new feature, while to still
+    // allow old sky textures to be used.
 
-        flip = l->special==272 ? 0u : ~0u;
+    flip = l->special==272 ? 0u : ~0u;
 
-        if (skystretch)
-        {
-          int skyheight = textureheight[texture]>>FRACBITS;
-          dcvars.texturemid = (int)((int_64_t)dcvars.texturemid * skyheight / SKYSTRETCH_HEIGHT);
-        }
-      }
-      else
-      {    // Normal Doom sky, only one allowed per level
-        dcvars.texturemid = skytexturemid;    // Default y-offset
-        texture = skytexture;             // Default texture
-        flip = 0;                         // Doom flips it
-      }
+    if (skystretch)
+    {
+      int skyheight = textureheight[texture]>>FRACBITS;
+      dcvars.texturemid = (int)((int_64_t)dcvars.texturemid * skyheight / SKYSTRETCH_HEIGHT);
+    }
+  }
+  else
+  {    // Normal Doom sky, only one allowed per level
+    dcvars.texturemid = skytexturemid;    // Default y-offset
+    texture = skytexture;             // Default texture
+    flip = 0;                         // Doom flips it
+  }
 
-      /* Sky is always drawn full bright, i.e. colormaps[0] is used.
-       * Because of this hack, sky is not affected by INVUL inverse mapping.
-       * Until Boom fixed this. Compat option added in MBF. */
+  /* Sky is always drawn full bright, i.e. colormaps[0] is used.
+   * Because of this hack, sky is not affected by INVUL inverse mapping.
+   * Until Boom fixed this. Compat option added in MBF. */
 
-      if (comp[comp_skymap] || !(dcvars.colormap = fixedcolormap))
-        dcvars.colormap = fullcolormap;          // killough 3/20/98
+  if (comp[comp_skymap] || !(dcvars.colormap = fixedcolormap))
+    dcvars.colormap = fullcolormap;          // killough 3/20/98
 
-      dcvars.nextcolormap = dcvars.colormap; // for filtering -- POPE
+  dcvars.nextcolormap = dcvars.colormap; // for filtering -- POPE
 
-      //dcvars.texturemid = skytexturemid;
-      dcvars.texheight = textureheight[texture]>>FRACBITS; // killough
-      
-      // proff 09/21/98: Changed for high-res
-      
-      // e6y
-      // disable sky texture scaling if status bar is used
-      // old code: dcvars.iscale = FRACUNIT*200/viewheight;
-      dcvars.iscale = skyiscale;
+  //dcvars.texturemid = skytexturemid;
+  dcvars.texheight = textureheight[texture]>>FRACBITS; // killough
+  
+  // proff 09/21/98: Changed for high-res
+  
+  // e6y
+  // disable sky texture scaling if status bar is used
+  // old code: dcvars.iscale = FRACUNIT*200/viewheight;
+  dcvars.iscale = skyiscale;
 
-      tex_patch = R_CacheTextureCompositePatchNum(texture);
+  R_LockRenderCache();
+  tex_patch = R_CacheTextureCompositePatchNum(texture);
+  R_UnlockRenderCache();
 
   // killough 10/98: Use sky scrolling offset, and possibly flip picture
-        for (x = pl->minx; (dcvars.x = x) <= pl->maxx; x++)
-          if ((dcvars.yl = pl->top[x]) != SHRT_MAX && dcvars.yl <= (dcvars.yh = pl->bottom[x])) // dropoff overflow
-            {
-              dcvars.source = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x])^flip) >> ANGLETOSKYSHIFT);
-              dcvars.prevsource = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x-1])^flip) >> ANGLETOSKYSHIFT);
-              dcvars.nextsource = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x+1])^flip) >> ANGLETOSKYSHIFT);
-              colfunc(&dcvars);
-            }
+  for (x = x1; (dcvars.x = x) <= x2; x++)
+    if ((dcvars.yl = pl->top[x]) != SHRT_MAX && dcvars.yl <= (dcvars.yh = pl->bottom[x])) // dropoff overflow
+      {
+        dcvars.source = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x])^flip) >> ANGLETOSKYSHIFT);
+        dcvars.prevsource = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x-1])^flip) >> ANGLETOSKYSHIFT);
+        dcvars.nextsource = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x+1])^flip) >> ANGLETOSKYSHIFT);
+        colfunc(&dcvars);
+      }
+
+  R_LockRenderCache();
+  R_UnlockTextureCompositePatchNum(texture);
+  R_UnlockRenderCache();
+}
+
+//
+// Flats are drawn by row bands, rows y1..y2. Clamping every column of the
+// plane to the band gives exactly the spans of the full plane that lie in
+// it, so the output does not depend on the number of bands.
+//
+// flatplanes[first..last] is a batch of planes that only differ in their
+// columns. With z-dithering a span's dither pattern depends on where it
+// starts, so spans are only joined without it.
+//
 
-      R_UnlockTextureCompositePatchNum(texture);
+#define BAND_TOP(t) ((t) < y1 ? y1 : (t))
+#define BAND_BOTTOM(b) ((b) > y2 ? y2 : (b))
 
-    } else {     // regular flat
+static void R_DoDrawFlat(int first, int last, unsigned int y1, unsigned int y2)
+{
+  visplane_t *pl = flatplanes[first];
+  register int x;
+  int i, stop, light;
+  span_batch_t batch;
 
-      int stop, light;
-      draw_span_vars_t dsvars;
+  R_LockRenderCache();
+  batch.dsvars.source = W_CacheLumpNum(firstflat + flattranslation[pl->picnum]);
+  R_UnlockRenderCache();
 
-      dsvars.source = W_CacheLumpNum(firstflat + flattranslation[pl->picnum]);
+  xoffs = pl->xoffs;  // killough 2/28/98: Add offsets
+  yoffs = pl->yoffs;
+  planeheight = D_abs(pl->height-viewz);
 
-      xoffs = pl->xoffs;  // killough 2/28/98: Add offsets
-      yoffs = pl->yoffs;
-      planeheight = D_abs(pl->height-viewz);
+  // SoM 10/19/02: deep water colormap fix
+  if(fixedcolormap)
+    light = (255  >> LIGHTSEGSHIFT);
+  else
+    light = (pl->lightlevel >> LIGHTSEGSHIFT) + (extralight * LIGHTBRIGHT);
 
-      // SoM 10/19/02: deep water colormap fix
-      if(fixedcolormap)
-        light = (255  >> LIGHTSEGSHIFT);
-      else
-        light = (pl->lightlevel >> LIGHTSEGSHIFT) + (extralight * LIGHTBRIGHT);
+  if(light >= LIGHTLEVELS)
+    light = LIGHTLEVELS-1;
 
-      if(light >= LIGHTLEVELS)
-        light = LIGHTLEVELS-1;
+  if(light < 0)
+    light = 0;
 
-      if(light < 0)
-        light = 0;
+  planezlight = zlight[light];
 
-      stop = pl->maxx + 1;
-      planezlight = zlight[light];
-      pl->top[pl->minx-1] = pl->top[stop] = SHRT_MAX; // dropoff overflow
+  // the dithered filters pick their pattern from where each span starts,
+  // so only spans drawn without them can be joined and stay the same
+  batch.merge = (drawvars.filterz != RDRAW_FILTER_LINEAR &&
+                 !(V_GetMode() == VID_MODE8 && drawvars.filterfloor == RDRAW_FILTER_LINEAR));
+  batch.top = INT_MAX;
+  batch.bottom = INT_MIN;
 
-      for (x = pl->minx ; x <= stop ; x++)
-         R_MakeSpans(x,pl->top[x-1],pl->bottom[x-1],
-                     pl->top[x],pl->bottom[x], &dsvars);
+  for (i = first; i <= last; i++)
+  {
+    pl = flatplanes[i];
+    stop = pl->maxx + 1;
 
-      W_UnlockLumpNum(firstflat + flattranslation[pl->picnum]);
-    }
+    // the dropoff overflow sentinels are set by R_DrawPlanes
+    for (x = pl->minx ; x <= stop ; x++)
+       R_MakeSpans(x,BAND_TOP(pl->top[x-1]),BAND_BOTTOM(pl->bottom[x-1]),
+                   BAND_TOP(pl->top[x]),BAND_BOTTOM(pl->bottom[x]), &batch);
+  }
+
+  R_FlushSpanBatch(&batch);
+
+  R_LockRenderCache();
+  W_UnlockLumpNum(firstflat + flattranslation[pl->picnum]);
+  R_UnlockRenderCache();
+}
+
+#undef BAND_TOP
+#undef BAND_BOTTOM
+
+// Nonzero if two flat planes can not share a batch
+static int R_ComparePlaneBatch(const visplane_t *a, const visplane_t *b)
+{
+  if (a->picnum != b->picnum)
+    return a->picnum < b->picnum ? -1 : 1;
+  if (a->lightlevel != b->lightlevel)
+    return a->lightlevel < b->lightlevel ? -1 : 1;
+  if (a->height != b->height)
+    return a->height < b->height ? -1 : 1;
+  if (a->xoffs != b->xoffs)
+    return a->xoffs < b->xoffs ? -1 : 1;
+  if (a->yoffs != b->yoffs)
+    return a->yoffs < b->yoffs ? -1 : 1;
+  return 0;
+}
+
+// Batch order, then left to right so that spans continue each other
+static int C_DECL R_SortPlanes(const void *a, const void *b)
+{
+  const visplane_t *pa = *(const visplane_t *const *)a;
+  const visplane_t *pb = *(const visplane_t *const *)b;
+  int cmp = R_ComparePlaneBatch(pa, pb);
+
+  if (cmp)
+    return cmp;
+  return pa->minx - pb->minx;
+}
+
+static void R_DrawPlanesStrip(int part, int parts)
+{
+  visplane_t *pl;
+  int i, x1, x2;
+
+  R_GetRenderStrip(part, parts, &x1, &x2);
+
+  // walls queued by R_RenderSegLoop, then the sky
+  R_DrawSegColumns(part);
+
+  for (i=0;i<MAXVISPLANES;i++)
+    for (pl=visplanes[i]; pl; pl=pl->next)
+      if (pl->picnum == skyflatnum || pl->picnum & PL_SKYFLAT)
+        R_DoDrawSky(pl, x1, x2);
+
+  R_ResetColumnBuffer();
+}
+
+static void R_DrawPlanesBand(int part, int parts)
+{
+  int first, last, y1, y2;
+
+  R_GetRenderBand(part, parts, &y1, &y2);
+
+  for (first = 0; first < numflatplanes; first = last + 1)
+  {
+    for (last = first; last + 1 < numflatplanes; last++)
+      if (R_ComparePlaneBatch(flatplanes[first], flatplanes[last + 1]))
+        break;
+    R_DoDrawFlat(first, last, y1, y2);
   }
 }
 
@@ -529,7 +718,30 @@ void R_DrawPlanes (void)
 {
   visplane_t *pl;
   int i;
+
+  numflatplanes = 0;
+
   for (i=0;i<MAXVISPLANES;i++)
     for (pl=visplanes[i]; pl; pl=pl->next, rendered_visplanes++)
-      R_DoDrawPlane(pl);
+      if (!(pl->picnum == skyflatnum || pl->picnum & PL_SKYFLAT) && pl->minx <= pl->maxx)
+      {
+        pl->top[pl->minx-1] = pl->top[pl->maxx+1] = SHRT_MAX; // dropoff overflow
+
+        if (numflatplanes == maxflatplanes)
+        {
+          maxflatplanes = maxflatplanes ? maxflatplanes*2 : 128;
+          flatplanes = realloc(flatplanes, maxflatplanes * sizeof(*flatplanes));
+        }
+        flatplanes[numflatplanes++] = pl;
+      }
+
+  // group planes by flat, then by everything R_MapPlane depends on
+  qsort(flatplanes, numflatplanes, sizeof(*flatplanes), R_SortPlanes);
+
+  for (i = 0; i < numflatplanes; i++)
+    if (!i || R_ComparePlaneBatch(flatplanes[i-1], flatplanes[i]))
+      rendered_planebatches++;
+
+  R_RunRenderThreads(R_DrawPlanesStrip, r_renderparts);
+  R_RunRenderThreads(R_DrawPlanesBand, r_renderparts);
 }
@@ -48,6 +48,7 @@
 #include "w_wad.h"
 #include "v_video.h"
 #include "lprintf.h"
+#include "r_threads.h"
 
 // OPTIMIZE: closed two sided lines as single sided
 
@@ -67,8 +68,8 @@ static fixed_t  toptexheight, midtexheight, bottomtexheight; // cph
 angle_t         rw_normalangle; // angle to line origin
 int             rw_angle1;
 fixed_t         rw_distance;
-const lighttable_t    **walllights;
-const lighttable_t    **walllightsnext;
+THREAD_LOCAL const lighttable_t    **walllights;
+THREAD_LOCAL const lighttable_t    **walllightsnext;
 
 //
 // regular wall
@@ -78,11 +79,11 @@ static int      rw_stopx;
 static angle_t  rw_centerangle;
 static fixed_t  rw_offset;
 static fixed_t  rw_scale;
-static fixed_t  rw_scalestep;
+static THREAD_LOCAL fixed_t  rw_scalestep;
 static fixed_t  rw_midtexturemid;
 static fixed_t  rw_toptexturemid;
 static fixed_t  rw_bottomtexturemid;
-static int      rw_lightlevel;
+static THREAD_LOCAL int      rw_lightlevel;
 static int      worldtop;
 static int      worldbottom;
 static int      worldhigh;
@@ -95,7 +96,7 @@ static int_64_t  topfrac; // R_WiggleFix
 static fixed_t  topstep;
 static int_64_t  bottomfrac; // R_WiggleFix
 static fixed_t  bottomstep;
-static int      *maskedtexturecol; // dropoff overflow
+static THREAD_LOCAL int      *maskedtexturecol; // dropoff overflow
 
 static int	max_rwscale = 64 * FRACUNIT;
 static int	HEIGHTBITS = 12;
@@ -273,7 +274,11 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
       colfunc = R_GetDrawColumnFunc(RDC_PIPELINE_TRANSLUCENT, drawvars.filterwall, drawvars.filterz);
       tranmap = main_tranmap;
       if (curline->linedef->tranlump > 0)
+      {
+        R_LockRenderCache();
         tranmap = W_CacheLumpNum(curline->linedef->tranlump-1);
+        R_UnlockRenderCache();
+      }
     }
   // killough 4/11/98: end translucent 2s normal code
 
@@ -318,7 +323,9 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
     dcvars.nextcolormap = dcvars.colormap; // for filtering -- POPE
   }
 
+  R_LockRenderCache();
   patch = R_CacheTextureCompositePatchNum(texnum);
+  R_UnlockRenderCache();
 
   // draw the columns
   for (dcvars.x = x1 ; dcvars.x <= x2 ; dcvars.x++, spryscale += rw_scalestep)
@@ -390,15 +397,71 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
         maskedtexturecol[dcvars.x] = INT_MAX; // dropoff overflow
       }
 
+  R_LockRenderCache();
+
   // Except for main_tranmap, mark others purgable at this point
   if (curline->linedef->tranlump > 0 && general_translucency)
     W_UnlockLumpNum(curline->linedef->tranlump-1); // cph - unlock it
 
   R_UnlockTextureCompositePatchNum(texnum);
 
+  R_UnlockRenderCache();
+
   curline = NULL; /* cph 2001/11/18 - must clear curline now we're done with it, so R_ColourMap doesn't try using it for other things */
 }
 
+//
+// When the frame is split between render threads, R_RenderSegLoop queues
+// its wall columns by strip instead of drawing them, and each thread draws
+// its own strip with R_DrawSegColumns. The texture columns stay valid until
+// then, as cached lumps are only purged between frames.
+//
+
+typedef struct
+{
+  R_DrawColumn_f colfunc;
+  draw_column_vars_t dcvars;
+} segcolumn_t;
+
+static struct
+{
+  segcolumn_t *columns;
+  int count, size;
+} segcolumns[MAX_RENDER_THREADS];
+
+static int segstripwidth;
+
+static void R_DrawSegColumn(R_DrawColumn_f colfunc, draw_column_vars_t *dcvars)
+{
+  if (r_renderparts > 1)
+  {
+    int part = dcvars->x / segstripwidth;
+
+    if (segcolumns[part].count == segcolumns[part].size)
+    {
+      segcolumns[part].size = segcolumns[part].size ? segcolumns[part].size * 2 : 1024;
+      segcolumns[part].columns = realloc(segcolumns[part].columns,
+        segcolumns[part].size * sizeof(segcolumns[part].columns[0]));
+    }
+    segcolumns[part].columns[segcolumns[part].count].colfunc = colfunc;
+    segcolumns[part].columns[segcolumns[part].count].dcvars = *dcvars;
+    segcolumns[part].count++;
+  }
+  else
+  {
+    colfunc(dcvars);
+  }
+}
+
+void R_DrawSegColumns(int part)
+{
+  int i;
+
+  for (i = 0; i < segcolumns[part].count; i++)
+    segcolumns[part].columns[i].colfunc(&segcolumns[part].columns[i].dcvars);
+  segcolumns[part].count = 0;
+}
+
 //
 // R_RenderSegLoop
 // Draws zero, one, or two textures (and possibly a masked texture) for walls.
@@ -417,6 +480,8 @@ static void R_RenderSegLoop (void)
 
   R_SetDefaultDrawColumnVars(&dcvars);
 
+  segstripwidth = R_RenderStripWidth(r_renderparts);
+
   rendered_segs++;
   for ( ; rw_x < rw_stopx ; rw_x++)
     {
@@ -513,7 +578,7 @@ static void R_RenderSegLoop (void)
           dcvars.prevsource = R_GetTextureColumn(tex_patch, texturecolumn-1);
           dcvars.nextsource = R_GetTextureColumn(tex_patch, texturecolumn+1);
           dcvars.texheight = midtexheight;
-          colfunc(&dcvars);
+          R_DrawSegColumn(colfunc, &dcvars);
           R_UnlockTextureCompositePatchNum(midtexture);
           tex_patch = NULL;
           ceilingclip[rw_x] = viewheight;
@@ -542,7 +607,7 @@ static void R_RenderSegLoop (void)
                   dcvars.prevsource = R_GetTextureColumn(tex_patch,texturecolumn-1);
                   dcvars.nextsource = R_GetTextureColumn(tex_patch,texturecolumn+1);
                   dcvars.texheight = toptexheight;
-                  colfunc(&dcvars);
+                  R_DrawSegColumn(colfunc, &dcvars);
                   R_UnlockTextureCompositePatchNum(toptexture);
                   tex_patch = NULL;
                   ceilingclip[rw_x] = mid;
@@ -576,7 +641,7 @@ static void R_RenderSegLoop (void)
                   dcvars.prevsource = R_GetTextureColumn(tex_patch, texturecolumn-1);
                   dcvars.nextsource = R_GetTextureColumn(tex_patch, texturecolumn+1);
                   dcvars.texheight = bottomtexheight;
-                  colfunc(&dcvars);
+                  R_DrawSegColumn(colfunc, &dcvars);
                   R_UnlockTextureCompositePatchNum(bottomtexture);
                   tex_patch = NULL;
                   floorclip[rw_x] = mid;
@@ -40,6 +40,7 @@ extern "C" {
 
 void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2);
 void R_StoreWallRange(const int start, const int stop);
+void R_DrawSegColumns(int part);
 
 #ifdef __cplusplus
 }  // extern "C"
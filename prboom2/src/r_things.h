@@ -52,10 +52,10 @@ extern int *screenheightarray; /* change to MAX_*  */ // dropoff overflow
 
 /* Vars for R_DrawMaskedColumn */
 
-extern int     *mfloorclip;    // dropoff overflow
-extern int     *mceilingclip;  // dropoff overflow
-extern fixed_t spryscale;
-extern int_64_t sprtopscreen;
+extern THREAD_LOCAL int     *mfloorclip;    // dropoff overflow
+extern THREAD_LOCAL int     *mceilingclip;  // dropoff overflow
+extern THREAD_LOCAL fixed_t spryscale;
+extern THREAD_LOCAL int_64_t sprtopscreen;
 extern fixed_t pspriteiscale;
 /* proff 11/06/98: Added for high-res */
 extern fixed_t pspritexscale;
@@ -72,6 +72,7 @@ typedef enum {
   DOOM_ORDER_LAST
 } sprite_doom_order_t;
 extern int sprites_doom_order;
+extern int sprites_radix_sort;
 
 extern int health_bar;
 extern int health_bar_full_length;
@@ -0,0 +1,165 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Thread pool for the software renderer.
+ *
+ *  Worker n always draws part n of a frame, the caller draws part 0. The
+ *  workers are started on the first threaded frame and live until the
+ *  process exits; between jobs they wait on a condition variable.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "r_threads.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "v_video.h"
+
+int render_threads;
+int r_renderparts = 1;
+
+namespace {
+
+struct render_pool_t {
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  void (*job)(int, int) = nullptr;
+  int parts = 0;
+  int pending = 0;
+  unsigned generation = 0;
+  int workers = 0;
+};
+
+// Never destroyed: the detached workers may still be waiting on it while
+// the process exits
+render_pool_t& pool = *new render_pool_t;
+std::mutex& cache_mutex = *new std::mutex;
+
+void RenderWorker(const int part) {
+  unsigned seen = 0;
+  std::unique_lock lock{pool.mutex};
+
+  for (;;) {
+    pool.start.wait(lock, [&] { return pool.generation != seen; });
+    seen = pool.generation;
+    if (part >= pool.parts)
+      continue;
+
+    const auto job = pool.job;
+    const int parts = pool.parts;
+
+    lock.unlock();
+    R_SelectColumnBuffer(part);
+    job(part, parts);
+    lock.lock();
+
+    if (--pool.pending == 0)
+      pool.done.notify_one();
+  }
+}
+
+}  // namespace
+
+void R_SetupRenderThreads(void) {
+  int threads = render_threads;
+
+  if (threads <= 0)
+    threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  threads = std::clamp(threads, 1, MAX_RENDER_THREADS);
+
+  // a strip is at least four columns wide
+  threads = std::min(threads, std::max(1, viewwidth / 4));
+
+  if (V_GetMode() == VID_MODEGL)
+    threads = 1;
+
+  for (; pool.workers < threads - 1; pool.workers++)
+    std::thread{RenderWorker, pool.workers + 1}.detach();
+
+  r_renderparts = threads;
+}
+
+void R_RunRenderThreads(void (*job)(int part, int parts), const int parts) {
+  if (parts > 1) {
+    {
+      std::lock_guard lock{pool.mutex};
+      pool.job = job;
+      pool.parts = parts;
+      pool.pending = parts - 1;
+      pool.generation++;
+    }
+    pool.start.notify_all();
+  }
+
+  R_SelectColumnBuffer(0);
+  job(0, parts);
+
+  if (parts > 1) {
+    std::unique_lock lock{pool.mutex};
+    pool.done.wait(lock, [] { return pool.pending == 0; });
+  }
+}
+
+void R_LockRenderCache(void) {
+  if (r_renderparts > 1)
+    cache_mutex.lock();
+}
+
+void R_UnlockRenderCache(void) {
+  if (r_renderparts > 1)
+    cache_mutex.unlock();
+}
+
+int R_RenderStripWidth(const int parts) {
+  return ((viewwidth + parts - 1) / parts + 3) & ~3;
+}
+
+void R_GetRenderStrip(const int part, const int parts, int* const x1, int* const x2) {
+  const int width = R_RenderStripWidth(parts);
+
+  *x1 = part * width;
+  *x2 = std::min((part + 1) * width, viewwidth) - 1;
+}
+
+void R_GetRenderBand(const int part, const int parts, int* const y1, int* const y2) {
+  const int height = (viewheight + parts - 1) / parts;
+
+  *y1 = part * height;
+  *y2 = std::min((part + 1) * height, viewheight) - 1;
+}
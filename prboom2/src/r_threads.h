@@ -0,0 +1,72 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Thread pool for the software renderer.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#ifndef __R_THREADS__
+#define __R_THREADS__
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+#define MAX_RENDER_THREADS 16
+
+/* render_threads config: 0 = one per CPU core, 1 = render on the main thread */
+extern int render_threads;
+
+/* Number of parts the current frame is split into, 1 when not threaded */
+extern int r_renderparts;
+
+/* Chooses r_renderparts for the next frame and starts the pool if needed */
+void R_SetupRenderThreads(void);
+
+/* Runs job(part, parts) for every part, part 0 on the calling thread,
+ * and returns once all of them have finished */
+void R_RunRenderThreads(void (*job)(int part, int parts), int parts);
+
+/* Serialises the lump and texture cache while render threads are running */
+void R_LockRenderCache(void);
+void R_UnlockRenderCache(void);
+
+/* Columns x1..x2 of the view drawn by one part: strips are multiples of
+ * four columns wide so the column buffer can still flush in quads */
+void R_GetRenderStrip(int part, int parts, int *x1, int *x2);
+int R_RenderStripWidth(int parts);
+
+/* Rows y1..y2 of the view drawn by one part */
+void R_GetRenderBand(int part, int parts, int *y1, int *y2);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif
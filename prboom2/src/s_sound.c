@@ -156,7 +156,10 @@ void S_Init(int sfxVolume, int musicVolume)
       sfx->lumpnum = I_GetSfxLumpNum(sfx);
 
       if (sfx->lumpnum >= 0)
+      {
         W_LockLumpNum(sfx->lumpnum);
+        I_PrecacheSound(sfx->lumpnum);
+      }
     }
   }
 
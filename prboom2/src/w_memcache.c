@@ -132,6 +132,26 @@ const void *W_LockLumpNum(int lump)
   return W_CacheLumpNum(lump);
 }
 
+/* W_TouchLumpNum
+ *
+ * Reading a lump in allocates zone memory, which only the main thread may
+ * do, so lumps can't be streamed in the background with this backend
+ */
+
+dboolean W_TouchLumpNum(int lump)
+{
+  return false;
+}
+
+/* W_WillNeedLumpNum
+ *
+ * Lumps are only read in on demand here, there is nothing to prefetch
+ */
+
+void W_WillNeedLumpNum(int lump)
+{
+}
+
 /*
  * W_UnlockLumpNum
  *
@@ -48,6 +48,7 @@
 #include "doomtype.h"
 
 #include "w_wad.h"
+#include "w_stream.h"
 #include "z_zone.h"
 #include "lprintf.h"
 #include "i_system.h"
@@ -84,7 +85,7 @@ static void W_ReportLocks(void)
   {
     for (i=0; i<numlumps; i++)
     {
-      if (cachelump[i].locks > 0)
+      if (cachelump[i].locks)
       {
         lprintf(LO_DEBUG, "%8.8s %6u %2d   %6d\n", lumpinfo[i].name,
         W_LumpLength(i), cachelump[i].locks, gametic - cachelump[i].locktic);
@@ -170,8 +171,6 @@ void W_InitCache(void)
     {
       int wad_index = (int)(lumpinfo[i].wadfile-wadfiles);
 
-      cachelump[i].locks = -1;
-
       if (!lumpinfo[i].wadfile)
         continue;
 #ifdef RANGECHECK
@@ -213,23 +212,43 @@ void W_InitCache(void)
   }
 }
 
+static const byte *W_MappedLump(int lump)
+{
+  if (!lumpinfo[lump].wadfile)
+    return NULL;
+  return (const byte *)mapped_wad[lumpinfo[lump].wadfile-wadfiles].data + lumpinfo[lump].position;
+}
+
 const void* W_CacheLumpNum(int lump)
 {
-  int wad_index = (int)(lumpinfo[lump].wadfile-wadfiles);
 #ifdef RANGECHECK
+  int wad_index = (int)(lumpinfo[lump].wadfile-wadfiles);
   if ((wad_index<0)||((size_t)wad_index>=numwadfiles))
     I_Error("W_CacheLumpNum: wad_index out of range");
   if ((unsigned)lump >= (unsigned)numlumps)
     I_Error ("W_CacheLumpNum: %i >= numlumps",lump);
 #endif
-  if (!lumpinfo[lump].wadfile)
-    return NULL;
-  return (void*)((unsigned char *)mapped_wad[wad_index].data+lumpinfo[lump].position);
+  if (lumpstreaming)
+    W_StreamWaitLump(lump);
+  return W_MappedLump(lump);
+}
+
+void W_WillNeedLumpNum(int lump)
+{
 }
 
 #else
 
-void ** mapped_wad;
+typedef struct {
+  void   *data;
+  size_t size;
+} mmap_info_t;
+
+// Indexed by file descriptor, so every lump from one WAD shares one mapping
+static mmap_info_t *mapped_wad;
+static int mapped_wads;
+static size_t pagesize;
+static char empty_wad[1];  // stands in for the mapping of an empty file
 
 void W_InitCache(void)
 {
@@ -243,22 +262,30 @@ void W_InitCache(void)
   I_AtExit(W_ReportLocks, true);
 #endif
 
+  pagesize = sysconf(_SC_PAGESIZE);
+
   {
     int i;
     for (i=0; i<numlumps; i++)
       if (lumpinfo[i].wadfile)
         if (lumpinfo[i].wadfile->handle > maxfd) maxfd = lumpinfo[i].wadfile->handle;
   }
-  mapped_wad = calloc(maxfd+1,sizeof *mapped_wad);
+  mapped_wads = maxfd+1;
+  mapped_wad = calloc(mapped_wads,sizeof *mapped_wad);
   {
     int i;
     for (i=0; i<numlumps; i++) {
-      cachelump[i].locks = -1;
       if (lumpinfo[i].wadfile) {
         int fd = lumpinfo[i].wadfile->handle;
-        if (!mapped_wad[fd])
-          if ((mapped_wad[fd] = mmap(NULL,I_Filelength(fd),PROT_READ,MAP_SHARED,fd,0)) == MAP_FAILED) 
-            I_Error("W_InitCache: failed to mmap");
+        if (!mapped_wad[fd].data) {
+          // mmap refuses empty files, whose only lump is empty anyway
+          size_t size = I_Filelength(fd);
+          void *data = size ? mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0) : empty_wad;
+          if (data == MAP_FAILED)
+            I_Error("W_InitCache: failed to mmap %s", lumpinfo[i].wadfile->name);
+          mapped_wad[fd].data = data;
+          mapped_wad[fd].size = size;
+        }
       }
     }
   }
@@ -266,20 +293,33 @@ void W_InitCache(void)
 
 void W_DoneCache(void)
 {
-  {
-    int i;
-    for (i=0; i<numlumps; i++)
-      if (lumpinfo[i].wadfile) {
-        int fd = lumpinfo[i].wadfile->handle;
-        if (mapped_wad[fd]) {
-          if (munmap(mapped_wad[fd],I_Filelength(fd))) 
-            I_Error("W_DoneCache: failed to munmap");
-          mapped_wad[fd] = NULL;
-        }
-      }
+  int fd;
+
+  if (cachelump) {
+    free(cachelump);
+    cachelump = NULL;
   }
+
+  if (!mapped_wad)
+    return;
+  for (fd=0; fd<mapped_wads; fd++)
+    if (mapped_wad[fd].size) {
+      if (munmap(mapped_wad[fd].data,mapped_wad[fd].size))
+        I_Error("W_DoneCache: failed to munmap");
+    }
   free(mapped_wad);
   mapped_wad = NULL;
+  mapped_wads = 0;
+}
+
+static const byte *W_MappedLump(int lump)
+{
+  if (!lumpinfo[lump].wadfile)
+    return NULL;
+
+  return
+    (const byte *) (mapped_wad[lumpinfo[lump].wadfile->handle].data)
+    + lumpinfo[lump].position;
 }
 
 const void* W_CacheLumpNum(int lump)
@@ -288,60 +328,99 @@ const void* W_CacheLumpNum(int lump)
   if ((unsigned)lump >= (unsigned)numlumps)
     I_Error ("W_CacheLumpNum: %i >= numlumps",lump);
 #endif
-  if (!lumpinfo[lump].wadfile)
-    return NULL;
+  if (lumpstreaming)
+    W_StreamWaitLump(lump);
+  return W_MappedLump(lump);
+}
 
-  return
-    (const void *) (
-      ((const byte *) (mapped_wad[lumpinfo[lump].wadfile->handle]))
-      + lumpinfo[lump].position
-    );
+/*
+ * W_WillNeedLumpNum
+ *
+ * Asks the kernel to start reading the lump's pages in, so the first
+ * W_CacheLumpNum access doesn't stall on disk
+ */
+void W_WillNeedLumpNum(int lump)
+{
+  const lumpinfo_t *l;
+  size_t start, end;
+
+#ifdef RANGECHECK
+  if ((unsigned)lump >= (unsigned)numlumps)
+    I_Error ("W_WillNeedLumpNum: %i >= numlumps",lump);
+#endif
+  l = &lumpinfo[lump];
+  if (!l->wadfile || l->size <= 0)
+    return;
+
+#ifdef MADV_WILLNEED
+  // madvise needs a page aligned start
+  start = (size_t)l->position & ~(pagesize - 1);
+  end = (size_t)l->position + l->size;
+  madvise((byte *)mapped_wad[l->wadfile->handle].data + start, end - start, MADV_WILLNEED);
+#endif
 }
 #endif
 
+/*
+ * W_TouchLumpNum
+ *
+ * Reads every page of the lump so it's resident before anything caches
+ * it. Unlike W_CacheLumpNum this is safe on any thread, which is what
+ * lets w_stream.cpp read lumps in on a worker
+ */
+dboolean W_TouchLumpNum(int lump)
+{
+  const volatile byte *data = W_MappedLump(lump);
+  int len = lumpinfo[lump].size;
+  int i;
+
+  if (data && len > 0)
+  {
+    for (i = 0; i < len; i += 4096)
+      (void)data[i];
+    (void)data[len - 1];
+  }
+  return true;
+}
+
 /*
  * W_LockLumpNum
  *
  * This copies the lump into a malloced memory region and returns its address
- * instead of returning a pointer into the memory mapped area
+ * instead of returning a pointer into the memory mapped area. Only lumps
+ * read outside the main thread (sounds, OPL instruments) need this; the
+ * rest should use W_CacheLumpNum, which doesn't duplicate the lump
  *
  */
 const void* W_LockLumpNum(int lump)
 {
-  size_t len = W_LumpLength(lump);
-  const void *data = W_CacheLumpNum(lump);
-
   if (!cachelump[lump].cache) {
     // read the lump in
+    size_t len = W_LumpLength(lump);
     Z_Malloc(len, PU_CACHE, &cachelump[lump].cache);
-    memcpy(cachelump[lump].cache, data, len);
+    memcpy(cachelump[lump].cache, W_CacheLumpNum(lump), len);
   }
 
   /* cph - if wasn't locked but now is, tell z_zone to hold it */
-  if (cachelump[lump].locks <= 0) {
+  if (!cachelump[lump].locks) {
     Z_ChangeTag(cachelump[lump].cache,PU_STATIC);
 #ifdef TIMEDIAG
     cachelump[lump].locktic = gametic;
 #endif
-    // reset lock counter
-    cachelump[lump].locks = 1;
-  } else {
-    // increment lock counter
-    cachelump[lump].locks += 1;
   }
+  cachelump[lump].locks += 1;
 
   return cachelump[lump].cache;
 }
 
 void W_UnlockLumpNum(int lump) {
-  if (cachelump[lump].locks == -1)
-    return; // this lump is memory mapped
+  if (!cachelump[lump].locks)
+    return; // only ever cached, which points into the memory mapped area
 
   cachelump[lump].locks -= 1;
   /* cph - Note: must only tell z_zone to make purgeable if currently locked,
    * else it might already have been purged
    */
-  if (cachelump[lump].locks == 0)
+  if (!cachelump[lump].locks)
     Z_ChangeTag(cachelump[lump].cache, PU_CACHE);
 }
-
@@ -0,0 +1,165 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Background streaming of WAD lumps.
+ *
+ *  A worker thread walks a list of lumps in priority order and reads each
+ *  one in with W_TouchLumpNum. Whoever caches a lump the worker hasn't
+ *  reached yet reads that one lump in itself, so it never waits for the
+ *  lumps queued ahead of it; only a lump the worker is reading right then
+ *  is waited on.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "w_stream.h"
+#include "w_wad.h"
+#include "lprintf.h"
+
+int lumpstreaming;
+
+namespace {
+
+enum lumpstate_t : unsigned char {
+  ls_none,     // not in the stream
+  ls_queued,   // waiting for the worker
+  ls_reading,  // being read in
+  ls_ready,    // read in, not used yet
+  ls_used,     // cached since the stream started
+};
+
+struct lump_stream_t {
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable read;
+  std::atomic<bool> stop = false;
+  std::vector<int> lumps;
+  std::vector<std::atomic<unsigned char>> state;
+  int streamed = 0;  // only touched by the worker until it's joined
+  int ready = 0;
+  int waited = 0;
+};
+
+// Never destroyed, so a stream still running when the process exits is
+// just abandoned
+lump_stream_t& stream = *new lump_stream_t;
+
+void StreamWorker() {
+  for (const int lump : stream.lumps) {
+    if (stream.stop.load(std::memory_order_relaxed))
+      break;
+
+    unsigned char expected = ls_queued;
+    if (!stream.state[lump].compare_exchange_strong(expected, ls_reading))
+      continue;
+
+    W_TouchLumpNum(lump);
+    stream.streamed++;
+
+    {
+      std::lock_guard lock{stream.mutex};
+      stream.state[lump] = ls_ready;
+    }
+    stream.read.notify_all();
+  }
+}
+
+}  // namespace
+
+dboolean W_StreamLumps(const int* const lumps, const int count) {
+  W_StopStreaming();
+
+  // The first lump is read here, which also tells whether the backend can
+  // read lumps in off the main thread at all
+  if (count <= 0 || !W_TouchLumpNum(lumps[0]))
+    return false;
+
+  if (stream.state.size() != static_cast<std::size_t>(numlumps))
+    stream.state = std::vector<std::atomic<unsigned char>>(numlumps);
+  else
+    for (auto& state : stream.state)
+      state.store(ls_none, std::memory_order_relaxed);
+
+  stream.lumps.assign(lumps + 1, lumps + count);
+  for (const int lump : stream.lumps)
+    stream.state[lump].store(ls_queued, std::memory_order_relaxed);
+  stream.state[lumps[0]].store(ls_ready, std::memory_order_relaxed);
+
+  stream.streamed = 1;
+  stream.ready = stream.waited = 0;
+  stream.stop = false;
+  stream.worker = std::thread{StreamWorker};
+  lumpstreaming = true;
+
+  return true;
+}
+
+void W_StreamWaitLump(const int lump) {
+  auto& state = stream.state[lump];
+  unsigned char current = state.load();
+
+  if (current == ls_none || current == ls_used)
+    return;
+
+  if (current == ls_ready) {
+    stream.ready++;
+  } else if (current == ls_queued && state.compare_exchange_strong(current, ls_reading)) {
+    // Not reached yet, read it now rather than after everything before it
+    W_TouchLumpNum(lump);
+    stream.waited++;
+  } else {
+    std::unique_lock lock{stream.mutex};
+    stream.read.wait(lock, [&] { return state.load() != ls_reading; });
+    stream.waited++;
+  }
+
+  state = ls_used;
+}
+
+void W_StopStreaming(void) {
+  if (!stream.worker.joinable())
+    return;
+
+  stream.stop = true;
+  stream.worker.join();
+  lumpstreaming = false;
+
+  lprintf(LO_DEBUG, "W_StopStreaming: %d lumps queued, %d read ahead, %d ready when used, %d waited on\n",
+          static_cast<int>(stream.lumps.size()) + 1, stream.streamed, stream.ready, stream.waited);
+}
@@ -0,0 +1,61 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Background streaming of WAD lumps.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#ifndef __W_STREAM__
+#define __W_STREAM__
+
+#include "doomtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+/* Set while a stream is running; W_CacheLumpNum then calls W_StreamWaitLump */
+extern int lumpstreaming;
+
+/* Reads count lumps in on a worker thread, in the order given, replacing
+ * any stream already running. Returns false if the cache backend can't
+ * read lumps off the main thread, in which case nothing is started */
+dboolean W_StreamLumps(const int *lumps, int count);
+
+/* Blocks until lump has been read in if it is still waiting in the stream */
+void W_StreamWaitLump(int lump);
+
+/* Stops the worker and reports how many lumps were ready when first used */
+void W_StopStreaming(void);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif
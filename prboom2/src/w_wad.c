@@ -52,6 +52,7 @@
 #include "r_main.h"
 
 #include "w_wad.h"
+#include "w_stream.h"
 #include "lprintf.h"
 
 //e6y
@@ -543,6 +544,7 @@ void W_ReleaseAllWads(void)
 {
   size_t i;
 
+  W_StopStreaming();
   W_DoneCache();
 
   for (i = 0; i < numwadfiles; i++)
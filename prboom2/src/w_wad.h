@@ -155,6 +155,10 @@ void    W_ReadLump (int lump, void *dest);
 const void* W_CacheLumpNum (int lump);
 const void* W_LockLumpNum(int lump);
 void    W_UnlockLumpNum(int lump);
+// Hint that a lump will be cached soon, so it can be read ahead
+void    W_WillNeedLumpNum(int lump);
+// Read a lump in from any thread; false if the backend can't do that
+dboolean W_TouchLumpNum(int lump);
 
 // CPhipps - convenience macros
 //#define W_CacheLumpNum(num) (W_CacheLumpNum)((num),1)
@@ -35,89 +35,202 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
+
 #include "doomtype.h"
 #include "z_zone.h"
 #include "z_bmalloc.h"
 #include "lprintf.h"
 
+/* Pools keep a bitmap of their free elements, and the pools with any
+ * free element are linked from the zone, so finding a free element takes
+ * a few word tests. Each element is preceded by a pointer to its pool,
+ * so freeing one doesn't have to search the zone's pools.
+ */
+
 typedef struct bmalpool_s {
-  struct bmalpool_s *nextpool;
-  size_t             blocks;
-  byte               used[0];
+  struct bmalpool_s *next, *prev;     // pools with a free element
+  struct block_memory_alloc_s *zone;
+  size_t             free;            // free elements
+  size_t             hint;            // no free elements in words below
+  unsigned int       freemap[1];      // set bits are free elements
 } bmalpool_t;
 
-inline static void* getelem(bmalpool_t *p, size_t size, size_t n)
+#define MAP_BITS (sizeof(unsigned int) * 8)
+
+// element size, with the pool pointer and padding
+#define ELEM_ALIGN 8
+#define ELEM_HEADER ((sizeof(bmalpool_t *) + ELEM_ALIGN - 1) & ~(ELEM_ALIGN - 1))
+#define ELEM_SIZE(pzone) (ELEM_HEADER + (((pzone)->size + ELEM_ALIGN - 1) & ~(ELEM_ALIGN - 1)))
+
+#define MAP_WORDS(pzone) (((pzone)->perpool + MAP_BITS - 1) / MAP_BITS)
+
+int bmalloc_stats;
+
+static struct block_memory_alloc_s *zones;
+
+inline static byte* getelems(bmalpool_t *pool)
+{
+  size_t words = MAP_WORDS(pool->zone);
+  size_t offset = offsetof(bmalpool_t, freemap) + sizeof(unsigned int) * words;
+
+  return (byte*)pool + ((offset + ELEM_ALIGN - 1) & ~(ELEM_ALIGN - 1));
+}
+
+inline static int lowestbit(unsigned int x)
 {
-  return (((byte*)p) + sizeof(bmalpool_t) + sizeof(byte)*(p->blocks) + size*n);
+#ifdef __GNUC__
+  return __builtin_ctz(x);
+#else
+  int n = 0;
+
+  while (!(x & 1))
+  {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
 }
 
-inline static PUREFUNC int iselem(const bmalpool_t *pool, size_t size, const void* p)
+static void linkpool(struct block_memory_alloc_s *pzone, bmalpool_t *pool)
 {
-  // CPhipps - need portable # of bytes between pointers
-  int dif = (const char*)p - (const char*)pool;
-
-  dif -= sizeof(bmalpool_t);
-  dif -= pool->blocks;
-  if (dif<0) return -1;
-  dif /= size;
-  return (((size_t)dif >= pool->blocks) ? -1 : dif);
+  pool->prev = NULL;
+  if ((pool->next = pzone->firstpool))
+    pool->next->prev = pool;
+  pzone->firstpool = pool;
 }
 
-enum { unused_block = 0, used_block = 1};
+static void unlinkpool(struct block_memory_alloc_s *pzone, bmalpool_t *pool)
+{
+  if (pool->prev)
+    pool->prev->next = pool->next;
+  else
+    pzone->firstpool = pool->next;
+  if (pool->next)
+    pool->next->prev = pool->prev;
+}
 
-void* Z_BMalloc(struct block_memory_alloc_s *pzone)
+static bmalpool_t* newpool(struct block_memory_alloc_s *pzone)
 {
-  register bmalpool_t **pool = (bmalpool_t **)&(pzone->firstpool);
-  while (*pool != NULL) {
-    byte *p = memchr((*pool)->used, unused_block, (*pool)->blocks); // Scan for unused marker
-    if (p) {
-      int n = p - (*pool)->used;
-#ifdef SIMPLECHECKS
-      if ((n<0) || ((size_t)n>=(*pool)->blocks))
-  I_Error("Z_BMalloc: memchr returned pointer outside of array");
-#endif
-      (*pool)->used[n] = used_block;
-      return getelem(*pool, pzone->size, n);
-    } else
-      pool = &((*pool)->nextpool);
-  }
+  size_t words = MAP_WORDS(pzone);
+  size_t i;
+  bmalpool_t *pool;
+
+  if (!pzone->registered)
   {
-    // Nothing available, must allocate a new pool
-    bmalpool_t *newpool;
+    pzone->next = zones;
+    zones = pzone;
+    pzone->registered = true;
+  }
 
-    // CPhipps: Allocate new memory, initialised to 0
+  pool = Z_Malloc(offsetof(bmalpool_t, freemap) + sizeof(unsigned int) * words + ELEM_ALIGN +
+                  ELEM_SIZE(pzone) * pzone->perpool, pzone->tag, NULL);
+  pool->zone = pzone;
+  pool->free = pzone->perpool;
+  pool->hint = 0;
 
-    *pool = newpool = Z_Calloc(sizeof(*newpool) + (sizeof(byte) + pzone->size)*(pzone->perpool),
-             1,  pzone->tag, NULL);
-    newpool->nextpool = NULL; // NULL = (void*)0 so this is redundant
+  for (i = 0; i < words; i++)
+    pool->freemap[i] = ~0u;
+  if (pzone->perpool % MAP_BITS)
+    pool->freemap[words - 1] = (1u << (pzone->perpool % MAP_BITS)) - 1;
 
-    // Return element 0 from this pool to satisfy the request
-    newpool->used[0] = used_block;
-    newpool->blocks = pzone->perpool;
-    return getelem(newpool, pzone->size, 0);
-  }
+  linkpool(pzone, pool);
+  pzone->pools++;
+  return pool;
+}
+
+void* Z_BMalloc(struct block_memory_alloc_s *pzone)
+{
+  bmalpool_t *pool = pzone->firstpool ? pzone->firstpool : newpool(pzone);
+  size_t w = pool->hint, n;
+  byte *elem;
+
+  while (!pool->freemap[w])
+    w++;
+  pool->hint = w;
+
+  n = w * MAP_BITS + lowestbit(pool->freemap[w]);
+  pool->freemap[w] &= pool->freemap[w] - 1;
+
+  if (!--pool->free)
+    unlinkpool(pzone, pool);
+
+  pzone->allocs++;
+  if (++pzone->used > pzone->peak)
+    pzone->peak = pzone->used;
+
+  elem = getelems(pool) + ELEM_SIZE(pzone) * n;
+  *(bmalpool_t **)elem = pool;
+  return elem + ELEM_HEADER;
 }
 
 void Z_BFree(struct block_memory_alloc_s *pzone, void* p)
 {
-  register bmalpool_t **pool = (bmalpool_t**)&(pzone->firstpool);
+  if ((*(bmalpool_t **)((byte*)p - ELEM_HEADER))->zone != pzone)
+    I_Error("Z_BFree: Free not in zone %s", pzone->desc);
+  Z_BFreeAny(p);
+}
+
+void Z_BFreeAny(void* p)
+{
+  byte *elem = (byte*)p - ELEM_HEADER;
+  bmalpool_t *pool = *(bmalpool_t **)elem;
+  struct block_memory_alloc_s *pzone = pool->zone;
+  size_t n = (elem - getelems(pool)) / ELEM_SIZE(pzone);
+  size_t w = n / MAP_BITS;
+  unsigned int bit = 1u << (n % MAP_BITS);
 
-  while (*pool != NULL) {
-    int n = iselem(*pool, pzone->size, p);
-    if (n >= 0) {
 #ifdef SIMPLECHECKS
-      if ((*pool)->used[n] == unused_block)
-  I_Error("Z_BFree: Refree in zone %s", pzone->desc);
+  if (pool->freemap[w] & bit)
+    I_Error("Z_BFree: Refree in zone %s", pzone->desc);
 #endif
-      (*pool)->used[n] = unused_block;
-      if (memchr(((*pool)->used), used_block, (*pool)->blocks) == NULL) {
-  // Block is all unused, can be freed
-  bmalpool_t *oldpool = *pool;
-  *pool = (*pool)->nextpool;
-  Z_Free(oldpool);
-      }
-      return;
-    } else pool = &((*pool)->nextpool);
+
+  pool->freemap[w] |= bit;
+  if (w < pool->hint)
+    pool->hint = w;
+
+  pzone->frees++;
+  pzone->used--;
+
+  if (!pool->free++)
+    linkpool(pzone, pool);
+  else if (pool->free == pzone->perpool && (pool->prev || pool->next))
+  {
+    // Pool is all unused, and not the zone's last free space
+    unlinkpool(pzone, pool);
+    pzone->pools--;
+    Z_Free(pool);
   }
-  I_Error("Z_BFree: Free not in zone %s", pzone->desc);
+}
+
+void Z_BFreeTags(int lowtag, int hightag)
+{
+  struct block_memory_alloc_s *pzone;
+
+  if (bmalloc_stats)
+    Z_BPrintStats();
+
+  for (pzone = zones; pzone; pzone = pzone->next)
+    if (pzone->tag >= lowtag && pzone->tag <= hightag)
+    {
+      pzone->firstpool = NULL;
+      pzone->used = pzone->peak = pzone->pools = 0;
+      pzone->allocs = pzone->frees = 0;
+    }
+}
+
+void Z_BPrintStats(void)
+{
+  struct block_memory_alloc_s *pzone;
+
+  if (!zones)
+    return;
+
+  lprintf(LO_INFO, "Z_BPrintStats:\n%-16s %5s %8s %8s %6s %10s %10s\n",
+          "zone", "size", "used", "peak", "pools", "allocs", "frees");
+  for (pzone = zones; pzone; pzone = pzone->next)
+    lprintf(LO_INFO, "%-16s %5u %8d %8d %6d %10u %10u\n",
+            pzone->desc, (unsigned int)pzone->size, pzone->used, pzone->peak,
+            pzone->pools, pzone->allocs, pzone->frees);
 }
@@ -39,17 +39,24 @@ extern "C" {
 #endif  // __cplusplus
 
 struct block_memory_alloc_s {
-  void  *firstpool;
+  void  *firstpool;   // pools with a free element
   size_t size;
   size_t perpool;
   int    tag;
   const char *desc;
+
+  // usage since the zone's tag was last freed
+  int    used, peak, pools;
+  unsigned int allocs, frees;
+
+  struct block_memory_alloc_s *next;  // zones in use, for Z_BFreeTags
+  int    registered;
 };
 
 #define DECLARE_BLOCK_MEMORY_ALLOC_ZONE(name) extern struct block_memory_alloc_s name
 #define IMPLEMENT_BLOCK_MEMORY_ALLOC_ZONE(name, size, tag, num, desc) \
 struct block_memory_alloc_s name = { NULL, size, num, tag, desc}
-#define NULL_BLOCK_MEMORY_ALLOC_ZONE(name) name.firstpool = NULL
+#define NULL_BLOCK_MEMORY_ALLOC_ZONE(name) (name.firstpool = NULL, name.used = name.pools = 0)
 
 void* Z_BMalloc(struct block_memory_alloc_s *pzone);
 
@@ -58,6 +65,18 @@ inline static void* Z_BCalloc(struct block_memory_alloc_s *pzone)
 
 void Z_BFree(struct block_memory_alloc_s *pzone, void* p);
 
+// Frees an element of any zone
+void Z_BFreeAny(void* p);
+
+// Forgets the pools of zones with these tags, after Z_FreeTags freed them
+void Z_BFreeTags(int lowtag, int hightag);
+
+// Prints the usage of each zone in use
+void Z_BPrintStats(void);
+
+// If set, Z_BFreeTags prints usage before forgetting pools
+extern int bmalloc_stats;
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif  // __cplusplus
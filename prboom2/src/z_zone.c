@@ -55,6 +55,7 @@
 #include "v_video.h"
 #include "g_game.h"
 #include "lprintf.h"
+#include "i_system.h"
 
 #ifdef DJGPP
 #include <dpmi.h>
@@ -85,6 +86,18 @@
 // Number of mallocs & frees kept in history buffer (must be a power of 2)
 #define ZONE_HISTORY 4
 
+// Largest block, header included, taken from a level arena
+#define ARENA_MAX_BLOCK 4096
+
+// Size of the chunks level arenas are carved from
+#define ARENA_CHUNK_SIZE (1024*1024)
+
+// Call sites the profiler tells apart (must be a power of 2)
+#define PROFILE_SITES 4096
+
+// Site of a block the profiler isn't counting, or has seen freed
+#define PROFILE_NOSITE 0xffff
+
 // End Tunables
 
 typedef struct memblock {
@@ -97,6 +110,8 @@ typedef struct memblock {
   size_t size;
   void **user;
   unsigned char tag;
+  unsigned char arena;        // block lives in a level arena
+  unsigned short site;        // profiler call site, 0 for the rest, or PROFILE_NOSITE
 
 #ifdef INSTRUMENTED
   const char *file;
@@ -112,6 +127,38 @@ static const size_t HEADER_SIZE = (sizeof(memblock_t)+CHUNK_SIZE-1) & ~(CHUNK_SI
 
 static memblock_t *blockbytag[PU_MAX];
 
+/* Level arenas
+ * PU_LEVEL and PU_LEVSPEC blocks are bump allocated from large chunks
+ * rather than malloc'd one by one, and Z_FreeTags drops them all at once
+ * on level exit. Z_Free'd arena blocks are kept on free lists by size, so
+ * the mobjs and thinkers a level churns through are recycled. Blocks too
+ * big for an arena, and blocks Z_ChangeTag'd to a level tag, are malloc'd
+ * and kept in blockbytag[] as before. -nolevelarena turns arenas off, so
+ * memory debuggers see every level block.
+ *
+ * Arena blocks are only linked (through next/prev) while they have a
+ * user, to nullify it on reset, or while free (through next).
+ */
+
+typedef struct arenachunk {
+  struct arenachunk *next;
+  char *top;              // end of the blocks in it, once full
+} arenachunk_t;
+
+typedef struct {
+  arenachunk_t *chunks;   // every chunk, kept across levels
+  arenachunk_t *chunk;    // chunk being filled, NULL before the first
+  char *top, *end;        // unused part of chunk
+  memblock_t *freeblocks[ARENA_MAX_BLOCK / CHUNK_SIZE + 1];
+  memblock_t *owned;      // live blocks with a user
+  size_t used;            // size of live blocks
+} arena_t;
+
+static const size_t ARENA_CHUNK_HEADER = (sizeof(arenachunk_t)+CHUNK_SIZE-1) & ~(CHUNK_SIZE-1);
+
+static arena_t levelarena[PU_LEVSPEC - PU_LEVEL + 1];
+static dboolean use_arenas;
+
 // 0 means unlimited, any other value is a hard limit
 //static int memory_size = 8192*1024;
 static int memory_size = 0;
@@ -217,6 +264,11 @@ void Z_DumpMemory(void)
       block=block->next;
     }
   }
+  for (tag = PU_LEVEL; tag <= PU_LEVSPEC; tag++)
+  {
+    fprintf(fp, "arena %d:%d\n", tag, (int)levelarena[tag - PU_LEVEL].used);
+    total_malloc += levelarena[tag - PU_LEVEL].used;
+  }
   fprintf(fp, "malloc %d, cache %d, free %d, total %d\n",
     total_malloc, total_cache, total_free, 
     total_malloc + total_cache + total_free);
@@ -267,6 +319,377 @@ void Z_DumpHistory(char *buf)
 
 #endif
 
+/* Allocation profiler
+ * -zoneprofile [file] counts allocations and frees, and live and peak
+ * bytes, by tag and by call site, and the allocations made each tic.
+ * The report is written when the program exits, or when
+ * key_zoneprofile is pressed.
+ *
+ * Call sites are file and line in INSTRUMENTED builds, and return
+ * addresses otherwise. On ELF systems these are printed as offsets
+ * into the executable, for addr2line -f -e prboom-plus. Blocks carry
+ * their site's index, so frees can be charged to it. Once the table
+ * is half full new sites share index 0, printed as "(other)".
+ */
+
+#if defined(__GNUC__)
+#define Z_CALLER() __builtin_return_address(0)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define Z_CALLER() _ReturnAddress()
+#else
+#define Z_CALLER() NULL
+#endif
+
+typedef struct {
+  const void *addr;
+  const char *file;
+  int line;
+  unsigned int allocs, frees;
+  size_t bytes;           // allocated in total
+  size_t live, peak;
+  int tics, lasttic;      // tics it allocated in
+} zonesite_t;
+
+typedef struct {
+  unsigned int allocs, frees, blocks;
+  size_t bytes, live, peak;
+} zonetag_t;
+
+static const char *zoneprofile;   // report file, or NULL if not profiling
+static zonesite_t zonesites[PROFILE_SITES];
+static int numzonesites;
+static zonetag_t zonetags[PU_MAX];
+
+// site of the Z_Malloc in progress, if not its caller
+static const void *zonecaller;
+
+static struct {
+  int tic, starttic;
+  unsigned int allocs, peakallocs;
+  size_t bytes, peakbytes;
+  int peaktic;
+} zonetics;
+
+static unsigned short Z_ProfileSite(const void *addr, const char *file, int line)
+{
+  size_t h = file ? (size_t) file * 31 + line : (size_t) addr;
+  unsigned short i;
+
+  h ^= h >> 15;
+  for (i = (h * 2654435761u) & (PROFILE_SITES-1); i == 0 || zonesites[i].allocs; i = (i+1) & (PROFILE_SITES-1))
+    if (i && zonesites[i].addr == addr && zonesites[i].file == file && zonesites[i].line == line)
+      return i;
+
+  if (numzonesites >= PROFILE_SITES/2)
+    return 0;                // table full, stop telling sites apart
+
+  numzonesites++;
+  zonesites[i].addr = addr;
+  zonesites[i].file = file;
+  zonesites[i].line = line;
+  zonesites[i].lasttic = -1;
+  return i;
+}
+
+static void Z_ProfileAlloc(memblock_t *block, const void *addr, const char *file, int line)
+{
+  zonetag_t *t = &zonetags[block->tag];
+  zonesite_t *site;
+
+  if (gametic != zonetics.tic)
+  {
+    if (zonetics.allocs > zonetics.peakallocs)
+    {
+      zonetics.peakallocs = zonetics.allocs;
+      zonetics.peaktic = zonetics.tic;
+    }
+    if (zonetics.bytes > zonetics.peakbytes)
+      zonetics.peakbytes = zonetics.bytes;
+    zonetics.allocs = 0;
+    zonetics.bytes = 0;
+    zonetics.tic = gametic;
+  }
+  zonetics.allocs++;
+  zonetics.bytes += block->size;
+
+  t->allocs++;
+  t->blocks++;
+  t->bytes += block->size;
+  if ((t->live += block->size) > t->peak)
+    t->peak = t->live;
+
+  block->site = Z_ProfileSite(addr, file, line);
+  site = &zonesites[block->site];
+  site->allocs++;
+  site->bytes += block->size;
+  if ((site->live += block->size) > site->peak)
+    site->peak = site->live;
+  if (site->lasttic != gametic)
+  {
+    site->lasttic = gametic;
+    site->tics++;
+  }
+}
+
+static void Z_ProfileFree(memblock_t *block)
+{
+  zonetag_t *t = &zonetags[block->tag];
+
+  t->frees++;
+  t->blocks--;
+  t->live -= block->size;
+
+  if (block->site != PROFILE_NOSITE)
+  {
+    zonesites[block->site].frees++;
+    zonesites[block->site].live -= block->size;
+    block->site = PROFILE_NOSITE;
+  }
+}
+
+static void Z_ProfileChangeTag(memblock_t *block, int tag)
+{
+  zonetags[block->tag].blocks--;
+  zonetags[block->tag].live -= block->size;
+  zonetags[tag].blocks++;
+  if ((zonetags[tag].live += block->size) > zonetags[tag].peak)
+    zonetags[tag].peak = zonetags[tag].live;
+}
+
+static void Z_PrintSite(FILE *fp, const zonesite_t *site)
+{
+  if (site->file)
+    fprintf(fp, "%s:%d", site->file, site->line);
+  else
+  {
+#ifdef __ELF__
+    extern char __executable_start;
+    fprintf(fp, "+0x%lx", (unsigned long)((const char *) site->addr - &__executable_start));
+#else
+    fprintf(fp, "%p", site->addr);
+#endif
+  }
+}
+
+static int Z_CompareSites(const void *a, const void *b)
+{
+  size_t x = zonesites[*(const unsigned short *) a].bytes;
+  size_t y = zonesites[*(const unsigned short *) b].bytes;
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void Z_ProfileDump(void)
+{
+  static const char *const tagnames[PU_MAX] = {
+    "free", "static", "sound", "music", "level", "levspec", "cache"
+  };
+  unsigned short order[PROFILE_SITES];
+  int tics, n = 0, i;
+  FILE *fp;
+
+  if (!zoneprofile)
+    return;
+
+  if (!(fp = M_fopen(zoneprofile, "w")))
+  {
+    lprintf(LO_WARN, "Z_ProfileDump: Couldn't write %s\n", zoneprofile);
+    return;
+  }
+
+  tics = gametic - zonetics.starttic;
+  fprintf(fp, "Zone profile over %d tics\n\n", tics);
+
+  fprintf(fp, "%-8s %10s %10s %8s %12s %12s %12s\n",
+          "tag", "allocs", "frees", "blocks", "bytes", "live", "peak");
+  for (i = PU_STATIC; i < PU_MAX; i++)
+    fprintf(fp, "%-8s %10u %10u %8u %12lu %12lu %12lu\n", tagnames[i],
+            zonetags[i].allocs, zonetags[i].frees, zonetags[i].blocks,
+            (unsigned long) zonetags[i].bytes, (unsigned long) zonetags[i].live,
+            (unsigned long) zonetags[i].peak);
+
+  // the tic in progress counts too
+  fprintf(fp, "\nBusiest tic: %u allocations (tic %d), most bytes in a tic: %lu\n\n",
+          MAX(zonetics.allocs, zonetics.peakallocs),
+          zonetics.allocs > zonetics.peakallocs ? zonetics.tic : zonetics.peaktic,
+          (unsigned long) MAX(zonetics.bytes, zonetics.peakbytes));
+
+  for (i = 0; i < PROFILE_SITES; i++)
+    if (zonesites[i].allocs)
+      order[n++] = i;
+  qsort(order, n, sizeof(order[0]), Z_CompareSites);
+
+  fprintf(fp, "%10s %10s %12s %12s %12s %10s %8s  site\n",
+          "allocs", "frees", "bytes", "live", "peak", "allocs/tic", "tics");
+  for (i = 0; i < n; i++)
+  {
+    const zonesite_t *site = &zonesites[order[i]];
+
+    fprintf(fp, "%10u %10u %12lu %12lu %12lu %10.2f %8d  ",
+            site->allocs, site->frees, (unsigned long) site->bytes,
+            (unsigned long) site->live, (unsigned long) site->peak,
+            tics > 0 ? (double) site->allocs / tics : 0.0, site->tics);
+    if (order[i])
+      Z_PrintSite(fp, site);
+    else
+      fprintf(fp, "(other)");
+    fputc('\n', fp);
+  }
+
+  fclose(fp);
+  lprintf(LO_INFO, "Z_ProfileDump: Wrote %s\n", zoneprofile);
+}
+
+// Returns the arena for blocks of this tag, or NULL
+static arena_t *Z_Arena(int tag)
+{
+  return use_arenas && tag >= PU_LEVEL && tag <= PU_LEVSPEC ?
+    &levelarena[tag - PU_LEVEL] : NULL;
+}
+
+static memblock_t *Z_ArenaAlloc(arena_t *arena, size_t size)
+{
+  memblock_t *block = arena->freeblocks[size / CHUNK_SIZE];
+
+  if (block)
+  {
+    arena->freeblocks[size / CHUNK_SIZE] = block->next;
+    return block;
+  }
+
+  if ((size_t)(arena->end - arena->top) < size + HEADER_SIZE)
+  {
+    // move on to the next chunk, reusing those of earlier levels
+    arenachunk_t *chunk = arena->chunk ? arena->chunk->next : arena->chunks;
+
+    if (arena->chunk)
+      arena->chunk->top = arena->top;
+    if (!chunk)
+    {
+      if (!(chunk = (malloc)(ARENA_CHUNK_SIZE)))
+        return NULL;
+      chunk->next = NULL;
+      if (arena->chunk)
+        arena->chunk->next = chunk;
+      else
+        arena->chunks = chunk;
+    }
+
+    arena->chunk = chunk;
+    arena->top = (char *) chunk + ARENA_CHUNK_HEADER;
+    arena->end = (char *) chunk + ARENA_CHUNK_SIZE;
+  }
+
+  block = (memblock_t *) arena->top;
+  arena->top += size + HEADER_SIZE;
+  return block;
+}
+
+// Resizes the block last bumped from its arena in place, if there's room
+static dboolean Z_ArenaResize(memblock_t *block, size_t size)
+{
+  arena_t *arena = &levelarena[block->tag - PU_LEVEL];
+  char *start = (char *) block + HEADER_SIZE;
+
+  size = (size+CHUNK_SIZE-1) & ~(CHUNK_SIZE-1);
+
+  if (start + block->size != arena->top ||
+      size + HEADER_SIZE > ARENA_MAX_BLOCK || start + size > arena->end)
+    return false;
+
+  if (zoneprofile)
+  {
+    zonetag_t *t = &zonetags[block->tag];
+
+    if (size > block->size)
+      t->bytes += size - block->size;
+    if ((t->live += size - block->size) > t->peak)
+      t->peak = t->live;
+    if (block->site != PROFILE_NOSITE)
+    {
+      zonesite_t *site = &zonesites[block->site];
+
+      if (size > block->size)
+        site->bytes += size - block->size;
+      if ((site->live += size - block->size) > site->peak)
+        site->peak = site->live;
+    }
+  }
+
+  arena->top = start + size;
+  arena->used += size - block->size;
+  free_memory -= (int) size - (int) block->size;
+#ifdef INSTRUMENTED
+  active_memory += (int) size - (int) block->size;
+#endif
+  block->size = size;
+  return true;
+}
+
+static void Z_ArenaReset(arena_t *arena)
+{
+  memblock_t *block;
+
+  for (block = arena->owned; block; block = block->next)
+    *block->user = NULL;
+
+  // charge the blocks being dropped to their call sites
+  if (zoneprofile && arena->chunk)
+  {
+    arenachunk_t *chunk = arena->chunks;
+    int tag = arena - levelarena + PU_LEVEL;
+
+    while (1)
+    {
+      char *top = chunk == arena->chunk ? arena->top : chunk->top;
+      char *p;
+
+      for (p = (char *) chunk + ARENA_CHUNK_HEADER; p < top; p += HEADER_SIZE + block->size)
+      {
+        block = (memblock_t *) p;
+        if (block->site != PROFILE_NOSITE)
+        {
+          zonesites[block->site].frees++;
+          zonesites[block->site].live -= block->size;
+        }
+      }
+      if (chunk == arena->chunk)
+        break;
+      chunk = chunk->next;
+    }
+
+    zonetags[tag].frees += zonetags[tag].blocks;
+    zonetags[tag].live -= arena->used;
+    zonetags[tag].blocks = 0;
+  }
+
+#if defined(ZONEIDCHECK) || defined(INSTRUMENTED)
+  // scramble memory, wiping ids so stale pointers fail Z_Free
+  if (arena->chunk)
+  {
+    arenachunk_t *chunk;
+
+    for (chunk = arena->chunks; chunk != arena->chunk; chunk = chunk->next)
+      memset((char *) chunk + ARENA_CHUNK_HEADER, gametic & 0xff,
+             ARENA_CHUNK_SIZE - ARENA_CHUNK_HEADER);
+    memset((char *) chunk + ARENA_CHUNK_HEADER, gametic & 0xff,
+           arena->top - ((char *) chunk + ARENA_CHUNK_HEADER));
+  }
+#endif
+
+  free_memory += arena->used;
+#ifdef INSTRUMENTED
+  active_memory -= arena->used;
+#endif
+
+  memset(arena->freeblocks, 0, sizeof(arena->freeblocks));
+  arena->owned = NULL;
+  arena->used = 0;
+  arena->chunk = NULL;
+  arena->top = arena->end = NULL;
+}
+
 void Z_Close(void)
 {
 #if 0
@@ -277,6 +700,8 @@ void Z_Close(void)
 
 void Z_Init(void)
 {
+  int p;
+
 #if 0
   size_t size = zone_size*1000;
 
@@ -324,6 +749,17 @@ void Z_Init(void)
   I_AtExit(Z_DumpMemory, true);
 #endif
 #endif
+
+#ifndef HAVE_LIBDMALLOC
+  use_arenas = !M_CheckParm("-nolevelarena");
+#endif
+
+  if ((p = M_CheckParm("-zoneprofile")))
+  {
+    zoneprofile = p < myargc-1 && *myargv[p+1] != '-' ? myargv[p+1] : "zoneprofile.txt";
+    zonetics.starttic = zonetics.tic = gametic;
+    I_AtExit(Z_ProfileDump, true);
+  }
 }
 
 /* Z_Malloc
@@ -345,6 +781,12 @@ void *(Z_Malloc)(size_t size, int tag, void **user
      )
 {
   memblock_t *block = NULL;
+  arena_t *arena;
+#ifndef INSTRUMENTED
+  const void *caller = zonecaller ? zonecaller : Z_CALLER();
+#endif
+
+  zonecaller = NULL;
 
 #ifdef INSTRUMENTED
 #ifdef CHECKHEAP
@@ -370,6 +812,8 @@ void *(Z_Malloc)(size_t size, int tag, void **user
 
   size = (size+CHUNK_SIZE-1) & ~(CHUNK_SIZE-1);  // round to chunk size
 
+  arena = size + HEADER_SIZE <= ARENA_MAX_BLOCK ? Z_Arena(tag) : NULL;
+
   if (memory_size > 0 && ((free_memory + memory_size) < (int)(size + HEADER_SIZE)))
   {
     memblock_t *end_block;
@@ -396,7 +840,7 @@ void *(Z_Malloc)(size_t size, int tag, void **user
 #ifdef HAVE_LIBDMALLOC
   while (!(block = dmalloc_malloc(file,line,size + HEADER_SIZE,DMALLOC_FUNC_MALLOC,0,0))) {
 #else
-  while (!(block = (malloc)(size + HEADER_SIZE))) {
+  while (!(block = arena ? Z_ArenaAlloc(arena, size) : (malloc)(size + HEADER_SIZE))) {
 #endif
     if (!blockbytag[PU_CACHE])
       I_Error ("Z_Malloc: Failure trying to allocate %lu bytes"
@@ -411,7 +855,19 @@ void *(Z_Malloc)(size_t size, int tag, void **user
     Z_FreeTags(PU_CACHE,PU_CACHE);
   }
 
-  if (!blockbytag[tag])
+  if (arena)
+  {
+    block->prev = NULL;
+    block->next = NULL;
+    if (user)
+    {
+      if ((block->next = arena->owned))
+        block->next->prev = block;
+      arena->owned = block;
+    }
+    arena->used += size;
+  }
+  else if (!blockbytag[tag])
   {
     blockbytag[tag] = block;
     block->next = block->prev = block;
@@ -443,7 +899,15 @@ void *(Z_Malloc)(size_t size, int tag, void **user
   block->id = ZONEID;         // signature required in block header
 #endif
   block->tag = tag;           // tag
+  block->arena = arena != NULL;
   block->user = user;         // user
+  block->site = PROFILE_NOSITE;
+  if (zoneprofile)
+#ifdef INSTRUMENTED
+    Z_ProfileAlloc(block, NULL, file, line);
+#else
+    Z_ProfileAlloc(block, caller, NULL, 0);
+#endif
   block = (memblock_t *)((char *) block + HEADER_SIZE);
   if (user)                   // if there is a user
     *user = block;            // set user to point to new block
@@ -490,9 +954,43 @@ void (Z_Free)(void *p
   block->id = 0;              // Nullify id so another free fails
 #endif
 
+  if (zoneprofile)
+    Z_ProfileFree(block);
+
   if (block->user)            // Nullify user if one exists
     *block->user = NULL;
 
+  if (block->arena)
+  {
+    arena_t *arena = &levelarena[block->tag - PU_LEVEL];
+
+    if (block->user)
+    {
+      if (block->prev)
+        block->prev->next = block->next;
+      else
+        arena->owned = block->next;
+      if (block->next)
+        block->next->prev = block->prev;
+    }
+
+    arena->used -= block->size;
+    free_memory += block->size;
+#ifdef INSTRUMENTED
+    active_memory -= block->size;
+
+    /* scramble memory -- weed out any bugs */
+    memset((char *) block + HEADER_SIZE, gametic & 0xff, block->size);
+#endif
+
+    block->next = arena->freeblocks[block->size / CHUNK_SIZE];
+    arena->freeblocks[block->size / CHUNK_SIZE] = block;
+#ifdef INSTRUMENTED
+    Z_DrawStats();           // print memory allocation stats
+#endif
+    return;
+  }
+
   if (block == block->next)
     blockbytag[block->tag] = NULL;
   else
@@ -528,6 +1026,8 @@ void (Z_FreeTags)(int lowtag, int hightag
 #endif
                  )
 {
+  int tag;
+
 #ifdef HEAPDUMP
   Z_DumpMemory();
 #endif
@@ -538,10 +1038,10 @@ void (Z_FreeTags)(int lowtag, int hightag
   if (hightag > PU_CACHE)
     hightag = PU_CACHE;
 
-  for (;lowtag <= hightag; lowtag++)
+  for (tag = lowtag; tag <= hightag; tag++)
   {
     memblock_t *block, *end_block;
-    block = blockbytag[lowtag];
+    block = blockbytag[tag];
     if (!block)
       continue;
     end_block = block->prev;
@@ -558,6 +1058,10 @@ void (Z_FreeTags)(int lowtag, int hightag
       block = next;               // Advance to next block
     }
   }
+
+  for (tag = lowtag; tag <= hightag; tag++)
+    if (tag >= PU_LEVEL && tag <= PU_LEVSPEC)
+      Z_ArenaReset(&levelarena[tag - PU_LEVEL]);
 }
 
 void (Z_ChangeTag)(void *ptr, int tag
@@ -603,6 +1107,16 @@ void (Z_ChangeTag)(void *ptr, int tag
 
 #endif // ZONEIDCHECK
 
+  // an arena block can't outlive its arena
+  if (block->arena)
+    I_Error ("Z_ChangeTag: can't change the tag of a level arena block"
+#ifdef INSTRUMENTED
+             "\nSource: %s:%d"
+             "\nSource of malloc: %s:%d"
+             , file, line, block->file, block->line
+#endif
+            );
+
   if (block == block->next)
     blockbytag[block->tag] = NULL;
   else
@@ -638,6 +1152,9 @@ void (Z_ChangeTag)(void *ptr, int tag
     }
 #endif
 
+  if (zoneprofile)
+    Z_ProfileChangeTag(block, tag);
+
   block->tag = tag;
 }
 
@@ -647,7 +1164,21 @@ void *(Z_Realloc)(void *ptr, size_t n, int tag, void **user
 #endif
                  )
 {
-  void *p = (Z_Malloc)(n, tag, user DA(file, line));
+  void *p;
+
+  if (ptr && n)
+    {
+      memblock_t *block = (memblock_t *)((char *) ptr - HEADER_SIZE);
+
+      // level code often grows its newest block a little at a time
+      if (block->arena && block->tag == tag && block->user == user &&
+          Z_ArenaResize(block, n))
+        return ptr;
+    }
+
+  if (zoneprofile)
+    zonecaller = Z_CALLER();
+  p = (Z_Malloc)(n, tag, user DA(file, line));
   if (ptr)
     {
       memblock_t *block = (memblock_t *)((char *) ptr - HEADER_SIZE);
@@ -665,8 +1196,11 @@ void *(Z_Calloc)(size_t n1, size_t n2, int tag, void **user
 #endif
                 )
 {
-  return
-    (n1*=n2) ? memset((Z_Malloc)(n1, tag, user DA(file, line)), 0, n1) : NULL;
+  if (!(n1*=n2))
+    return NULL;
+  if (zoneprofile)
+    zonecaller = Z_CALLER();
+  return memset((Z_Malloc)(n1, tag, user DA(file, line)), 0, n1);
 }
 
 char *(Z_Strdup)(const char *s, int tag, void **user
@@ -675,6 +1209,8 @@ char *(Z_Strdup)(const char *s, int tag, void **user
 #endif
                 )
 {
+  if (zoneprofile)
+    zonecaller = Z_CALLER();
   return strcpy((Z_Malloc)(strlen(s)+1, tag, user DA(file, line)), s);
 }
 
@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""Plays a short headless netgame through the server's network simulator
+
+    netsim.py path/to/prboom-plus-game-server [latency,jitter,loss,reorder]
+
+Starts the server with -S and two scripted players that speak protocol
+version 0 (raw ticcmds, little endian like all Doom packets) over
+loopback, and checks that
+ - both players ran every tic, with the same commands, despite the losses
+ - a second run with the same seed gave each packet the fate it had in
+   the first, and a run with another seed did not
+ - in a last run where one player asks for version 1 (delta coded
+   ticcmds), the server agrees to it for that player only, and both
+   still run the same commands
+The fates come from the server's -v -v -v trace, one line per packet.
+"""
+import re
+import select
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+PKT_INIT, PKT_SETUP, PKT_GO, PKT_TICC, PKT_TICS, PKT_RETRANS = 0, 1, 2, 3, 4, 5
+PKT_QUIT, PKT_DOWN = 7, 8
+PKT_DTICC, PKT_DTICS = 11, 12
+
+TICS = 350        # length of the game
+AHEAD = 8         # tics a player may make before the server runs them
+TICCMD = '<bbhhBB'
+TICCMD_SIZE = struct.calcsize(TICCMD)
+TIMEOUT = 60
+
+# Fields of a delta coded ticcmd, in the order of their flags
+TD_FIELDS = ((1, 0, 'b'), (2, 1, 'b'), (4, 2, 'zigzag'), (8, 3, 'zigzag'),
+             (16, 4, 'B'), (32, 5, 'B'))
+
+def packet(type, tic, data=b'', version=0):
+    body = struct.pack('<BBBI', type, version, 0, tic) + data
+    return bytes([sum(body) & 0xff]) + body
+
+def delta(cmd, base):
+    """A ticcmd as protocol.h's TicToDelta writes it"""
+    cmd, base = struct.unpack(TICCMD, cmd), struct.unpack(TICCMD, base)
+    flags, out = 0, b''
+    for flag, i, kind in TD_FIELDS:
+        if cmd[i] == base[i]:
+            continue
+        flags |= flag
+        if kind == 'zigzag':
+            d = (cmd[i] - base[i] + 0x8000) % 0x10000 - 0x8000
+            v = d << 1 if d >= 0 else ((-(d + 1)) << 1) | 1
+            while v >= 0x80:
+                out += bytes([v & 0x7f | 0x80])
+                v >>= 7
+            out += bytes([v])
+        else:
+            out += struct.pack(kind, cmd[i])
+    return bytes([flags]) + out
+
+def undelta(body, p, base):
+    """Reads a ticcmd written by TicToDelta, returns it and where it ends"""
+    cmd, flags = list(struct.unpack(TICCMD, base)), body[p]
+    p += 1
+    for flag, i, kind in TD_FIELDS:
+        if not flags & flag:
+            continue
+        if kind == 'zigzag':
+            v = shift = 0
+            while True:
+                v |= (body[p] & 0x7f) << shift
+                shift += 7
+                p += 1
+                if not body[p - 1] & 0x80:
+                    break
+            d = -(v >> 1) - 1 if v & 1 else v >> 1
+            cmd[i] = (cmd[i] + d + 0x8000) % 0x10000 - 0x8000
+        else:
+            cmd[i] = struct.unpack_from(kind, body, p)[0]
+            p += 1
+    return struct.pack(TICCMD, *cmd), p
+
+def command(player, tic):
+    return struct.pack(TICCMD, player * 10 + tic % 3, (tic // 50) & 1,
+                       (tic * 37 * (player + 1)) & 0x7fff, 0, 0, tic % 11 == 0)
+
+ZERO = bytes(TICCMD_SIZE)
+
+class Player:
+    def __init__(self, port, version=0):
+        self.version = version  # the protocol asked for, then the one agreed
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(('127.0.0.1', 0))
+        self.server = ('127.0.0.1', port)
+        self.stage = 'join'
+        self.player = None
+        self.maketic = 0
+        self.remotetic = 0    # tics had back from the server
+        self.ran = []         # each tic's commands, as the server sent them
+        self.last = 0.0       # when we last sent, or last heard new tics
+        self.start = None
+
+    def send(self, type, tic, data=b'', version=0):
+        self.sock.sendto(packet(type, tic, data, version), self.server)
+        self.last = time.time()
+
+    def receive(self):
+        data = self.sock.recv(65536)
+        if len(data) < 8 or sum(data[1:]) & 0xff != data[0]:
+            return
+        type, tic, body = data[1], struct.unpack('<I', data[4:8])[0], data[8:]
+        if type == PKT_SETUP and self.stage == 'join':
+            self.player = body[1]
+            self.version = data[2]
+            self.stage = 'confirm'
+        elif type == PKT_GO and self.stage == 'confirm':
+            self.stage = 'play'
+            self.start = time.time()
+        elif type == (PKT_DTICS if self.version else PKT_TICS) and self.stage in ('play', 'quit'):
+            if tic > self.remotetic:
+                # Missed some, ask again from the first we haven't had
+                self.send(PKT_RETRANS, self.remotetic, bytes([self.player]))
+                return
+            p, last = 1, {}
+            for t in range(tic, tic + body[0]):
+                cmds = {}
+                if self.version:
+                    # Each player's base is their command the tic before
+                    players = body[p]
+                    p += 1
+                    for pl in range(8):
+                        if players & 1 << pl:
+                            cmds[pl], p = undelta(body, p, last.get(pl, ZERO))
+                    last = cmds
+                else:
+                    n = body[p]
+                    p += 1
+                    for i in range(n):
+                        cmds[body[p]] = body[p + 1:p + 1 + TICCMD_SIZE]
+                        p += 1 + TICCMD_SIZE
+                if t == self.remotetic:
+                    self.ran.append(cmds)
+                    self.remotetic += 1
+                    self.last = time.time()
+
+    def step(self, now):
+        if self.stage == 'join' and now - self.last > 0.3:
+            self.send(PKT_INIT, 0, b'\0\0', self.version)
+        elif self.stage == 'confirm' and now - self.last > 0.1:
+            self.send(PKT_GO, 0, bytes([self.player]))
+        elif self.stage == 'play':
+            made = False
+            while (self.maketic < TICS and self.maketic < self.remotetic + AHEAD
+                   and self.maketic < (now - self.start) * 35):
+                self.maketic += 1
+                made = True
+            if self.remotetic >= TICS:
+                self.stage = 'quit'
+            elif made or now - self.last > 0.1:
+                # Everything the server might not have run yet
+                tics = range(self.remotetic, self.maketic)
+                cmds = [command(self.player, t) for t in tics]
+                if self.version:
+                    data = b''.join(delta(c, b) for c, b in zip(cmds, [ZERO] + cmds))
+                else:
+                    data = b''.join(cmds)
+                self.send(PKT_DTICC if self.version else PKT_TICC, self.remotetic,
+                          bytes([len(tics), self.player]) + data)
+                if not made:
+                    self.send(PKT_RETRANS, self.remotetic, bytes([self.player]))
+        elif self.stage == 'quit' and now - self.last > 0.1:
+            # Until the server goes, as the simulator may lose these too
+            self.send(PKT_QUIT, TICS, bytes([self.player]))
+
+def play(server, spec, port, versions=(0, 0)):
+    out = tempfile.TemporaryFile()
+    proc = subprocess.Popen([server, '-N', '2', '-p', str(port), '-S', spec, '-v', '-v', '-v'],
+                            stdout=out, stderr=subprocess.STDOUT)
+    time.sleep(0.5)
+    players = [Player(port, v) for v in versions]
+    deadline = time.time() + TIMEOUT
+    while proc.poll() is None:
+        if time.time() > deadline:
+            proc.kill()
+            sys.exit('timed out: ' + ', '.join('%s at %d' % (p.stage, p.remotetic) for p in players))
+        ready = select.select([p.sock for p in players], [], [], 0.005)[0]
+        for p in players:
+            if p.sock in ready:
+                p.receive()
+            p.step(time.time())
+    out.seek(0)
+    log = out.read().decode('latin-1')
+    for p in players:
+        p.sock.close()
+
+    for p, v in zip(players, versions):
+        if p.version != v:
+            sys.exit('player %d asked for protocol %d, got %d' % (p.player, v, p.version))
+        if len(p.ran) < TICS:
+            sys.exit('player %d ran %d of %d tics' % (p.player, len(p.ran), TICS))
+        for t, cmds in enumerate(p.ran[:TICS]):
+            for pl in (0, 1):
+                if cmds.get(pl) != command(pl, t):
+                    sys.exit('player %d tic %d: wrong commands for player %d' % (p.player, t, pl))
+    fates = dict(((d, int(n)), f) for d, n, f in re.findall(r'netsim (in|out) (\d+): (lost|\+\d+ms(?: reordered)?)', log))
+    report = re.search(r'simulated .*', log)
+    print('%s: %d packets traced, %s' % (spec, len(fates), report.group(0) if report else 'no report'))
+    return fates
+
+def same(a, b):
+    common = set(a) & set(b)
+    return common and all(a[k] == b[k] for k in common)
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    server = sys.argv[1]
+    spec = sys.argv[2] if len(sys.argv) > 2 else '40,20,10,10'
+
+    first = play(server, spec + ',7', 5130)
+    second = play(server, spec + ',7', 5131)
+    other = play(server, spec + ',8', 5132)
+    if not same(first, second):
+        sys.exit('the same seed gave different fates')
+    if same(first, other):
+        sys.exit('another seed gave the same fates')
+    play(server, spec + ',7', 5133, (1, 0))
+    lost = sum(f == 'lost' for f in first.values())
+    print('ok, %d of %d packets lost' % (lost, len(first)))
+
+if __name__ == '__main__':
+    main()